@@ -1,4 +1,5 @@
 #include <ast/ast.h>
+#include <ast/spawn.h>
 #include <err.h>
 #include <evalexpr/eval_exp.h>
 #include <getopt.h>
@@ -8,6 +9,8 @@
 #include <stdlib.h>
 #include <time.h>
 #include <unistd.h>
+#include <utils/intern.h>
+#include <utils/slab.h>
 #include <utils/utils.h>
 #include <utils/vec.h>
 
@@ -15,57 +18,7 @@ struct global *global = NULL;
 
 static void setinitvars(int argc, char **argv)
 {
-    char *value = my_itoa(argc - 1 < 0 ? 0 : argc - 1);
-    char *var = build_var("#", value);
-    var_assign_special(var);
-    free(var);
-    free(value);
-
-    int len = 0;
-    for (int i = 0; i < argc - 1; i++)
-    {
-        len += strlen(argv[i + 1]);
-    }
-    value = zalloc(sizeof(char) * (len * 2 + 3));
-    if (argc > 1)
-    {
-        for (int i = 0; i < argc - 1; i++)
-        {
-            if (i != 0)
-                strcat(value, " ");
-            strcat(value, argv[i + 1]);
-        }
-    }
-    var = build_var("@", value);
-    var_assign_special(var);
-    free(var);
-    free(value);
-
-    value = zalloc(sizeof(char) * (len * 2 + 3));
-    if (argc > 1)
-    {
-        value[0] = '\"';
-        strcat(value, argv[1]);
-        for (int i = 1; i < argc - 1; i++)
-        {
-            strcat(value, " ");
-            strcat(value, argv[i + 1]);
-        }
-        strcat(value, "\"");
-    }
-    var = build_var("*", value);
-    var_assign_special(var);
-    free(value);
-    free(var);
-
-    for (int i = 1; i < argc; i++)
-    {
-        char *value = my_itoa(i);
-        char *var = build_var(value, argv[i]);
-        var_assign_special(var);
-        free(var);
-        free(value);
-    }
+    global->params = params_new(argv + 1, argc > 1 ? argc - 1 : 0);
 }
 
 static struct opts *parse_opts(int argc, char **argv)
@@ -74,6 +27,8 @@ static struct opts *parse_opts(int argc, char **argv)
     static struct option long_options[] = {
         { "pretty-print", no_argument, NULL, 'p' },
         { "c", required_argument, NULL, 'c' },
+        { "alloc-stats", optional_argument, NULL, 'A' },
+        { "spawn-server", no_argument, NULL, 'S' },
         { NULL, 0, NULL, 0 }
     };
     int c;
@@ -88,6 +43,17 @@ static struct opts *parse_opts(int argc, char **argv)
             opts->c = 1;
             opts->input = optarg;
             break;
+        case 'A':
+#ifdef ALLOC_STATS
+            alloc_stats_enable(optarg);
+            opts->alloc_stats = 1;
+#else
+            warnx("--alloc-stats: not built with -Dalloc_stats=true");
+#endif
+            break;
+        case 'S':
+            opts->spawn_server = 1;
+            break;
         case '?':
             fprintf(stderr, "Usage: %s [OPTIONS] [SCRIPTS] [ARGUMENTS ...]\n",
                     argv[0]);
@@ -113,12 +79,14 @@ static struct cstream *parse_args(int *argc, char **argv[], struct opts **opts)
         return NULL;
     if ((*opts)->c)
     {
-        (*argc) -= 3;
-        (*argv) += 3;
+        (*argc) -= (*opts)->optind;
+        (*argv) += (*opts)->optind;
         return NULL;
     }
-    if (*argc == 1 || (*argc == 2 && (*opts)->p))
+    if ((*opts)->optind >= *argc)
     {
+        // No positional parameters, whatever options came before
+        (*argc) = 1;
         if (isatty(STDIN_FILENO))
             return cstream_readline_create();
         return cstream_file_create(stdin, /* fclose_on_free */ false);
@@ -131,8 +99,8 @@ static struct cstream *parse_args(int *argc, char **argv[], struct opts **opts)
         warn("failed to open input files");
         return NULL;
     }
-    (*argc)--;
-    (*argv)++;
+    (*argc) -= (*opts)->optind;
+    (*argv) += (*opts)->optind;
     return cstream_file_create(fp, /* fclose_on_free */ true);
 }
 
@@ -193,8 +161,7 @@ enum error read_print_loop(struct cstream *cs, struct vec *line,
     enum parser_state state = parsing(parser);
     if (state != PARSER_OK)
     {
-        vec_destroy(final);
-        free(final);
+        vec_free(final);
         return 2;
     }
     if (opts->p)
@@ -202,14 +169,18 @@ enum error read_print_loop(struct cstream *cs, struct vec *line,
     set_special_vars();
     int return_code = 0;
     global->functions = NULL;
+    // The shell exits after the last command of -c, unless it prints its
+    // allocations at exit
+    if (opts->c && !opts->alloc_stats)
+        global->exec_tail = ast_tail_cmd(parser->ast);
     int eval = ast_eval(parser->ast, &return_code);
 
     // Free functions
     while (global->functions)
     {
         struct function *save = global->functions->next;
-        free(global->functions->name);
-        free(global->functions);
+        slab_free(SLAB_FUNCTION, global->functions,
+                  sizeof(struct function));
         global->functions = save;
     }
 
@@ -221,8 +192,7 @@ enum error read_print_loop(struct cstream *cs, struct vec *line,
         free_var(cur);
         cur = tmp;
     }
-    vec_destroy(final);
-    free(final);
+    vec_free(final);
     return eval;
 }
 
@@ -242,6 +212,9 @@ int main(int argc, char *argv[])
         free(opts);
         return 1;
     }
+    // Start the server before the shell grows
+    if (opts->spawn_server && spawn_server_start() == -1)
+        warn("--spawn-server: failed to start");
     setinitvars(argc, argv);
 
     // Create a vector to hold the current line
@@ -254,7 +227,7 @@ int main(int argc, char *argv[])
     rc = read_print_loop(cs, line, parser, opts);
 
     free(opts);
-    free(line);
+    vec_free(line);
     if (cs)
     {
         cstream_free(cs);
@@ -262,5 +235,12 @@ int main(int argc, char *argv[])
     }
     while (global->nb_parsers > 0)
         parser_free(global->parsers_to_free[--global->nb_parsers]);
+    glob_cache_free();
+    params_free(global->params);
+    cmd_hash_clear();
+    spawn_server_stop();
+    arena_destroy(&global->scratch);
+    slab_destroy();
+    intern_destroy();
     return rc;
 }
@@ -0,0 +1,511 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utils/alloc.h>
+#include <utils/intern.h>
+#include <utils/slab.h>
+
+#include "ast.h"
+
+/**
+ * \brief Marks of the slots of an associative array without an entry
+ */
+#define SLOT_EMPTY SIZE_MAX
+#define SLOT_DELETED (SIZE_MAX - 1)
+
+struct array *array_new(enum array_kind kind)
+{
+    struct array *array = zalloc(sizeof(struct array));
+    array->kind = kind;
+    return array;
+}
+
+void array_free(struct array *array)
+{
+    if (array == NULL)
+        return;
+    for (size_t i = 0; i < array->size; i++)
+        free(array->values[i]);
+    free(array->values);
+    for (size_t i = 0; i < array->nb_entries; i++)
+    {
+        free(array->entries[i].key);
+        free(array->entries[i].value);
+    }
+    free(array->entries);
+    free(array->slots);
+    free(array);
+}
+
+char *array_get_index(struct array *array, size_t index)
+{
+    return index < array->size ? array->values[index] : NULL;
+}
+
+void array_set_index(struct array *array, size_t index, const char *value)
+{
+    if (index >= array->capacity)
+    {
+        size_t capacity = array->capacity ? array->capacity : 8;
+        while (capacity <= index)
+            capacity *= 2;
+        array->values = xrealloc(array->values, capacity * sizeof(char *));
+        memset(array->values + array->capacity, 0,
+               (capacity - array->capacity) * sizeof(char *));
+        array->capacity = capacity;
+    }
+    if (index >= array->size)
+        array->size = index + 1;
+    if (array->values[index] == NULL)
+        array->count++;
+    free(array->values[index]);
+    array->values[index] = strdup(value);
+}
+
+void array_unset_index(struct array *array, size_t index)
+{
+    if (index >= array->size || array->values[index] == NULL)
+        return;
+    free(array->values[index]);
+    array->values[index] = NULL;
+    array->count--;
+    while (array->size > 0 && array->values[array->size - 1] == NULL)
+        array->size--;
+}
+
+void array_push(struct array *array, const char *value, size_t len)
+{
+    if (array->size >= array->capacity)
+    {
+        array->capacity = array->capacity ? array->capacity * 2 : 8;
+        array->values =
+            xrealloc(array->values, array->capacity * sizeof(char *));
+    }
+    char *copy = xmalloc(len + 1);
+    memcpy(copy, value, len);
+    copy[len] = '\0';
+    array->values[array->size++] = copy;
+    array->count++;
+}
+
+static size_t key_hash(const char *key)
+{
+    // FNV-1a
+    size_t hash = 14695981039346656037ULL;
+    for (; *key != '\0'; key++)
+    {
+        hash ^= (unsigned char)*key;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * \brief Return the slot of key, or the slot it should be inserted in
+ */
+static size_t *slot_find(struct array *array, const char *key, size_t hash)
+{
+    size_t mask = array->nb_slots - 1;
+    size_t *free_slot = NULL;
+    for (size_t i = hash & mask;; i = (i + 1) & mask)
+    {
+        size_t *slot = array->slots + i;
+        if (*slot == SLOT_EMPTY)
+            return free_slot ? free_slot : slot;
+        if (*slot == SLOT_DELETED)
+        {
+            if (!free_slot)
+                free_slot = slot;
+            continue;
+        }
+        struct array_entry *entry = array->entries + *slot;
+        if (entry->hash == hash && strcmp(entry->key, key) == 0)
+            return slot;
+    }
+}
+
+// Drop the unset entries and rebuild the slots with room for more entries
+static void slots_rebuild(struct array *array)
+{
+    size_t size = 0;
+    for (size_t i = 0; i < array->nb_entries; i++)
+    {
+        if (array->entries[i].key != NULL)
+            array->entries[size++] = array->entries[i];
+    }
+    array->nb_entries = size;
+    size_t nb_slots = 16;
+    while (nb_slots < (array->count + 1) * 2)
+        nb_slots *= 2;
+    free(array->slots);
+    array->slots = xmalloc(nb_slots * sizeof(size_t));
+    array->nb_slots = nb_slots;
+    for (size_t i = 0; i < nb_slots; i++)
+        array->slots[i] = SLOT_EMPTY;
+    for (size_t i = 0; i < array->nb_entries; i++)
+        *slot_find(array, array->entries[i].key, array->entries[i].hash) = i;
+}
+
+char *array_get_key(struct array *array, const char *key)
+{
+    if (array->nb_slots == 0)
+        return NULL;
+    size_t *slot = slot_find(array, key, key_hash(key));
+    if (*slot == SLOT_EMPTY || *slot == SLOT_DELETED)
+        return NULL;
+    return array->entries[*slot].value;
+}
+
+void array_set_key(struct array *array, const char *key, const char *value)
+{
+    size_t hash = key_hash(key);
+    // Each entry appended since the last rebuild holds a slot
+    if ((array->nb_entries + 1) * 4 > array->nb_slots * 3)
+        slots_rebuild(array);
+    size_t *slot = slot_find(array, key, hash);
+    if (*slot != SLOT_EMPTY && *slot != SLOT_DELETED)
+    {
+        struct array_entry *entry = array->entries + *slot;
+        free(entry->value);
+        entry->value = strdup(value);
+        return;
+    }
+    if (array->nb_entries >= array->entries_capacity)
+    {
+        array->entries_capacity =
+            array->entries_capacity ? array->entries_capacity * 2 : 8;
+        array->entries = xrealloc(array->entries, array->entries_capacity
+                                      * sizeof(struct array_entry));
+    }
+    struct array_entry *entry = array->entries + array->nb_entries;
+    entry->key = strdup(key);
+    entry->value = strdup(value);
+    entry->hash = hash;
+    *slot = array->nb_entries++;
+    array->count++;
+}
+
+void array_unset_key(struct array *array, const char *key)
+{
+    if (array->nb_slots == 0)
+        return;
+    size_t *slot = slot_find(array, key, key_hash(key));
+    if (*slot == SLOT_EMPTY || *slot == SLOT_DELETED)
+        return;
+    struct array_entry *entry = array->entries + *slot;
+    free(entry->key);
+    free(entry->value);
+    entry->key = NULL;
+    entry->value = NULL;
+    *slot = SLOT_DELETED;
+    array->count--;
+}
+
+/**
+ * \brief Evaluate the subscript of an indexed array, counting negative ones
+ * from the end
+ * Return 0 on success, -1 on a bad subscript
+ */
+static int array_index(struct array *array, const char *subscript,
+                       size_t *index)
+{
+    int64_t value = 0;
+    const char *digit = subscript;
+    while (isdigit(*digit))
+        value = value * 10 + *digit++ - '0';
+    // Only evaluate subscripts which are not plain numbers
+    if (digit == subscript || *digit != '\0')
+    {
+        char *expr = strdup(subscript);
+        int status = arithmetic_eval(expr, NULL, &value);
+        free(expr);
+        if (status == -1)
+            return -1;
+    }
+    if (value < 0)
+        value += array->size;
+    if (value < 0)
+    {
+        fprintf(stderr, "42sh: %s: bad array subscript\n", subscript);
+        return -1;
+    }
+    *index = value;
+    return 0;
+}
+
+int array_set(struct array *array, const char *subscript, const char *value)
+{
+    if (array->kind == ARRAY_ASSOC)
+    {
+        array_set_key(array, subscript, value);
+        return 0;
+    }
+    size_t index = 0;
+    if (array_index(array, subscript, &index) == -1)
+        return -1;
+    array_set_index(array, index, value);
+    return 0;
+}
+
+int array_unset(struct array *array, const char *subscript)
+{
+    if (array->kind == ARRAY_ASSOC)
+    {
+        array_unset_key(array, subscript);
+        return 0;
+    }
+    size_t index = 0;
+    if (array_index(array, subscript, &index) == -1)
+        return -1;
+    array_unset_index(array, index);
+    return 0;
+}
+
+int array_get(struct array *array, const char *subscript, char **value)
+{
+    if (array->kind == ARRAY_ASSOC)
+    {
+        *value = array_get_key(array, subscript);
+        return 0;
+    }
+    size_t index = 0;
+    if (array_index(array, subscript, &index) == -1)
+        return -1;
+    *value = array_get_index(array, index);
+    return 0;
+}
+
+char *array_first(struct array *array)
+{
+    if (array->kind == ARRAY_ASSOC)
+        return array_get_key(array, "0");
+    return array_get_index(array, 0);
+}
+
+char *array_join(struct array *array, int keys, const char *sep,
+                 const char *escape)
+{
+    char **fields = zalloc((array->count + 1) * sizeof(char *));
+    size_t count = 0;
+    // The indexes of an indexed array are written in one buffer
+    char *numbers = keys && array->kind == ARRAY_INDEXED
+        ? xmalloc(array->count * 21 + 1)
+        : NULL;
+    char *number = numbers;
+    for (size_t i = 0; i < array->size; i++)
+    {
+        if (array->values[i] == NULL)
+            continue;
+        if (keys)
+        {
+            fields[count++] = number;
+            number += sprintf(number, "%zu", i) + 1;
+        }
+        else
+            fields[count++] = array->values[i];
+    }
+    for (size_t i = 0; i < array->nb_entries; i++)
+    {
+        if (array->entries[i].key != NULL)
+            fields[count++] =
+                keys ? array->entries[i].key : array->entries[i].value;
+    }
+    char *res = fields_join(fields, count, sep, escape);
+    free(numbers);
+    free(fields);
+    return res;
+}
+
+/**
+ * \brief Return the variable of the len first characters of name, turned
+ * into an array if it is a string, created if it is unset
+ */
+static struct list *array_var(const char *name, size_t len,
+                              enum array_kind kind)
+{
+    const char *var_name = intern(name, len);
+    struct list *var = find_var(var_name);
+    if (var == NULL)
+    {
+        var = slab_alloc(SLAB_VAR, sizeof(struct list));
+        var->name = var_name;
+        var->value = strdup("");
+        add_var(var);
+    }
+    if (var->array == NULL)
+    {
+        var->array = array_new(kind);
+        // The value of a string becomes the first element
+        if (var->value[0] != '\0')
+            array_set(var->array, "0", var->value);
+    }
+    return var;
+}
+
+struct array *var_new_array(const char *name)
+{
+    size_t len = strlen(name);
+    if (len == 0 || (!isalpha(name[0]) && name[0] != '_'))
+        return NULL;
+    for (size_t i = 1; i < len; i++)
+    {
+        if (!isalnum(name[i]) && name[i] != '_')
+            return NULL;
+    }
+    struct list *var = array_var(name, len, ARRAY_INDEXED);
+    array_free(var->array);
+    var->array = array_new(ARRAY_INDEXED);
+    return var->array;
+}
+
+// Split name[subscript] at its brackets, return 0 if it has no subscript
+static int split_element(const char *word, size_t *name_len,
+                         char **subscript)
+{
+    const char *open = strchr(word, '[');
+    size_t len = strlen(word);
+    if (!open || open == word || word[len - 1] != ']')
+        return 0;
+    *name_len = open - word;
+    *subscript = strndup(open + 1, word + len - 1 - open - 1);
+    return 1;
+}
+
+int var_set_element(const char *word, const char *value, int append)
+{
+    size_t name_len = 0;
+    char *subscript = NULL;
+    if (!split_element(word, &name_len, &subscript))
+        return -1;
+    struct list *var = array_var(word, name_len, ARRAY_INDEXED);
+    char *old = NULL;
+    int res = 0;
+    if (append && array_get(var->array, subscript, &old) == 0 && old)
+    {
+        size_t old_len = strlen(old);
+        size_t len = strlen(value);
+        char *joined = xmalloc(old_len + len + 1);
+        memcpy(joined, old, old_len);
+        memcpy(joined + old_len, value, len + 1);
+        res = array_set(var->array, subscript, joined);
+        free(joined);
+    }
+    else
+        res = array_set(var->array, subscript, value);
+    free(subscript);
+    return res;
+}
+
+int var_unset_element(const char *word)
+{
+    size_t name_len = 0;
+    char *subscript = NULL;
+    if (!split_element(word, &name_len, &subscript))
+        return -1;
+    char *name = strndup(word, name_len);
+    struct list *var = find_var(name);
+    int res = 0;
+    if (var && var->array)
+        res = array_unset(var->array, subscript);
+    else if (var && strcmp(subscript, "0") == 0)
+        unset_var(name);
+    free(name);
+    free(subscript);
+    return res;
+}
+
+// Return the index of the ')' closing the '(' at start, 0 if there is none
+static size_t compound_end(const char *str, size_t start)
+{
+    char quote = 0;
+    for (size_t i = start + 1; str[i] != '\0'; i++)
+    {
+        if (str[i] == '\\' && quote != '\'' && str[i + 1] != '\0')
+            i++;
+        else if ((str[i] == '\'' || str[i] == '"')
+                 && (!quote || quote == str[i]))
+            quote = quote ? 0 : str[i];
+        else if (str[i] == ')' && !quote)
+            return i;
+    }
+    return 0;
+}
+
+// Set the elements of array from the words of a compound assignment, the
+// words without subscripts of an indexed array starting at index next
+static int array_fill(struct array *array, char **words, size_t count,
+                      size_t next)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        char *word = words[i];
+        char *close = word[0] == '[' ? strstr(word, "]=") : NULL;
+        if (close)
+        {
+            *close = '\0';
+            if (array_set(array, word + 1, close + 2) == -1)
+                return -1;
+            // The next words follow the given index
+            size_t index = 0;
+            if (array->kind == ARRAY_INDEXED
+                && array_index(array, word + 1, &index) == 0)
+                next = index + 1;
+        }
+        else if (array->kind == ARRAY_ASSOC)
+        {
+            // Words without subscripts are alternating keys and values
+            array_set_key(array, word, i + 1 < count ? words[i + 1] : "");
+            i++;
+        }
+        else
+            array_set_index(array, next++, word);
+    }
+    return 0;
+}
+
+int array_assign(char *words)
+{
+    size_t i = 0;
+    while (words[i] == ' ' || words[i] == '\t')
+        i++;
+    size_t name = i;
+    if (!isalpha(words[i]) && words[i] != '_')
+        return 0;
+    while (isalnum(words[i]) || words[i] == '_')
+        i++;
+    size_t name_len = i - name;
+    int append = words[i] == '+';
+    i += append;
+    if (words[i] != '=' || words[i + 1] != '(')
+        return 0;
+    size_t end = compound_end(words, i + 1);
+    if (end == 0)
+        return 0;
+    for (size_t j = end + 1; words[j] != '\0'; j++)
+    {
+        if (words[j] != ' ' && words[j] != '\t')
+            return 0;
+    }
+    struct list *var = array_var(words + name, name_len, ARRAY_INDEXED);
+    words[end] = '\0';
+    size_t count = 0;
+    char **fields = word_split(words + i + 2, &count, NULL);
+    if (append)
+    {
+        // The elements are added in place, after the last one
+        array_fill(var->array, fields, count, var->array->size);
+        free(fields);
+        return 1;
+    }
+    struct array *array = array_new(var->array->kind);
+    if (array_fill(array, fields, count, 0) == 0)
+    {
+        array_free(var->array);
+        var->array = array;
+    }
+    else
+        array_free(array);
+    free(fields);
+    return 1;
+}
@@ -1,9 +1,12 @@
 #include "ast.h"
 
 #include <err.h>
+#include <parser/parser.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <utils/alloc.h>
+#include <utils/intern.h>
 #include <utils/utils.h>
 #include <utils/vec.h>
 
@@ -24,6 +27,38 @@ struct ast *create_ast(enum ast_type type)
     return new;
 }
 
+const char *cmd_literal_name(const char *cmd)
+{
+    size_t len = 0;
+    while (cmd[len] != '\0' && !is_separator(cmd[len]))
+    {
+        if (strchr("$`'\"\\*?[{~=", cmd[len]))
+            return NULL;
+        len++;
+    }
+    return len > 0 ? intern(cmd, len) : NULL;
+}
+
+struct ast *ast_tail_cmd(struct ast *ast)
+{
+    while (ast)
+    {
+        // Lists and && || chains run their right part last, when they run it
+        if (ast->type == AST_ROOT || ast->type == AST_AND
+            || ast->type == AST_OR)
+            ast = ast->right ? ast->right : ast->left;
+        // A single redirection need not be undone if nothing follows
+        else if (ast->type == AST_REDIR && ast->right == NULL)
+            ast = ast->left;
+        else
+            break;
+    }
+    // The left part of a command runs after it
+    if (ast && ast->type == AST_CMD && ast->left == NULL)
+        return ast;
+    return NULL;
+}
+
 void ast_free(struct ast *ast)
 {
     if (!ast)
@@ -31,8 +66,7 @@ void ast_free(struct ast *ast)
 
     if (ast->val)
     {
-        free(ast->val->data);
-        free(ast->val);
+        vec_free(ast->val);
     }
     for (size_t i = 0; i < ast->size; ++i)
         free(ast->list[i]);
@@ -41,6 +75,8 @@ void ast_free(struct ast *ast)
         free(ast->var);
     if (ast->replace)
         free(ast->replace);
+    if (ast->block)
+        parser_free(ast->block);
     ast_free(ast->cond);
     ast_free(ast->left);
     ast_free(ast->right);
@@ -48,6 +84,8 @@ void ast_free(struct ast *ast)
     if (ast->word)
         free(ast->word);
     cas_free(ast->cas);
+    case_table_free(ast->case_table);
+    arith_cache_free(ast->arith);
     free(ast);
 }
 
@@ -178,6 +216,15 @@ static void pretty_rec(struct ast *ast)
     }
     else if (ast->type == AST_FUNCTION)
         printf("Function declaration %s\n", ast->val->data);
+    else if (ast->type == AST_ARITH)
+        printf("(( %s )) ", ast->val->data);
+    else if (ast->type == AST_FOR_ARITH)
+    {
+        printf("for (( %s; %s; %s )) do ", ast->list[0], ast->list[1],
+               ast->list[2]);
+        pretty_rec(ast->left);
+        printf("done ");
+    }
     else
         printf("pretty-print : Unknown node type\n");
 }
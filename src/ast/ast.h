@@ -3,33 +3,160 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <utils/arena.h>
 
+enum array_kind
+{
+    ARRAY_INDEXED,
+    ARRAY_ASSOC
+};
+
+/**
+ * \brief An element of an associative array, key is NULL once unset
+ */
+struct array_entry
+{
+    char *key;
+    char *value;
+    size_t hash;
+};
+
+/**
+ * \brief The elements of an array variable
+ * @details Indexed arrays keep their values in a vector, NULL at the unset
+ * indexes. Associative arrays keep their entries in insertion order, found
+ * through an open addressing table of entry positions. count is the number
+ * of set elements.
+ */
+struct array
+{
+    enum array_kind kind;
+    size_t count;
+    char **values;
+    size_t size;
+    size_t capacity;
+    struct array_entry *entries;
+    size_t nb_entries;
+    size_t entries_capacity;
+    size_t *slots;
+    size_t nb_slots;
+};
+
+/**
+ * \brief A shell variable
+ * @details capacity is the size of the value buffer, 0 when it is unknown
+ * (strlen + 1), and length is the length of the value when capacity is
+ * known. number caches the integer value when is_number is set.
+ * array holds the elements of array variables, value is then unused.
+ * name is interned, so names are compared by pointer.
+ */
 struct list
 {
-    char *name;
+    const char *name;
     char *value;
+    struct array *array;
+    size_t capacity;
+    size_t length;
+    int64_t number;
+    int is_number;
     struct list *next;
 };
 
 struct function
 {
-    char *name;
+    const char *name;
     struct ast *body;
     struct function *next;
 };
 
+/**
+ * \brief The positional parameters
+ * @details $1 is args[start]: shift only moves start. joined, starred and
+ * quoted cache $@, "$*" and "$@", built the first time they are expanded.
+ * count is the text of $#.
+ */
+struct params
+{
+    char **args;
+    size_t start;
+    size_t size;
+    char *joined;
+    char *starred;
+    size_t starred_generation;
+    char *quoted;
+    char count[24];
+};
+
+/**
+ * \brief The state of the shell
+ * @details scratch holds the temporaries of the simple command being run,
+ * released once it completes. dispatch_generation changes whenever what a
+ * command name resolves to may change, invalidating the dispatch caches.
+ * exec_tail is the simple command after which the process exits, an
+ * external one is executed in place of the shell.
+ */
 struct global
 {
     struct mode *current_mode;
     struct list *vars;
     struct function *functions;
+    struct params *params;
     struct list *save_vars;
+    size_t vars_generation;
+    size_t ifs_generation;
+    size_t dispatch_generation;
+    struct arena scratch;
     struct parser *parsers_to_free[100];
     int nb_parsers;
+    struct ast *exec_tail;
 };
 
 extern struct global *global;
 
+/**
+ * \brief What the name of a simple command resolved to
+ */
+enum dispatch_kind
+{
+    DISPATCH_NONE = 0,
+    DISPATCH_BUILTIN,
+    DISPATCH_FIELD_BUILTIN,
+    DISPATCH_FUNCTION,
+    DISPATCH_EXTERNAL
+};
+
+/**
+ * \brief An entry of the command hash table, the path of an external
+ * command
+ * @param name: the interned name of the command
+ * @param path: its executable
+ * @param hits: the number of times it was run
+ */
+struct hashed_cmd
+{
+    const char *name;
+    char *path;
+    size_t hits;
+    struct hashed_cmd *next;
+    struct hashed_cmd *order;
+};
+
+/**
+ * \brief The target of a simple command, kept in its node
+ * @details It is valid while generation is the dispatch generation of the
+ * shell. index is the one of the builtin in its table, hashed the entry of
+ * an external command, NULL if its name has a slash or if it was not found.
+ */
+struct dispatch
+{
+    size_t generation;
+    enum dispatch_kind kind;
+    size_t index;
+    struct function *function;
+    struct hashed_cmd *hashed;
+};
+
 /**
  * \brief Possible nodes types for ast structure.
  */
@@ -54,7 +181,9 @@ enum ast_type
     AST_FUNCTION,
     AST_BREAK,
     AST_CONTINUE,
-    AST_CASE
+    AST_CASE,
+    AST_ARITH,
+    AST_FOR_ARITH
 };
 
 /**
@@ -75,6 +204,28 @@ struct mode
     int depth;
 };
 
+/**
+ * \brief Number of compiled expressions kept by a node
+ */
+#define ARITH_CACHE_SIZE 8
+
+struct arith_prog;
+
+/**
+ * \brief Compiled arithmetic expressions of a node, by expression text
+ * @details most recently used first
+ */
+struct arith_cache
+{
+    char *expr;
+    struct arith_prog *prog;
+    struct arith_cache *next;
+};
+
+/**
+ * \brief An arm of a case statement
+ * @details pattern is the text of its alternatives, for printing
+ */
 struct cas
 {
     char *pattern;
@@ -82,6 +233,65 @@ struct cas
     struct cas *next;
 };
 
+/**
+ * \brief A case alternative found in the literal table
+ */
+struct case_literal
+{
+    char *key;
+    size_t hash;
+    size_t index;
+    struct cas *arm;
+};
+
+/**
+ * \brief A case alternative matched as a pattern
+ * @details compiled is NULL when the pattern needs expansion each time
+ */
+struct case_pattern
+{
+    char *pattern;
+    struct pattern *compiled;
+    size_t index;
+    struct cas *arm;
+    struct case_pattern *next;
+};
+
+/**
+ * \brief Compiled alternatives of a case statement
+ * @details alternatives without expansions nor glob characters are in an
+ * open addressing hash table, the other ones are tried in order, up to the
+ * arm of the literal match if any. index is the position of the arm.
+ */
+struct case_table
+{
+    struct case_literal *literals;
+    size_t capacity;
+    size_t count;
+    struct case_pattern *patterns;
+    struct case_pattern *last;
+};
+
+/**
+ * \brief Lazy generator for a brace range word like pre{1..10..2}post.
+ * @details prefix and suffix point inside the parsed word, values are built
+ * one at a time in buf.
+ */
+struct range
+{
+    char *prefix;
+    size_t prefix_len;
+    char *suffix;
+    size_t suffix_len;
+    long long cur;
+    long long end;
+    long long step;
+    int width;
+    int is_char;
+    int done;
+    struct vec *buf;
+};
+
 /**
  * \brief Structure for ast.
  * @details: cond use for ifs conditions
@@ -101,10 +311,20 @@ struct ast
 
     char *word;
     struct cas *cas;
+    struct case_table *case_table;
 
     struct vec *val;
+    // The interned name of a command whose first word is not expanded, NULL
+    // otherwise, and what it resolved to
+    const char *name;
+    struct dispatch dispatch;
+    // The parsed commands of a command block, while it is not running
+    struct parser *block;
+    int block_busy;
     struct ast *cond;
 
+    struct arith_cache *arith;
+
     struct ast *left;
     struct ast *right;
 };
@@ -114,6 +334,12 @@ struct ast
  */
 typedef int (*commands)(char *args);
 
+/**
+ * \brief Array of pointers to builtins taking their arguments as fields
+ * @param argv: the NULL terminated fields, argv[0] is the builtin name
+ */
+typedef int (*field_commands)(char **argv, size_t argc);
+
 /**
  * \brief  Functions pointers arrays to redirection functions
  * @param left: the left part of the redirection
@@ -141,19 +367,73 @@ void pretty_print(struct ast *ast);
 /**
  * \brief Choose to execute builtin commands or
  * not builtins.
- * @param cmd: the command to execute
+ * @param cmd: the command to execute, without its quotes
+ * @param words: the same command with its quotes, split in place into the
+ * arguments of functions, field builtins and external commands
+ * @param ast: the node of the command, whose dispatch cache is used if its
+ * name is known, NULL to resolve the name each time
  * @return: return if the command fail or succeed
  */
-int cmd_exec(char *cmd);
+int cmd_exec(char *cmd, char *words, struct ast *ast);
 
-char *my_strstr(char *str, char *var);
+/**
+ * \brief Return the interned name of a command, NULL if its first word
+ * needs an expansion or is an assignment
+ */
+const char *cmd_literal_name(const char *cmd);
 
-char *replace_vars(char *str, char *var, char *replace);
+/**
+ * \brief Return the simple command which runs last in ast, if it runs at
+ * all, NULL if ast does not end with one
+ */
+struct ast *ast_tail_cmd(struct ast *ast);
 
+/**
+ * \brief Replace the parameters of str ($name, ${name} and the ${name<op>word}
+ * forms) and its arithmetic expansions by their values, from left to right
+ * @details Command substitutions are left for substitute_cmds: they expand
+ * their own parameters when they run
+ * @param var: the variable of the enclosing for loop, replaced by var_rep
+ * @return: the new string, NULL on a ${name:?word} or bad substitution
+ * error, which also stops the shell
+ */
 char *expand_vars(char *str, char *var, char *var_rep);
 
+/**
+ * \brief Which of the values expanded outside of quotes are split into
+ * fields at IFS
+ * @details EXPAND_SPLIT_CMDLINE splits all but those of assignment words
+ */
+enum expand_split
+{
+    EXPAND_KEEP,
+    EXPAND_SPLIT,
+    EXPAND_SPLIT_CMDLINE
+};
+
+/**
+ * \brief Expand the parameters and arithmetic expansions of str like
+ * expand_vars, splitting the values expanded outside of quotes into fields
+ * at IFS as split says
+ * @param cache: compiled expressions of the node, NULL to compile each time
+ */
+char *expand_fields(char *str, char *var, char *var_rep,
+                    enum expand_split split, struct arith_cache **cache);
+
+/**
+ * \brief Remove the quotes of a pattern, escaping the characters they made
+ * literal
+ */
+char *pattern_unquote(char *str);
+
 char *remove_quotes(char *str);
 
+/**
+ * \brief Like remove_quotes, but str is kept and the result is allocated in
+ * the scratch arena
+ */
+char *remove_quotes_scratch(char *str);
+
 void add_var(struct list *new);
 
 int is_var_assign(char *str);
@@ -168,6 +448,61 @@ char *my_itoa(int n);
 
 void unset_var(char *name);
 
+/**
+ * \brief Return the variable called name, NULL if it is unset
+ */
+struct list *find_var(const char *name);
+
+/**
+ * \brief Replace the value of a variable, reusing its buffer
+ */
+void var_replace(struct list *var, const char *value);
+
+/**
+ * \brief Append the len first characters of value to a variable
+ * @details The buffer grows geometrically, so that appending is amortized
+ * O(len)
+ */
+void var_append(struct list *var, const char *value, size_t len);
+
+/**
+ * \brief Rewrite the assignment name="$name..." of a command line as
+ * name+="...", which appends to the value instead of copying it
+ * @param var: the $name of the enclosing for loop variable, left as is
+ * @return: the command line, str itself if it is not such an assignment
+ */
+char *self_append_assign(char *str, const char *var);
+
+/**
+ * \brief Set the value of a variable, reusing its node and buffer
+ * Returns the variable
+ */
+struct list *var_set(const char *name, const char *value);
+
+/**
+ * \brief Get the integer value of a variable
+ * A value which is not a number is evaluated as an arithmetic expression
+ * Return 0 on success, -1 on error
+ */
+int var_number(struct list *var, int64_t *res);
+
+/**
+ * \brief Get the floating point value of a variable
+ * Return 0 on success, -1 if the value is not a number
+ */
+int var_real(struct list *var, double *res);
+
+/**
+ * \brief Store an integer in a variable without allocating once its buffer
+ * is big enough
+ */
+void var_set_number(struct list *var, int64_t nb);
+
+/**
+ * \brief Set the special variable $?
+ */
+void set_status(int status);
+
 /**
  * \brief Exectue args in a new process
  */
@@ -175,22 +510,128 @@ int subshell(char *args);
 
 /**
  * \brief Execute cmd substitution
+ * @param split: if the output is split into fields at IFS
+ * @param next: set to the index following the output in the result
+ */
+char *cmd_sub(char *str, size_t quote_pos, size_t quote_end, int is_dollar,
+              int split, size_t *next);
+
+/**
+ * \brief Return the index of the "))" closing the arithmetic expansion whose
+ * expression starts at str[start], 0 if there is none
+ */
+size_t arith_end(const char *str, size_t start);
+
+/**
+ * \brief Append to out the value of the arithmetic expansion of the len
+ * first characters of expr, once its parameters and command substitutions
+ * are expanded
+ * @param cache: compiled expressions of the node, NULL to compile each time
+ * @return: 0 on success, -1 on error, which also stops the shell
+ */
+int arith_append(struct vec *out, const char *expr, size_t len,
+                 struct arith_cache **cache);
+
+/**
+ * \brief Compile ahead the arithmetic expansions of str that no other
+ * expansion can modify
+ */
+void arithmetic_compile(char *str, struct arith_cache **cache);
+
+void arith_cache_free(struct arith_cache *cache);
+
+/**
+ * \brief Evaluate the arithmetic expression expr, expanding it first if it
+ * contains parameters or command substitutions
+ * Return 0 on success, -1 on error
  */
-char *cmd_sub(char *str, size_t quote_pos, size_t quote_end, int is_dollar);
+int arithmetic_eval(char *expr, struct arith_cache **cache, int64_t *res);
 
 /**
- * \brief Execute arithmetic expansion
- * if suceed replace the expression by its value
- * on failure return NULL
+ * \brief Execute the arithmetic command (( expr ))
+ * @return: 0 if the expression is not zero, 1 if it is zero or invalid
  */
-char *arithmetic_exp(char *cmd);
+int arithmetic_cmd(char *expr, struct arith_cache **cache);
 
 char *substitute_cmds(char *s);
 
 /**
- * \brief Exectue args in a whole block
+ * \brief Run the command substitutions of s like substitute_cmds, splitting
+ * the output of those outside of quotes into fields at IFS as split says
+ */
+char *substitute_fields(char *s, enum expand_split split);
+
+/**
+ * \brief Return the directories commands are searched in: the PATH variable
+ * of the shell, that of its environment if it has none
+ */
+const char *path_dirs(void);
+
+/**
+ * \brief Return the first executable called name in the directories of
+ * PATH, allocated, NULL if there is none
  */
-int cmdblock(char *args);
+char *path_search(const char *name);
+
+/**
+ * \brief Return the hash table entry of the interned command name key, NULL
+ * if it was not looked up yet
+ */
+struct hashed_cmd *cmd_hash_find(const char *key);
+
+/**
+ * \brief Return the hash table entry of key, searching PATH for it the first
+ * time, NULL if it is not found
+ * @details Misses are not remembered: PATH is searched again for the next
+ * one, which finds a command installed since
+ */
+struct hashed_cmd *cmd_hash_get(const char *key);
+
+/**
+ * \brief Set the path of key, which the table takes, resetting its hits
+ */
+struct hashed_cmd *cmd_hash_set(const char *key, char *path);
+
+/**
+ * \brief Forget every command, when PATH changes or on hash -r
+ */
+void cmd_hash_clear(void);
+
+/** \brief List the hits and paths of the commands found, like bash */
+int cmd_hash_print(void);
+
+/**
+ * \brief Return the path of name saved in the file shared by the shells
+ * which SH42_PATH_CACHE names, allocated, NULL if it is not there
+ * @details The entries of the file are dropped when PATH or one of its
+ * directories changed since they were found
+ */
+char *path_cache_lookup(const char *name);
+
+/** \brief Save the path name was found at in the shared file */
+void path_cache_store(const char *name, const char *path);
+
+/** \brief Unmap the shared file, it is opened again when next needed */
+void path_cache_close(void);
+
+/**
+ * \brief Return what name resolves to, functions first, without running it
+ * @param functions: consider functions, command skips them
+ */
+struct dispatch cmd_resolve(const char *name, int functions);
+
+/**
+ * \brief Run a command given as fields, skipping functions, for command
+ */
+int cmd_exec_fields(char **argv, size_t argc);
+
+/**
+ * \brief Execute a command block
+ * @details The block is parsed on its first run and kept in the node. A
+ * block run again from inside itself is parsed again, since the nodes keep
+ * the state of the loops running them.
+ */
+int cmdblock(struct ast *ast);
 
 /**
  * \brief Add a function in the global list
@@ -198,10 +639,135 @@ int cmdblock(char *args);
 int add_function(struct ast *ast);
 
 /**
- * \brief Execute a local function from global function list
- * Returns -1 if function not found
+ * \brief Return the function called name, NULL if there is none
+ */
+struct function *find_function(const char *name);
+
+/**
+ * \brief Return the function whose interned name is key, NULL if there is
+ * none
+ */
+struct function *find_function_interned(const char *key);
+
+/**
+ * \brief Execute a function, argv[1] and the next fields being its
+ * positional parameters
+ */
+int call_function(struct function *function, char **argv, size_t argc);
+
+/**
+ * \brief Characters escaped in the values expanded between double quotes
+ */
+#define QUOTED_ESCAPE "\"\\$`"
+
+/**
+ * \brief Separator of the fields of "$@" and "${name[@]}": each one is left
+ * in double quotes of its own
+ */
+#define QUOTED_SEP "\" \""
+
+/**
+ * \brief Join count fields with sep, escaping the characters of escape
+ * @param escape: NULL to copy the fields as they are
+ */
+char *fields_join(char *const *fields, size_t count, const char *sep,
+                  const char *escape);
+
+/**
+ * \brief Create positional parameters holding a copy of args
+ */
+struct params *params_new(char **args, size_t count);
+
+/**
+ * \brief Replace the positional parameters by a copy of args, as set -- does
+ */
+void params_set(struct params *params, char **args, size_t count);
+
+/**
+ * \brief Drop the n first positional parameters
+ * Return 0 on success, -1 if there are less than n parameters
+ */
+int params_shift(struct params *params, size_t n);
+
+void params_free(struct params *params);
+
+struct array *array_new(enum array_kind kind);
+
+void array_free(struct array *array);
+
+char *array_get_index(struct array *array, size_t index);
+
+void array_set_index(struct array *array, size_t index, const char *value);
+
+void array_unset_index(struct array *array, size_t index);
+
+/**
+ * \brief Append a copy of the len first characters of value to an indexed
+ * array, after its last element
+ */
+void array_push(struct array *array, const char *value, size_t len);
+
+char *array_get_key(struct array *array, const char *key);
+
+void array_set_key(struct array *array, const char *key, const char *value);
+
+void array_unset_key(struct array *array, const char *key);
+
+/**
+ * \brief Get, set or unset the element of the array at subscript, an
+ * arithmetic expression for indexed arrays and a key for associative ones
+ * Return 0 on success, -1 on a bad subscript
+ */
+int array_get(struct array *array, const char *subscript, char **value);
+
+int array_set(struct array *array, const char *subscript, const char *value);
+
+int array_unset(struct array *array, const char *subscript);
+
+/**
+ * \brief Return the element expanded by the name of the array alone
+ */
+char *array_first(struct array *array);
+
+/**
+ * \brief Join the values, or the keys, of the set elements as fields_join
+ */
+char *array_join(struct array *array, int keys, const char *sep,
+                 const char *escape);
+
+/**
+ * \brief Assign, or append to, the element of an array variable written
+ * name[subscript], creating an indexed array if name is unset
+ * Return 0 on success, -1 on a bad subscript
+ */
+int var_set_element(const char *word, const char *value, int append);
+
+/**
+ * \brief Replace the value of the variable name by an empty indexed array
+ * @return: the array, NULL if name is not a valid variable name
+ */
+struct array *var_new_array(const char *name);
+
+/**
+ * \brief Unset the element of an array variable written name[subscript]
+ */
+int var_unset_element(const char *word);
+
+/**
+ * \brief Perform the compound assignment name=(word...) of a command line
+ * with its quotes, [subscript]=value words setting a given element.
+ * name+=(word...) adds the elements after the existing ones.
+ * @return: 1 if words was such an assignment, 0 otherwise
  */
-int eval_func(char *cmd);
+int array_assign(char *words);
+
+/**
+ * \brief Return the value of the positional parameter, $#, $@ or $* called
+ * by the len first characters of name, NULL for other names or unset ones
+ * @param quoted: if the parameter is between double quotes, "$@" is then
+ * expanded to its parameters in separate double quotes
+ */
+char *params_value(const char *name, size_t len, int quoted);
 
 /**
  * \brief Push a variable at the beginning of the var list
@@ -213,7 +779,131 @@ void push_front(char *name, char *value);
  */
 void remove_function(char *name);
 
-// char *remove_vars(char *str, char *exclude);
+/**
+ * \brief Parse the first unquoted brace range {x..y[..step]} of a word
+ * Returns 1 and fill range on success, 0 if the word has no range
+ */
+int range_parse(char *word, struct range *range);
+
+/**
+ * \brief Return the next value of the range, NULL once exhausted
+ * The returned string is owned by the range and reused by the next call
+ */
+char *range_next(struct range *range);
+
+void range_free(struct range *range);
+
+/**
+ * \brief Return if the values of the range need no further expansion
+ */
+int range_is_static(struct range *range);
+
+/**
+ * \brief Replace every brace range word of str by its values
+ * @details If assigns is set, the assignment words str starts with are kept
+ */
+char *expand_braces(char *str, int assigns);
+
+/**
+ * \brief Skip the quoted text or substitution starting at str[i]
+ * @return: the index following it, i if none starts there
+ */
+size_t skip_nested(const char *str, size_t i);
+
+/**
+ * \brief Return the length of the word starting str, up to an unquoted blank
+ * @details Quoted text and substitutions are skipped as a whole
+ */
+size_t word_len(const char *str);
+
+/**
+ * \brief Delimiters used by field_split
+ * @details SPLIT_FIELDS splits at the IFS characters. SPLIT_WORDS splits
+ * command lines, at spaces and IFS blanks only: they mix literal text with
+ * expansion results, and a non blank IFS character may be literal there.
+ */
+enum split_mode
+{
+    SPLIT_FIELDS,
+    SPLIT_WORDS
+};
+
+/**
+ * \brief Split str in place following the POSIX field splitting rules
+ * @details The delimiters are looked up in a table rebuilt only when IFS
+ * changes
+ * @param count: set to the number of fields
+ * @return: the NULL terminated fields, pointing into str
+ */
+char **field_split(char *str, enum split_mode mode, size_t *count);
+
+/**
+ * \brief Split a command line in place into its words, at the unquoted
+ * blanks, and remove their quotes
+ * @details The parenthesized words of name=(...) are kept with their quotes,
+ * for array_assign
+ * @param count: set to the number of words
+ * @param arena: where to allocate the array of words, NULL to use malloc
+ * @return: the NULL terminated words, pointing into str
+ */
+char **word_split(char *str, size_t *count, struct arena *arena);
+
+struct vec;
+
+/**
+ * \brief Append len characters of str to out as one quoted word, which
+ * word_split and the quote removal give back unchanged
+ * @details Words without blanks, quotes or backslashes are appended as is
+ */
+void word_quote(struct vec *out, const char *str, size_t len);
+
+/**
+ * \brief Append the fields of len characters of value to out, split at IFS
+ * as the result of an unquoted expansion
+ * @details The fields are separated by single spaces and quoted by
+ * word_quote, empty ones are kept as ''
+ * @param after: the text following the expansion
+ * @param joined: if spaces also separate fields, as they join the elements
+ * of $@ and arrays
+ * @return: the number of fields
+ */
+size_t fields_append(struct vec *out, const char *value, size_t len,
+                     const char *after, int joined);
+
+/**
+ * \brief Return if an expansion at pos in the command line str is split
+ * @details The assignment words before the command name and those given to
+ * export or declare are not
+ */
+int word_is_split(const char *str, size_t pos);
+
+/**
+ * \brief Return if word starts with name=, name+= or name[subscript]=
+ */
+int is_assign_word(const char *word);
+
+/**
+ * \brief Replace every word of str with unquoted * ? or [...] by the sorted
+ * pathnames it matches, words matching nothing are kept unchanged
+ */
+char *expand_globs(char *str);
+
+/**
+ * \brief Release the directory listings kept by the pathname expansion
+ */
+void glob_cache_free(void);
+
+/**
+ * \brief Add an alternative of the index-th arm to the case table of ast
+ */
+void case_add_pattern(struct ast *ast, struct cas *arm, size_t index,
+                      char *word);
+
+void case_table_free(struct case_table *table);
+
+/**
+ * \brief Evaluate a case statement
+ */
 int handle_case(struct ast *ast);
 
 #endif /* ! AST_H */
@@ -2,16 +2,21 @@
 #include <ctype.h>
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <utils/alloc.h>
+#include <utils/intern.h>
+#include <utils/slab.h>
 #include <utils/utils.h>
 #include <utils/vec.h>
 
 #include "ast.h"
 #include "redirection.h"
+#include "spawn.h"
 
 /**
  * \brief The number of builtins commands
@@ -23,101 +28,221 @@
  */
 #define REDIR_NB 7
 
-struct global *global;
-
 /**
- * \brief Split a string into an array in which the
- * first element is the command.
- * @param cmd: the string to spilit
- * @param size: the size of the returned array
- * @return: the splited array
+ * \brief The number of builtins taking their arguments as fields
  */
+#define FIELD_BLT_NB 8
+
+extern char **environ;
 
-static char **split_in_array(char *cmd, int *size)
+/**
+ * \brief Execute a command in a sub-process
+ * @details The process is started with posix_spawn, which does not copy the
+ * memory of the shell as fork does, or by the spawn server if it runs. The
+ * redirections are already applied to the descriptors of the shell, which
+ * the command inherits.
+ * @param args: The NULL terminated arguments of the command
+ * @param path: the executable of the command if it is known, NULL to search
+ * PATH for it
+ * @param replace: nothing runs after the command, it replaces the shell
+ * @return: return if the command fail or succeed
+ */
+static int spawn_exec(char **args, const char *path, int replace)
 {
-    char **args = zalloc(sizeof(char *) * strlen(cmd));
-    int index = 0;
-    int i = 0;
-    while (cmd[i] != 0)
+    if (args[0] == NULL)
+        return 0;
+    int err = 0;
+    int wstatus = 0;
+    if (replace)
+        err = exec_command(path, args);
+    else if (spawn_server_run(path, args, &err, &wstatus) == -1)
     {
-        while (cmd[i] != 0 && cmd[i] == ' ')
-            i++;
-        index = i;
-        while (cmd[i] != 0 && cmd[i] != ' ')
-            i++;
-        if (i != index)
-            args[(*size)++] = strndup(cmd + index, i - index);
+        pid_t pid = 0;
+        err = spawn_command(&pid, path, args, NULL, NULL, environ);
+        if (err == EAGAIN || err == ENOMEM)
+            errx(1, "Failed to fork\n");
+        if (err == 0 && waitpid(pid, &wstatus, 0) == -1)
+            errx(1, "Failed waiting for child\n%s", strerror(errno));
     }
-    return args;
+    if (err != 0)
+    {
+        fprintf(stderr, "Command not found: '%s'\n", args[0]);
+        return 127;
+    }
+    return WEXITSTATUS(wstatus);
+}
+
+// getcmdname, in the scratch arena
+static char *scratch_cmdname(char *cmd, int *i)
+{
+    while (cmd[*i] != '\0' && !is_separator(cmd[*i]))
+        (*i)++;
+    return arena_strndup(&global->scratch, cmd, *i);
+}
+
+static const char *builtins[] = { "echo",   "exit", "cd",
+                                  "export", ".",    "unset" };
+static const commands cmds[BLT_NB] = { &echo,   &builtin_exit, &cd,
+                                       &export, &dot,          &unset };
+static const char *field_builtins[] = { "set",       "shift", "declare",
+                                        "mapfile",   "readarray", "hash",
+                                        "type",      "command" };
+static const field_commands field_cmds[FIELD_BLT_NB] = {
+    &builtin_set,     &builtin_shift, &builtin_declare, &builtin_mapfile,
+    &builtin_mapfile, &builtin_hash,  &builtin_type,    &builtin_command
+};
+
+// The interned names of the builtins, so that a command name is compared to
+// them by pointer
+static const char *builtin_keys[BLT_NB];
+static const char *field_builtin_keys[FIELD_BLT_NB];
+
+static void builtins_intern(void)
+{
+    for (size_t i = 0; i < BLT_NB; i++)
+        builtin_keys[i] = intern(builtins[i], strlen(builtins[i]));
+    for (size_t i = 0; i < FIELD_BLT_NB; i++)
+        field_builtin_keys[i] =
+            intern(field_builtins[i], strlen(field_builtins[i]));
 }
 
 /**
- * \brief Execute a command in a sub-process
- * @param cmd: The command to execute
- * @return: return if the command fail or succeed
+ * \brief Find what key names, in the order functions, builtins, field
+ * builtins and external commands
+ * @param key: the interned name of the command, NULL if it is not interned
+ * @param search: look external commands up in the hash table, searching
+ * PATH for those which are not in it yet
  */
-static int fork_exec(char *cmd)
+static void dispatch_resolve(struct dispatch *dispatch, const char *key,
+                             const char *name, int functions, int search)
 {
-    int size = 0;
-    char **args = split_in_array(cmd, &size);
-    int pid = fork();
-    if (pid == -1)
-        errx(1, "Failed to fork\n");
-
-    if (pid == 0)
+    dispatch->hashed = NULL;
+    dispatch->generation = global->dispatch_generation;
+    dispatch->function =
+        key && functions ? find_function_interned(key) : NULL;
+    dispatch->kind = DISPATCH_FUNCTION;
+    if (dispatch->function)
+        return;
+    for (size_t i = 0; key && i < BLT_NB; i++)
+    {
+        if (key == builtin_keys[i])
+        {
+            dispatch->kind = DISPATCH_BUILTIN;
+            dispatch->index = i;
+            return;
+        }
+    }
+    for (size_t i = 0; key && i < FIELD_BLT_NB; i++)
     {
-        if (execvp(args[0], args) == -1)
+        if (key == field_builtin_keys[i])
         {
-            fprintf(stderr, "Command not found: '%s'\n", args[0]);
-            for (int i = 0; i < size; i++)
-                free(args[i]);
-            free(args);
-            exit(127);
+            dispatch->kind = DISPATCH_FIELD_BUILTIN;
+            dispatch->index = i;
+            return;
         }
     }
+    dispatch->kind = DISPATCH_EXTERNAL;
+    if (name[0] == '\0' || strchr(name, '/'))
+        return;
+    if (!key)
+        key = intern(name, strlen(name));
+    dispatch->hashed = search ? cmd_hash_get(key) : cmd_hash_find(key);
+}
 
-    for (int i = 0; i < size; i++)
-        free(args[i]);
-    free(args);
-    int wstatus;
-    int cpid = waitpid(pid, &wstatus, 0);
+struct dispatch cmd_resolve(const char *name, int functions)
+{
+    struct dispatch dispatch = { 0, DISPATCH_NONE, 0, NULL, NULL };
+    const char *key = intern_find(name, strlen(name));
+    dispatch_resolve(&dispatch, key, name, functions, 0);
+    return dispatch;
+}
 
-    if (cpid == -1)
-        errx(1, "Failed waiting for child\n%s", strerror(errno));
-    return WEXITSTATUS(wstatus);
+// Run an external command, the one of the hash table for a name without a
+// slash: the environment may not have the PATH of the shell
+static int dispatch_external(struct dispatch *dispatch, char **argv,
+                             int replace)
+{
+    struct hashed_cmd *hashed = dispatch->hashed;
+    if (argv[0] == NULL)
+        return 0;
+    if (hashed != NULL)
+    {
+        hashed->hits++;
+        return spawn_exec(argv, hashed->path, replace);
+    }
+    if (strchr(argv[0], '/') != NULL)
+        return spawn_exec(argv, argv[0], replace);
+    fprintf(stderr, "Command not found: '%s'\n", argv[0]);
+    return 127;
 }
 
-int cmd_exec(char *cmd)
+static int run_builtin(size_t index, char *args)
 {
-    char *builtins[] = { "echo", "exit", "cd", "export", ".", "unset" };
-    commands cmds[BLT_NB] = {
-        &echo, &builtin_exit, &cd, &export, &dot, &unset
-    };
-    int is_local_func = eval_func(cmd);
-    if (is_local_func != -1)
-        return is_local_func;
+    int return_code = cmds[index](args);
+    if (cmds[index] == &builtin_exit)
+        global->current_mode->mode = EXIT;
+    return return_code;
+}
+
+int cmd_exec_fields(char **argv, size_t argc)
+{
+    if (argc == 0)
+        return 0;
+    struct dispatch dispatch = { 0, DISPATCH_NONE, 0, NULL, NULL };
+    const char *key = intern_find(argv[0], strlen(argv[0]));
+    dispatch_resolve(&dispatch, key, argv[0], 0, 1);
+    if (dispatch.kind == DISPATCH_FIELD_BUILTIN)
+        return field_cmds[dispatch.index](argv, argc);
+    if (dispatch.kind != DISPATCH_BUILTIN)
+        return dispatch_external(&dispatch, argv, 0);
+    // The builtins taking a string get the arguments joined back
+    char *args = fields_join(argv + 1, argc - 1, " ", NULL);
+    int return_code = run_builtin(dispatch.index, args);
+    free(args);
+    return return_code;
+}
 
+int cmd_exec(char *cmd, char *words, struct ast *ast)
+{
+    if (builtin_keys[0] == NULL)
+        builtins_intern();
     int arg_index = 0;
-    char *cmd_name = getcmdname(cmd, &arg_index);
+    char *cmd_name = scratch_cmdname(cmd, &arg_index);
+    // A command whose name is known keeps what it resolved to until a
+    // function, PATH or the hash table changes. An external command which
+    // was not found is searched again.
+    struct dispatch local = { 0, DISPATCH_NONE, 0, NULL, NULL };
+    struct dispatch *dispatch = &local;
+    if (ast && ast->name)
+        dispatch = &ast->dispatch;
+    if (dispatch->kind == DISPATCH_NONE
+        || dispatch->generation != global->dispatch_generation
+        || (dispatch->kind == DISPATCH_EXTERNAL && dispatch->hashed == NULL))
+    {
+        // A name which was never interned is neither a builtin nor a
+        // function
+        const char *key = dispatch == &local
+            ? intern_find(cmd_name, arg_index)
+            : ast->name;
+        dispatch_resolve(dispatch, key, cmd_name, 1, 1);
+    }
     if (cmd_name[arg_index] == 0)
         arg_index--; // handle \0 for empty args
-    int i = 0;
-    while (i < BLT_NB)
+    if (dispatch->kind == DISPATCH_BUILTIN)
     {
-        if (strcmp(cmd_name, builtins[i]) == 0)
-        {
-            free(cmd_name);
-            if (cmd[arg_index + 1] == ' ')
-                arg_index++;
-            int return_code = cmds[i](cmd + arg_index + 1);
-            if (i == 1)
-                global->current_mode->mode = EXIT;
-            return return_code;
-        }
-        i++;
+        if (cmd[arg_index + 1] == ' ')
+            arg_index++;
+        return run_builtin(dispatch->index, cmd + arg_index + 1);
     }
-    free(cmd_name);
-    return fork_exec(cmd);
+
+    size_t argc = 0;
+    char **argv = word_split(words, &argc, &global->scratch);
+    if (dispatch->kind == DISPATCH_FUNCTION)
+        return call_function(dispatch->function, argv, argc);
+    if (dispatch->kind == DISPATCH_FIELD_BUILTIN)
+        return field_cmds[dispatch->index](argv, argc);
+    return dispatch_external(dispatch, argv,
+                             ast != NULL && ast == global->exec_tail);
 }
 
 static int eval_pipe(struct ast *ast)
@@ -126,8 +251,11 @@ static int eval_pipe(struct ast *ast)
 
     if (pipe(fds) == -1)
         errx(1, "Failed to create pipe file descriptors.");
+    // Only the copies made on the standard descriptors are inherited
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
 
-    int out = dup(STDOUT_FILENO);
+    int out = fd_save(STDOUT_FILENO);
 
     if (dup2(fds[1], STDOUT_FILENO) == -1)
         errx(1, "dup2 failed");
@@ -140,7 +268,7 @@ static int eval_pipe(struct ast *ast)
     dup2(out, STDOUT_FILENO);
     close(out);
 
-    int in = dup(STDIN_FILENO);
+    int in = fd_save(STDIN_FILENO);
 
     if (dup2(fds[0], STDIN_FILENO) == -1)
         errx(1, "dup2 failed");
@@ -172,14 +300,16 @@ int exec_redir(struct ast *ast)
         i++;
     if (fd == -1 && i > 2)
         return 2; // Not valid
+    struct arena_mark mark = arena_mark(&global->scratch);
     char *redir_mode = NULL;
     if (fd != -1)
-        redir_mode = strndup(ast->val->data + 1, i - 1);
+        redir_mode = arena_strndup(&global->scratch, ast->val->data + 1, i - 1);
     else
-        redir_mode = strndup(ast->val->data, i);
+        redir_mode = arena_strndup(&global->scratch, ast->val->data, i);
     while (isspace(ast->val->data[i])) // Skip spaces before WORD
         i++;
-    char *right = strdup(ast->val->data + i); // Skip redir operator
+    char *right = ast->val->data + i; // Skip redir operator
+    right = arena_strndup(&global->scratch, right, strlen(right));
     int return_code = -1;
     for (size_t index = 0; index < REDIR_NB; index++)
     {
@@ -189,8 +319,7 @@ int exec_redir(struct ast *ast)
             break;
         }
     }
-    free(redir_mode);
-    free(right);
+    arena_release(&global->scratch, mark);
     if (ast->right)
         return exec_redir(ast->right);
     return return_code;
@@ -221,18 +350,370 @@ static void set_replace(char *value, struct ast *ast)
 {
     if (ast == NULL)
         return;
-    if (ast->replace)
+    // The values of a loop mostly fit in the buffer of the previous one
+    size_t len = strlen(value);
+    if (ast->replace == NULL || strlen(ast->replace) < len)
+    {
         free(ast->replace);
-    ast->replace = strdup(value);
+        ast->replace = xmalloc(len + 1);
+    }
+    memcpy(ast->replace, value, len + 1);
     set_replace(value, ast->left);
     set_replace(value, ast->right);
 }
 
 void free_var(struct list *var)
 {
-    free(var->name);
     free(var->value);
-    free(var);
+    array_free(var->array);
+    slab_free(SLAB_VAR, var, sizeof(struct list));
+}
+
+/**
+ * \brief A value of a for loop word list
+ * @details static brace ranges are kept as a lazy range instead of a value.
+ * The fields of an expanded word point into one buffer, owned by the first
+ * of them.
+ */
+struct for_item
+{
+    char *value;
+    char *buffer;
+    struct range range;
+};
+
+static void free_for_items(struct for_item *items, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        free(items[i].buffer);
+        if (!items[i].value)
+            range_free(&items[i].range);
+    }
+    free(items);
+}
+
+static void push_for_item(struct for_item **items, size_t *size,
+                          size_t *capacity, char *value, char *buffer)
+{
+    if (*size >= *capacity)
+    {
+        *capacity *= 2;
+        *items = xrealloc(*items, *capacity * sizeof(struct for_item));
+    }
+    (*items)[*size].value = value;
+    (*items)[*size].buffer = buffer;
+    (*size)++;
+}
+
+/**
+ * \brief Expand the pathnames of an expanded word of a for loop list and
+ * push the words it is split into
+ * @param s: the expanded word, owned by the pushed items
+ */
+static void push_for_words(struct for_item **items, size_t *size,
+                           size_t *capacity, char *s)
+{
+    s = expand_globs(s);
+    size_t count = 0;
+    char **words = word_split(s, &count, NULL);
+    for (size_t i = 0; i < count; i++)
+        push_for_item(items, size, capacity, words[i], i ? NULL : s);
+    if (count == 0)
+        free(s);
+    free(words);
+}
+
+/**
+ * \brief Expand the word list of a for loop
+ * @return: the items to iterate on, NULL on expansion error
+ */
+static struct for_item *get_for_items(struct ast *ast, size_t *size)
+{
+    size_t capacity = 16;
+    struct for_item *items = zalloc(sizeof(struct for_item) * capacity);
+    for (size_t i = 0; i < ast->size; i++)
+    {
+        struct range range;
+        if (range_parse(ast->list[i], &range) && range_is_static(&range))
+        {
+            push_for_item(&items, size, &capacity, NULL, NULL);
+            items[*size - 1].range = range;
+            continue;
+        }
+        char *s = strdup(ast->list[i]);
+        s = expand_braces(s, 0);
+        s = expand_fields(s, NULL, NULL, EXPAND_SPLIT, &ast->arith);
+        s = substitute_fields(s, EXPAND_SPLIT);
+        if (s == NULL)
+        {
+            free_for_items(items, *size);
+            return NULL;
+        }
+        push_for_words(&items, size, &capacity, s);
+    }
+    return items;
+}
+
+/**
+ * \brief Handle a break or continue of the previous iteration of a loop
+ * @return: 1 if the loop must stop, 0 otherwise
+ */
+static int loop_stop(void)
+{
+    if (global->current_mode->mode == BREAK
+        || global->current_mode->mode == EXIT)
+        return 1;
+    if (global->current_mode->mode == CONTINUE)
+    {
+        if (global->current_mode->nb != 1)
+            return 1;
+        global->current_mode->nb--;
+        global->current_mode->mode = NORMAL;
+    }
+    return 0;
+}
+
+/**
+ * \brief Leave a loop, consuming one level of a pending break or continue
+ */
+static void loop_end(void)
+{
+    struct mode *mode = global->current_mode;
+    if (mode->mode == BREAK || mode->mode == CONTINUE)
+        mode->nb--;
+    if (mode->nb <= 0 && mode->mode != EXIT)
+        mode->mode = NORMAL;
+    mode->depth--;
+}
+
+/**
+ * \brief Run one iteration of a for loop body
+ * @return: 0 if the loop must stop, 1 otherwise
+ */
+static int for_iteration(struct ast *ast, char *value, int *return_code,
+                         int *ret_code)
+{
+    if (loop_stop())
+        return 0;
+    var_set(ast->val->data + 1, value);
+    set_replace(value, ast->left);
+    *ret_code = ast_eval(ast->left, return_code);
+    return 1;
+}
+
+static int eval_for(struct ast *ast, int *return_code)
+{
+    global->current_mode->depth++;
+    set_loop(ast->left);
+    set_var(ast->val->data, ast->left);
+    int ret_code = 0;
+    size_t size = 0;
+    struct for_item *items = get_for_items(ast, &size);
+    if (items == NULL)
+    {
+        loop_end();
+        return 2;
+    }
+    int running = 1;
+    for (size_t i = 0; running && i < size; i++)
+    {
+        if (items[i].value)
+        {
+            running = for_iteration(ast, items[i].value, return_code, &ret_code);
+            continue;
+        }
+        // Brace ranges are generated one value at a time
+        char *value = NULL;
+        while (running && (value = range_next(&items[i].range)) != NULL)
+            running = for_iteration(ast, value, return_code, &ret_code);
+    }
+    free_for_items(items, size);
+    loop_end();
+    return ret_code;
+}
+
+// Evaluate a clause of an arithmetic for loop, an empty clause is true
+static int for_clause(struct ast *ast, size_t i, int64_t *res)
+{
+    char *expr = ast->list[i];
+    while (isspace(*expr))
+        expr++;
+    *res = 1;
+    if (*expr == '\0')
+        return 0;
+    return arithmetic_eval(expr, &ast->arith, res);
+}
+
+static int eval_for_arith(struct ast *ast, int *return_code)
+{
+    global->current_mode->depth++;
+    set_loop(ast->left);
+    int ret_code = 0;
+    int64_t value = 0;
+    int status = for_clause(ast, 0, &value);
+    while (status == 0 && (status = for_clause(ast, 1, &value)) == 0 && value)
+    {
+        ret_code = ast_eval(ast->left, return_code);
+        if (loop_stop())
+            break;
+        status = for_clause(ast, 2, &value);
+    }
+    loop_end();
+    return status == -1 ? 1 : ret_code;
+}
+
+// Return the length of the assignment words str starts with and of the
+// blanks following them, 0 if one of them assigns an array
+static size_t assigns_len(const char *str)
+{
+    size_t i = 0;
+    while (is_assign_word(str + i))
+    {
+        if (strchr(str + i, '=')[1] == '(')
+            return 0;
+        i += word_len(str + i);
+        while (str[i] == ' ')
+            i++;
+    }
+    return i;
+}
+
+/**
+ * \brief A variable assigned for the duration of a command, with its values
+ * before the assignment
+ */
+struct saved_var
+{
+    char *word;
+    char *name;
+    char *value;
+    char *env;
+    int restore;
+};
+
+/**
+ * \brief Run the expanded command words after the assignment words of the
+ * first len characters of the command ast
+ * @details The assignments are expanded after the command words. The
+ * variables are assigned and exported while the command runs, then get their
+ * previous values back.
+ * @param res: set to the status of the command
+ * @return: 0, -1 on expansion error
+ */
+static int cmd_exec_assigns(struct ast *ast, size_t len, char *words,
+                            int *res)
+{
+    struct arena *scratch = &global->scratch;
+    char *data = ast->val->data;
+    struct saved_var *saved = arena_alloc(scratch, len * sizeof(*saved));
+    size_t count = 0;
+    for (size_t i = 0; i < len; count++)
+    {
+        size_t end = i + word_len(data + i);
+        char *word = expand_fields(strndup(data + i, end - i), ast->var,
+                                   ast->replace, EXPAND_KEEP, &ast->arith);
+        word = substitute_cmds(word);
+        if (word == NULL)
+            return -1;
+        saved[count].word = remove_quotes_scratch(word);
+        free(word);
+        for (i = end; data[i] == ' '; i++)
+            continue;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        struct saved_var *var = saved + i;
+        var->name = arena_strndup(scratch, var->word,
+                                  strcspn(var->word, "+[="));
+        struct list *old = find_var(var->name);
+        // Arrays and their elements keep what is assigned to them
+        var->restore = var->word[strlen(var->name)] != '['
+            && !(old && old->array);
+        var->value = old ? arena_strndup(scratch, old->value,
+                                         strlen(old->value))
+                         : NULL;
+        char *env = getenv(var->name);
+        var->env = env ? arena_strndup(scratch, env, strlen(env)) : NULL;
+        is_var_assign(var->word);
+        struct list *new = find_var(var->name);
+        if (var->restore && new)
+            setenv(var->name, new->value, 1);
+    }
+    char *line = remove_quotes_scratch(words);
+    *res = cmd_exec(line, words, ast);
+    while (count-- > 0)
+    {
+        struct saved_var *var = saved + count;
+        if (!var->restore)
+            continue;
+        if (var->value)
+            var_set(var->name, var->value);
+        else
+            unset_var(var->name);
+        if (var->env)
+            setenv(var->name, var->env, 1);
+        else
+            unsetenv(var->name);
+    }
+    return 0;
+}
+
+/**
+ * \brief Expand and run a simple command
+ * @details The temporaries of the command are allocated in the scratch
+ * arena, released once it has run
+ */
+static int eval_cmd(struct ast *ast, int *return_code)
+{
+    struct arena_mark mark = arena_mark(&global->scratch);
+    int res = 0;
+    // The assignment words before a command are expanded apart
+    size_t assigns = assigns_len(ast->val->data);
+    if (ast->val->data[assigns] == '\0')
+        assigns = 0;
+    char *cmd2 = strdup(ast->val->data + assigns);
+
+    cmd2 = self_append_assign(cmd2, ast->var);
+    cmd2 = expand_braces(cmd2, 1);
+    cmd2 = expand_fields(cmd2, ast->var, ast->replace, EXPAND_SPLIT_CMDLINE,
+                         &ast->arith);
+    cmd2 = substitute_fields(cmd2, EXPAND_SPLIT_CMDLINE);
+    if (cmd2 == NULL)
+        goto expansion_error;
+    cmd2 = expand_globs(cmd2);
+    int error = 0;
+    if (assigns > 0)
+        error = cmd_exec_assigns(ast, assigns, cmd2, &res);
+    else if (!array_assign(cmd2))
+    {
+        char *line = remove_quotes_scratch(cmd2);
+        if (!is_var_assign(line))
+            res = cmd_exec(line, cmd2, ast);
+    }
+    free(cmd2);
+    if (error)
+        goto expansion_error;
+    *return_code = res;
+    int i = 0;
+    char *command_name = scratch_cmdname(ast->val->data + assigns, &i);
+    if (strcmp(command_name, ".") == 0 && res != 0)
+        global->current_mode->mode = EXIT;
+    arena_release(&global->scratch, mark);
+    if (!ast->left)
+    {
+        set_status(res);
+        return res;
+    }
+    res = ast_eval(ast->left, return_code);
+    set_status(res);
+    return res;
+
+expansion_error:
+    arena_release(&global->scratch, mark);
+    *return_code = 2;
+    set_status(2);
+    return 2;
 }
 
 int ast_eval(struct ast *ast, int *return_code)
@@ -298,48 +779,11 @@ int ast_eval(struct ast *ast, int *return_code)
     case AST_CMD:
         if (ast->val == NULL)
             return 2;
-        int res = 0;
-        char *cmd2 = strdup(ast->val->data);
-
-        cmd2 = expand_vars(cmd2, ast->var, ast->replace);
-        cmd2 = substitute_cmds(cmd2);
-        if (cmd2 == NULL)
-            return 2;
-        cmd2 = arithmetic_exp(cmd2);
-        if (cmd2 == NULL)
-            return 2;
-        cmd2 = remove_quotes(cmd2);
-        if (!is_var_assign(cmd2))
-            res = cmd_exec(cmd2);
-        free(cmd2);
-        *return_code = res;
-        int i = 0;
-        char *command_name = getcmdname(ast->val->data, &i);
-        if (strcmp(command_name, ".") == 0 && res != 0)
-            global->current_mode->mode = EXIT;
-        free(command_name);
-        if (!ast->left)
-        {
-            char *value = my_itoa(res);
-            char *var = build_var("?", value);
-            var_assign_special(var);
-            free(var);
-            free(value);
-            return res;
-        }
-        res = ast_eval(ast->left, return_code);
-        char *value = my_itoa(res);
-        char *var = build_var("?", value);
-        var_assign_special(var);
-        free(var);
-        free(value);
-        return res;
+        return eval_cmd(ast, return_code);
     case AST_REDIR:
-        tmp = expand_vars(ast->val->data, NULL, NULL);
+        tmp = expand_fields(ast->val->data, NULL, NULL, EXPAND_KEEP,
+                            &ast->arith);
         tmp = substitute_cmds(tmp);
-        if (tmp == NULL)
-            return 2;
-        tmp = arithmetic_exp(tmp);
         if (tmp == NULL)
             return 2;
         tmp = remove_quotes(tmp);
@@ -367,6 +811,7 @@ int ast_eval(struct ast *ast, int *return_code)
         set_loop(ast->cond);
         a = 0;
         while (global->current_mode->mode != BREAK
+               && global->current_mode->mode != EXIT
                && ast_eval(ast->cond, return_code) == 0)
         {
             if (global->current_mode->mode == CONTINUE)
@@ -381,12 +826,7 @@ int ast_eval(struct ast *ast, int *return_code)
             }
             a = ast_eval(ast->left, return_code);
         }
-        if (global->current_mode->mode == BREAK
-            || global->current_mode->mode == CONTINUE)
-            global->current_mode->nb--;
-        if (global->current_mode->nb <= 0)
-            global->current_mode->mode = NORMAL;
-        global->current_mode->depth--;
+        loop_end();
         return a;
     case AST_UNTIL:
         global->current_mode->depth++;
@@ -394,6 +834,7 @@ int ast_eval(struct ast *ast, int *return_code)
         set_loop(ast->cond);
         a = 0;
         while (global->current_mode->mode != BREAK
+               && global->current_mode->mode != EXIT
                && ast_eval(ast->cond, return_code) != 0)
         {
             if (global->current_mode->mode == CONTINUE)
@@ -408,82 +849,10 @@ int ast_eval(struct ast *ast, int *return_code)
             }
             a = ast_eval(ast->left, return_code);
         }
-        if (global->current_mode->mode == BREAK
-            || global->current_mode->mode == CONTINUE)
-            global->current_mode->nb--;
-        if (global->current_mode->nb <= 0)
-            global->current_mode->mode = NORMAL;
-        global->current_mode->depth--;
+        loop_end();
         return a;
     case AST_FOR:
-        global->current_mode->depth++;
-        set_loop(ast->left);
-        set_var(ast->val->data, ast->left);
-        int ret_code = 0;
-        char **total = zalloc(100000);
-        size_t size = 0;
-        for (size_t i = 0; i < ast->size; i++)
-        {
-            char *s = strdup(ast->list[i]);
-            s = expand_vars(s, NULL, NULL);
-            s = substitute_cmds(s);
-            if (s == NULL)
-                return 2;
-            s = arithmetic_exp(s);
-            if (s == NULL)
-                return 2;
-            if (strlen(s) == 0)
-            {
-                free(s);
-                break;
-            }
-            if (s[0] != '\"')
-            {
-                char **args = zalloc(sizeof(char *) * strlen(s));
-                char *save = NULL;
-                char *val = strtok_r(s, " \n", &save);
-                int index = 0;
-                args[index++] = val;
-                while ((val = strtok_r(NULL, " \n", &save)) != NULL)
-                    args[index++] = val;
-                for (int i = 0; i < index; i++)
-                    total[size++] = strdup(args[i]);
-                free(args);
-            }
-            else
-                total[size++] = strdup(s);
-            free(s);
-        }
-        for (size_t i = 0; global->current_mode->mode != BREAK && i < size; ++i)
-        {
-            if (global->current_mode->mode == CONTINUE)
-            {
-                if (global->current_mode->nb == 1)
-                {
-                    global->current_mode->nb--;
-                    global->current_mode->mode = NORMAL;
-                }
-                else
-                    break;
-            }
-            set_replace(total[i], ast->left);
-            ret_code = ast_eval(ast->left, return_code);
-            free(total[i]);
-            total[i] = NULL;
-        }
-        if (global->current_mode->mode == BREAK
-            || global->current_mode->mode == CONTINUE)
-            global->current_mode->nb--;
-        if (global->current_mode->nb <= 0)
-            global->current_mode->mode = NORMAL;
-        for (size_t i = 0; i < size; i++)
-        {
-            if (total[i] != NULL)
-                free(total[i]);
-        }
-        free(total);
-        global->current_mode->depth--;
-        return ret_code;
+        return eval_for(ast, return_code);
     case AST_BREAK:
         global->current_mode->mode = BREAK;
         if (ast->val->data[5] != 0)
@@ -525,36 +894,19 @@ int ast_eval(struct ast *ast, int *return_code)
         if (ast->is_loop)
             return 0;
         return ast_eval(ast->left, return_code);
+    case AST_FOR_ARITH:
+        return eval_for_arith(ast, return_code);
+    case AST_ARITH:
+        *return_code = arithmetic_cmd(ast->val->data, &ast->arith);
+        set_status(*return_code);
+        return *return_code;
     case AST_SUBSHELL:
         return subshell(vec_cstring(ast->val));
     case AST_CMDBLOCK:
-        return cmdblock(vec_cstring(ast->val));
+        return cmdblock(ast);
     case AST_FUNCTION:
         return add_function(ast);
     case AST_CASE:
-        tmp = expand_vars(ast->word, NULL, NULL);
-        tmp = substitute_cmds(tmp);
-        if (tmp == NULL)
-            return 2;
-        tmp = arithmetic_exp(tmp);
-        if (tmp == NULL)
-            return 2;
-        tmp = remove_quotes(tmp);
-        ast->word = tmp;
-        struct cas *cas = ast->cas;
-        while (cas)
-        {
-            tmp = expand_vars(cas->pattern, NULL, NULL);
-            tmp = substitute_cmds(tmp);
-            if (tmp == NULL)
-                return 2;
-            tmp = arithmetic_exp(tmp);
-            if (tmp == NULL)
-                return 2;
-            tmp = remove_quotes(tmp);
-            cas->pattern = tmp;
-            cas = cas->next;
-        }
         return handle_case(ast);
     default:
         printf("ast->type = %d\n", ast->type);
@@ -0,0 +1,286 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utils/alloc.h>
+#include <utils/utils.h>
+#include <utils/vec.h>
+
+#include "ast.h"
+
+// Parse a range bound, return the number of characters read, 0 on failure
+static size_t parse_bound(char *str, long long *value, int *padded,
+                          int *is_char)
+{
+    if (isalpha(str[0]) && (str[1] == '.' || str[1] == '}'))
+    {
+        *value = str[0];
+        *is_char = 1;
+        return 1;
+    }
+    size_t i = 0;
+    if (str[i] == '-' || str[i] == '+')
+        i++;
+    size_t digits = i;
+    while (isdigit(str[i]))
+        i++;
+    if (i == digits || i - digits > 18)
+        return 0;
+    *value = strtoll(str, NULL, 10);
+    *is_char = 0;
+    if (str[digits] == '0' && i - digits > 1)
+        *padded = 1;
+    return i;
+}
+
+// Parse the {x..y[..step]} part starting at the opening brace
+static size_t parse_braces(char *str, struct range *range)
+{
+    size_t i = 1;
+    int padded = 0;
+    int first_char = 0;
+    int last_char = 0;
+    long long start;
+    long long end;
+    size_t first_len = parse_bound(str + i, &start, &padded, &first_char);
+    if (first_len == 0 || strncmp(str + i + first_len, "..", 2) != 0)
+        return 0;
+    i += first_len + 2;
+    size_t last_len = parse_bound(str + i, &end, &padded, &last_char);
+    if (last_len == 0 || first_char != last_char)
+        return 0;
+    i += last_len;
+    long long step = 1;
+    if (strncmp(str + i, "..", 2) == 0)
+    {
+        i += 2;
+        size_t digits = i;
+        if (str[i] == '-' || str[i] == '+')
+            i++;
+        while (isdigit(str[i]) && i - digits < 18)
+            i++;
+        if (!isdigit(str[i - 1]))
+            return 0;
+        step = llabs(strtoll(str + digits, NULL, 10));
+    }
+    if (str[i] != '}')
+        return 0;
+    range->cur = start;
+    range->end = end;
+    range->step = step == 0 ? 1 : step;
+    if (start > end)
+        range->step = -range->step;
+    range->width = 0;
+    if (padded)
+        range->width = first_len > last_len ? first_len : last_len;
+    range->is_char = first_char;
+    range->done = 0;
+    return i + 1;
+}
+
+// Braces are not expanded and blanks do not end a word in quoted text and
+// substitutions: substitutions expand their own braces when they run
+size_t skip_nested(const char *str, size_t i)
+{
+    if (str[i] == '\\')
+        return str[i + 1] != '\0' ? i + 2 : i + 1;
+    if (str[i] == '\'')
+    {
+        const char *end = strchr(str + i + 1, '\'');
+        return end ? (size_t)(end - str) + 1 : strlen(str);
+    }
+    char close = 0;
+    size_t j = i + 1;
+    if (str[i] == '"' || str[i] == '`')
+        close = str[i];
+    else if (str[i] == '$' && (str[i + 1] == '(' || str[i + 1] == '{'))
+    {
+        close = str[i + 1] == '(' ? ')' : '}';
+        j++;
+    }
+    else
+        return i;
+    int depth = 0;
+    while (str[j] != '\0')
+    {
+        if (str[j] == close && depth == 0)
+            return j + 1;
+        if (close != '"' && close != '`' && str[j] == str[i + 1])
+            depth++;
+        else if (str[j] == close)
+            depth--;
+        // Only backslashes quote in backquotes, and single quotes are plain
+        // characters between double quotes
+        size_t next = j;
+        if (str[j] == '\\'
+            || (close != '`' && (close != '"' || str[j] != '\'')))
+            next = skip_nested(str, j);
+        j = next == j ? j + 1 : next;
+    }
+    return j;
+}
+
+size_t word_len(const char *str)
+{
+    size_t i = 0;
+    while (str[i] != '\0' && str[i] != ' ' && str[i] != '\t'
+           && str[i] != '\n')
+    {
+        size_t next = skip_nested(str, i);
+        i = next == i ? i + 1 : next;
+    }
+    return i;
+}
+
+int range_parse(char *word, struct range *range)
+{
+    size_t i = 0;
+    while (word[i] != '\0' && word[i] != ' ' && word[i] != '\t'
+           && word[i] != '\n')
+    {
+        size_t next = skip_nested(word, i);
+        if (next != i)
+        {
+            i = next;
+            continue;
+        }
+        size_t len = word[i] == '{' ? parse_braces(word + i, range) : 0;
+        if (len == 0)
+        {
+            i++;
+            continue;
+        }
+        range->prefix = word;
+        range->prefix_len = i;
+        range->suffix = word + i + len;
+        range->suffix_len = word_len(range->suffix);
+        range->buf = NULL;
+        return 1;
+    }
+    return 0;
+}
+
+char *range_next(struct range *range)
+{
+    if (range->done)
+        return NULL;
+    if (!range->buf)
+        range->buf = vec_init();
+    vec_reset(range->buf);
+    for (size_t i = 0; i < range->prefix_len; i++)
+        vec_push(range->buf, range->prefix[i]);
+    char number[32];
+    if (range->is_char)
+        sprintf(number, "%c", (char)range->cur);
+    else
+        sprintf(number, "%0*lld", range->width, range->cur);
+    for (size_t i = 0; number[i] != '\0'; i++)
+        vec_push(range->buf, number[i]);
+    for (size_t i = 0; i < range->suffix_len; i++)
+        vec_push(range->buf, range->suffix[i]);
+
+    // Stop once the next value would step over the end bound
+    if (range->step > 0 ? range->end - range->cur < range->step
+                        : range->end - range->cur > range->step)
+        range->done = 1;
+    else
+        range->cur += range->step;
+    return vec_cstring(range->buf);
+}
+
+void range_free(struct range *range)
+{
+    if (!range->buf)
+        return;
+    vec_free(range->buf);
+    range->buf = NULL;
+}
+
+int range_is_static(struct range *range)
+{
+    // Expansions and globs apply to each value, as does a second range
+    char *special = "$`\\\'\"*?[";
+    for (size_t i = 0; i < range->prefix_len; i++)
+    {
+        if (strchr(special, range->prefix[i]))
+            return 0;
+    }
+    for (size_t i = 0; i < range->suffix_len; i++)
+    {
+        if (strchr(special, range->suffix[i]))
+            return 0;
+    }
+    struct range next;
+    return !range_parse(range->suffix, &next);
+}
+
+/**
+ * \brief Push the words the word expands to on res, each following head
+ * @details The values of its first range are followed by the words its
+ * suffix expands to, so that every range of the word is expanded
+ */
+static void brace_word(struct vec *res, struct vec *head, char *word,
+                       int *first)
+{
+    struct range range;
+    if (!range_parse(word, &range))
+    {
+        if (!*first)
+            vec_push(res, ' ');
+        *first = 0;
+        if (head->size > 0)
+            vec_append(res, head->data, head->size);
+        vec_append(res, word, strlen(word));
+        return;
+    }
+    size_t head_len = head->size;
+    char *suffix = strndup(range.suffix, range.suffix_len);
+    char *value = NULL;
+    while ((value = range_next(&range)) != NULL)
+    {
+        vec_append(head, value, strlen(value) - range.suffix_len);
+        brace_word(res, head, suffix, first);
+        head->size = head_len;
+    }
+    range_free(&range);
+    free(suffix);
+}
+
+char *expand_braces(char *str, int assigns)
+{
+    struct vec *res = NULL;
+    size_t copied = 0;
+    size_t i = 0;
+    while (str[i] != '\0')
+    {
+        while (str[i] == ' ' || str[i] == '\t' || str[i] == '\n')
+            i++;
+        size_t word = i;
+        i += word_len(str + i);
+        struct range range;
+        char save = str[i];
+        str[i] = '\0';
+        // The assignment words before the command name are not expanded
+        if (assigns)
+            assigns = is_assign_word(str + word);
+        if (!assigns && range_parse(str + word, &range))
+        {
+            if (!res)
+                res = vec_init();
+            vec_append(res, str + copied, word - copied);
+            struct vec head = { NULL, 0, 0 };
+            int first = 1;
+            brace_word(res, &head, str + word, &first);
+            vec_destroy(&head);
+            copied = i;
+        }
+        str[i] = save;
+    }
+    if (!res)
+        return str;
+    vec_append(res, str + copied, strlen(str + copied));
+    char *new = strdup(vec_cstring(res));
+    vec_free(res);
+    free(str);
+    return new;
+}
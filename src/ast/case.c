@@ -1,21 +1,275 @@
-#define _GNU_SOURCE
-
-#include <fnmatch.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utils/alloc.h>
+#include <utils/pattern.h>
+#include <utils/vec.h>
 
 #include "ast.h"
 
+#define NONE 0
+#define SIMPLE 1
+#define DOUBLE 2
+
+static size_t hash_string(const char *str)
+{
+    size_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; str[i] != '\0'; i++)
+    {
+        hash ^= (unsigned char)str[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Return if the word is changed by parameter or command substitution
+static int needs_expansion(const char *word)
+{
+    int context = NONE;
+    for (size_t i = 0; word[i] != '\0'; i++)
+    {
+        if (word[i] == '\\' && context != SIMPLE && word[i + 1] != '\0')
+            i++;
+        else if (word[i] == '\'' && context != DOUBLE)
+            context = context == NONE ? SIMPLE : NONE;
+        else if (word[i] == '\"' && context != SIMPLE)
+            context = context == NONE ? DOUBLE : NONE;
+        else if ((word[i] == '$' || word[i] == '`') && context != SIMPLE)
+            return 1;
+    }
+    return 0;
+}
+
+static void push_literal(struct vec *vec, char c)
+{
+    if (strchr("*?[\\", c))
+        vec_push(vec, '\\');
+    vec_push(vec, c);
+}
+
+char *pattern_unquote(char *str)
+{
+    struct vec *vec = vec_init();
+    int context = NONE;
+    for (size_t i = 0; str[i] != '\0'; i++)
+    {
+        if (context == SIMPLE)
+        {
+            if (str[i] == '\'')
+                context = NONE;
+            else
+                push_literal(vec, str[i]);
+        }
+        else if (str[i] == '\\' && str[i + 1] != '\0')
+        {
+            if (context == DOUBLE && !strchr("$`\"\\", str[i + 1]))
+                push_literal(vec, str[i]);
+            else
+            {
+                vec_push(vec, '\\');
+                vec_push(vec, str[i + 1]);
+                i++;
+            }
+        }
+        else if (str[i] == '\"')
+            context = context == NONE ? DOUBLE : NONE;
+        else if (str[i] == '\'' && context == NONE)
+            context = SIMPLE;
+        else if (context == DOUBLE)
+            push_literal(vec, str[i]);
+        else
+            vec_push(vec, str[i]);
+    }
+    char *res = strdup(vec_cstring(vec));
+    vec_free(vec);
+    free(str);
+    return res;
+}
+
+// Remove the escapes of a pattern without glob characters
+static char *pattern_unescape(char *str)
+{
+    size_t j = 0;
+    for (size_t i = 0; str[i] != '\0'; i++)
+    {
+        if (str[i] == '\\' && str[i + 1] != '\0')
+            i++;
+        str[j++] = str[i];
+    }
+    str[j] = '\0';
+    return str;
+}
+
+static struct case_literal *literal_find(struct case_table *table,
+                                         const char *key, size_t hash)
+{
+    size_t mask = table->capacity - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask)
+    {
+        struct case_literal *entry = table->literals + i;
+        if (!entry->key
+            || (entry->hash == hash && strcmp(entry->key, key) == 0))
+            return entry;
+    }
+}
+
+static void literal_grow(struct case_table *table)
+{
+    struct case_literal *old = table->literals;
+    size_t old_capacity = table->capacity;
+    table->capacity = old_capacity == 0 ? 16 : old_capacity * 2;
+    table->literals = zalloc(table->capacity * sizeof(struct case_literal));
+    for (size_t i = 0; i < old_capacity; i++)
+    {
+        if (old[i].key)
+            *literal_find(table, old[i].key, old[i].hash) = old[i];
+    }
+    free(old);
+}
+
+static void literal_add(struct case_table *table, char *key, size_t index,
+                        struct cas *arm)
+{
+    // Keep the load factor under one half
+    if (2 * (table->count + 1) > table->capacity)
+        literal_grow(table);
+    size_t hash = hash_string(key);
+    struct case_literal *entry = literal_find(table, key, hash);
+    // A word matches the first arm listing it
+    if (entry->key)
+    {
+        free(key);
+        return;
+    }
+    entry->key = key;
+    entry->hash = hash;
+    entry->index = index;
+    entry->arm = arm;
+    table->count++;
+}
+
+void case_add_pattern(struct ast *ast, struct cas *arm, size_t index,
+                      char *word)
+{
+    if (!ast->case_table)
+        ast->case_table = zalloc(sizeof(struct case_table));
+    struct case_table *table = ast->case_table;
+    struct case_pattern *pattern = NULL;
+    if (needs_expansion(word))
+    {
+        pattern = zalloc(sizeof(struct case_pattern));
+        pattern->pattern = strdup(word);
+    }
+    else
+    {
+        char *unquoted = pattern_unquote(strdup(word));
+        if (!pattern_has_glob(unquoted))
+        {
+            literal_add(table, pattern_unescape(unquoted), index, arm);
+            return;
+        }
+        pattern = zalloc(sizeof(struct case_pattern));
+        pattern->compiled = pattern_compile(unquoted);
+        free(unquoted);
+    }
+    pattern->index = index;
+    pattern->arm = arm;
+    if (table->last)
+        table->last->next = pattern;
+    else
+        table->patterns = pattern;
+    table->last = pattern;
+}
+
+void case_table_free(struct case_table *table)
+{
+    if (!table)
+        return;
+    for (size_t i = 0; i < table->capacity; i++)
+        free(table->literals[i].key);
+    free(table->literals);
+    struct case_pattern *pattern = table->patterns;
+    while (pattern)
+    {
+        struct case_pattern *next = pattern->next;
+        free(pattern->pattern);
+        pattern_free(pattern->compiled);
+        free(pattern);
+        pattern = next;
+    }
+    free(table);
+}
+
+static char *expand_word(struct ast *ast, char *word)
+{
+    char *tmp =
+        expand_fields(strdup(word), NULL, NULL, EXPAND_KEEP, &ast->arith);
+    return substitute_cmds(tmp);
+}
+
+/**
+ * \brief Match a pattern alternative against word
+ * @return: 1 if it matches, 0 if not, -1 on expansion error
+ */
+static int pattern_matches(struct ast *ast, struct case_pattern *pattern,
+                           char *word)
+{
+    if (pattern->compiled)
+        return pattern_match(pattern->compiled, word);
+    char *expanded = expand_word(ast, pattern->pattern);
+    if (expanded == NULL)
+        return -1;
+    expanded = pattern_unquote(expanded);
+    struct pattern *compiled = pattern_compile(expanded);
+    int res = pattern_match(compiled, word);
+    pattern_free(compiled);
+    free(expanded);
+    return res;
+}
+
 int handle_case(struct ast *ast)
 {
-    struct cas *cas = ast->cas;
-    while (cas)
+    struct case_table *table = ast->case_table;
+    if (!table)
+        return 1;
+    char *word = expand_word(ast, ast->word);
+    if (word == NULL)
+        return 2;
+    word = remove_quotes(word);
+
+    struct cas *arm = NULL;
+    size_t limit = SIZE_MAX;
+    if (table->count > 0)
+    {
+        struct case_literal *literal =
+            literal_find(table, word, hash_string(word));
+        if (literal->key)
+        {
+            arm = literal->arm;
+            limit = literal->index;
+        }
+    }
+    // Only the arms before the literal match can take precedence over it
+    for (struct case_pattern *pattern = table->patterns;
+         pattern && pattern->index < limit; pattern = pattern->next)
     {
-        if (fnmatch(cas->pattern, ast->word, FNM_EXTMATCH) == 0)
+        int match = pattern_matches(ast, pattern, word);
+        if (match == -1)
+        {
+            free(word);
+            return 2;
+        }
+        if (match)
         {
-            int return_code = 0;
-            return_code = ast_eval(cas->ast, &return_code);
-            return return_code;
+            arm = pattern->arm;
+            break;
         }
-        cas = cas->next;
     }
-    return 1;
+    free(word);
+    if (!arm)
+        return 1;
+    int return_code = 0;
+    return_code = ast_eval(arm->ast, &return_code);
+    return return_code;
 }
@@ -8,6 +8,8 @@
 #include <sys/wait.h>
 #include <unistd.h>
 #include <utils/alloc.h>
+#include <utils/intern.h>
+#include <utils/slab.h>
 #include <utils/utils.h>
 #include <utils/vec.h>
 
@@ -26,56 +28,77 @@ static char *is_valid(char *str)
     return NULL;
 }
 
-int cmdblock(char *args)
+// Parse the commands of a block, NULL if it is not closed. What could be
+// parsed before a syntax error is run anyway
+static struct parser *block_parse(char *args)
 {
     char *blk = is_valid(args);
     if (!blk)
     {
         fprintf(stderr, "42sh: Syntax error: end of file unexecpected\n");
-        return 2;
+        return NULL;
     }
-
     struct parser *parser = create_parser();
     parser->lexer = lexer_create(blk);
-    enum parser_state state = parsing(parser);
-    int return_code = 0;
-    if (state != PARSER_OK)
-        return_code = 2;
-    return_code = ast_eval(parser->ast, &return_code);
-    global->parsers_to_free[global->nb_parsers++] = parser;
+    parsing(parser);
     free(blk);
+    return parser;
+}
+
+int cmdblock(struct ast *ast)
+{
+    int return_code = 0;
+    if (ast->block_busy)
+    {
+        // The functions it defines point into its nodes, which are kept
+        struct parser *parser = block_parse(vec_cstring(ast->val));
+        if (!parser)
+            return 2;
+        return_code = ast_eval(parser->ast, &return_code);
+        global->parsers_to_free[global->nb_parsers++] = parser;
+        return return_code;
+    }
+    if (!ast->block)
+        ast->block = block_parse(vec_cstring(ast->val));
+    if (!ast->block)
+        return 2;
+    ast->block_busy = 1;
+    return_code = ast_eval(ast->block->ast, &return_code);
+    ast->block_busy = 0;
     return return_code;
 }
 
 int add_function(struct ast *ast)
 {
-    struct function *new = zalloc(sizeof(struct function));
-    new->name = strdup(vec_cstring(ast->val));
+    struct function *new = slab_alloc(SLAB_FUNCTION, sizeof(struct function));
+    const char *name = vec_cstring(ast->val);
+    new->name = intern(name, strlen(name));
     new->body = ast->left;
     new->next = global->functions;
     global->functions = new;
+    global->dispatch_generation++;
     return 0;
 }
 
 void remove_function(char *name)
 {
-    struct function *fcs = global->functions;
+    const char *key = intern_find(name, strlen(name));
+    struct function *fcs = key ? global->functions : NULL;
+    global->dispatch_generation++;
     struct function *prev = NULL;
     while (fcs != NULL)
     {
-        if (strcmp(fcs->name, name) == 0)
+        if (fcs->name == key)
         {
             if (prev == NULL)
             {
                 struct function *save = global->functions;
                 global->functions = global->functions->next;
-                free(save->name);
-                free(save);
+                slab_free(SLAB_FUNCTION, save, sizeof(struct function));
                 return;
             }
             prev->next = fcs->next;
-            free(fcs->name);
-            free(fcs);
+            slab_free(SLAB_FUNCTION, fcs, sizeof(struct function));
             return;
         }
         prev = fcs;
@@ -83,85 +106,33 @@ void remove_function(char *name)
     }
 }
 
-int eval_func(char *cmd)
+struct function *find_function(const char *name)
 {
-    struct function *fs = global->functions;
-    char *params = strchr(cmd, ' ');
-    char *name = strndup(cmd, params - cmd);
-
-    while (fs)
-    {
-        if (!strcmp(name, fs->name))
-            break;
-        fs = fs->next;
-    }
-    free(name);
-    if (!fs)
-    {
-        return -1;
-    }
+    const char *key = intern_find(name, strlen(name));
+    return key ? find_function_interned(key) : NULL;
+}
 
-    int nb_params = 1;
-    if (params)
-        params++;
-    char *save_params = strdup("");
-    if (!params)
-        nb_params = 0;
-    while (nb_params <= 9 && nb_params != 0)
+struct function *find_function_interned(const char *key)
+{
+    for (struct function *fs = global->functions; fs; fs = fs->next)
     {
-        char *current_param = strchr(params, ' ');
-        if (!current_param)
-            current_param = params + strlen(params);
-        if (current_param == params)
-        {
-            nb_params = 0;
-            break;
-        }
-        char *nb_params_alloc = my_itoa(nb_params);
-        char *tmp = strndup(params, current_param - params);
-
-        while (*tmp && isblank(*tmp))
-            ++tmp;
-        if (strlen(tmp))
-        {
-            char *save_param_tmp =
-                calloc(strlen(save_params) + strlen(tmp) + 2, sizeof(char));
-            if (!strcmp("", save_params))
-                sprintf(save_param_tmp, "%s", tmp);
-            else
-                sprintf(save_param_tmp, "%s %s", save_params, tmp);
-            free(save_params);
-            save_params = save_param_tmp;
-        }
-        push_front(nb_params_alloc, tmp);
-        free(nb_params_alloc);
-        params = current_param + 1;
-        ++nb_params;
-        if (!(*current_param))
-            break;
+        if (fs->name == key)
+            return fs;
     }
+    return NULL;
+}
 
-    if (save_params == NULL)
-        save_params = "";
-    if (nb_params > 0)
-        nb_params--;
-    push_front("*", strdup(save_params));
-    push_front("@", strdup(save_params));
-    push_front("#", my_itoa(nb_params));
-    free(save_params);
+int call_function(struct function *function, char **argv, size_t argc)
+{
+    // The function has its own positional parameters, the caller gets its
+    // own ones back when it returns
+    struct params *saved = global->params;
+    global->params = params_new(argv + 1, argc - 1);
 
     int ret = 0;
-    int return_val = ast_eval(fs->body, &ret);
-
-    unset_var("*");
-    unset_var("@");
-    unset_var("#");
-    for (int i = 1; i <= nb_params; ++i)
-    {
-        char *itoaed = my_itoa(i);
-        unset_var(itoaed);
-        free(itoaed);
-    }
+    int return_val = ast_eval(function->body, &ret);
 
+    params_free(global->params);
+    global->params = saved;
     return return_val;
-}
\ No newline at end of file
+}
@@ -0,0 +1,495 @@
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <utils/alloc.h>
+#include <utils/dirwalk.h>
+#include <utils/pattern.h>
+#include <utils/vec.h>
+
+#include "ast.h"
+
+#define NONE 0
+#define SIMPLE 1
+#define DOUBLE 2
+
+/**
+ * \brief Number of directory listings kept between expansions
+ */
+#define GLOB_CACHE_SIZE 16
+
+/**
+ * \brief The entries of a directory, read once and reused while the
+ * directory is unchanged
+ * @details names holds the entries one after the other, each ended by a
+ * '\0', read_time is when the directory was read
+ */
+struct dir_listing
+{
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    time_t read_time;
+    char *names;
+    size_t size;
+    size_t count;
+    size_t last_use;
+};
+
+static struct dir_listing cache[GLOB_CACHE_SIZE];
+static size_t cache_clock = 0;
+
+/**
+ * \brief The pathnames matched by a word
+ */
+struct glob_matches
+{
+    char **paths;
+    size_t size;
+    size_t capacity;
+};
+
+static void listing_clear(struct dir_listing *listing)
+{
+    free(listing->names);
+    memset(listing, 0, sizeof(struct dir_listing));
+}
+
+static int listing_read(struct dir_listing *listing, const char *path)
+{
+    DIR *dir = opendir(path);
+    if (!dir)
+        return -1;
+    size_t capacity = 4096;
+    listing->names = xmalloc(capacity);
+    listing->size = 0;
+    listing->count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        size_t len = strlen(entry->d_name) + 1;
+        if (listing->size + len > capacity)
+        {
+            while (listing->size + len > capacity)
+                capacity *= 2;
+            listing->names = xrealloc(listing->names, capacity);
+        }
+        memcpy(listing->names + listing->size, entry->d_name, len);
+        listing->size += len;
+        listing->count++;
+    }
+    closedir(dir);
+    listing->read_time = time(NULL);
+    return 0;
+}
+
+/**
+ * \brief Return the entries of the directory at path, NULL if it can not
+ * be read
+ * @details A listing is reused when the directory has the same inode and
+ * mtime. A directory modified during the second it was read may change
+ * again without its mtime moving on coarse clocks, such listings are read
+ * again each time.
+ */
+static struct dir_listing *listing_get(const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) == -1 || !S_ISDIR(st.st_mode))
+        return NULL;
+    struct dir_listing *slot = cache;
+    for (size_t i = 0; i < GLOB_CACHE_SIZE; i++)
+    {
+        struct dir_listing *listing = cache + i;
+        if (listing->names && listing->dev == st.st_dev
+            && listing->ino == st.st_ino)
+        {
+            slot = listing;
+            break;
+        }
+        if (listing->last_use < slot->last_use)
+            slot = listing;
+    }
+    slot->last_use = ++cache_clock;
+    if (slot->names && slot->dev == st.st_dev && slot->ino == st.st_ino
+        && slot->mtime.tv_sec == st.st_mtim.tv_sec
+        && slot->mtime.tv_nsec == st.st_mtim.tv_nsec
+        && st.st_mtim.tv_sec < slot->read_time)
+        return slot;
+    listing_clear(slot);
+    slot->last_use = cache_clock;
+    if (listing_read(slot, path) == -1)
+    {
+        listing_clear(slot);
+        return NULL;
+    }
+    slot->dev = st.st_dev;
+    slot->ino = st.st_ino;
+    slot->mtime = st.st_mtim;
+    return slot;
+}
+
+void glob_cache_free(void)
+{
+    for (size_t i = 0; i < GLOB_CACHE_SIZE; i++)
+        listing_clear(cache + i);
+}
+
+static void matches_add(struct glob_matches *matches, const char *path,
+                        size_t len)
+{
+    if (matches->size >= matches->capacity)
+    {
+        matches->capacity = matches->capacity ? matches->capacity * 2 : 16;
+        matches->paths =
+            xrealloc(matches->paths, matches->capacity * sizeof(char *));
+    }
+    matches->paths[matches->size++] = strndup(path, len);
+}
+
+// Return the end of the pattern component starting at str
+static char *component_end(char *str)
+{
+    size_t i = 0;
+    while (str[i] != '\0' && str[i] != '/')
+    {
+        if (str[i] == '\\' && str[i + 1] != '\0')
+            i++;
+        i++;
+    }
+    return str + i;
+}
+
+// Terminate path without counting the '\0', so that it can still grow
+static char *path_cstring(struct vec *path)
+{
+    vec_push(path, '\0');
+    path->size--;
+    return path->data;
+}
+
+// Append a component without glob characters to path, dropping escapes
+static void push_literal(struct vec *path, const char *str, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        if (str[i] == '\\' && i + 1 < len)
+            i++;
+        vec_push(path, str[i]);
+    }
+}
+
+static void glob_walk(struct vec *path, char *pattern,
+                      struct glob_matches *matches);
+
+// Add the entries below path whose name matches the last component rest
+static void globstar_names(struct vec *path, char *rest,
+                           struct glob_matches *matches)
+{
+    size_t prefix = path->size;
+    size_t count = 0;
+    char **entries =
+        dir_walk(prefix == 0 ? "." : path_cstring(path), WALK_ALL, &count);
+    if (!entries)
+        return;
+    struct pattern *compiled = pattern_compile(rest);
+    for (size_t i = 0; i < count; i++)
+    {
+        char *name = strrchr(entries[i], '/');
+        if (!pattern_match(compiled, name ? name + 1 : entries[i]))
+            continue;
+        for (size_t j = 0; entries[i][j] != '\0'; j++)
+            vec_push(path, entries[i][j]);
+        matches_add(matches, path->data, path->size);
+        path->size = prefix;
+    }
+    pattern_free(compiled);
+    dir_walk_free(entries, count);
+}
+
+/**
+ * \brief Expand a ** component, which matches any number of directories
+ * when followed by other components and every entry below path otherwise
+ * @param end: the end of the ** component
+ */
+static void glob_globstar(struct vec *path, char *end,
+                          struct glob_matches *matches)
+{
+    char *rest = end + 1;
+    // **/name only needs the names of the entries, the tree is read once
+    if (*end == '/' && *rest != '\0' && *component_end(rest) == '\0'
+        && rest[0] != '.' && rest[0] != '\\')
+    {
+        globstar_names(path, rest, matches);
+        return;
+    }
+    size_t prefix = path->size;
+    size_t count = 0;
+    char **entries = dir_walk(prefix == 0 ? "." : path_cstring(path),
+                              *end == '/' ? WALK_DIRS : WALK_ALL, &count);
+    if (!entries)
+        return;
+    // Zero directories: the components after ** apply to path itself, which
+    // keeps its slash as a match of its own
+    if (*end == '/')
+        glob_walk(path, rest, matches);
+    else if (prefix > 0)
+        matches_add(matches, path->data, prefix);
+    for (size_t i = 0; i < count; i++)
+    {
+        for (size_t j = 0; entries[i][j] != '\0'; j++)
+            vec_push(path, entries[i][j]);
+        if (*end == '/')
+        {
+            vec_push(path, '/');
+            glob_walk(path, rest, matches);
+        }
+        else
+            matches_add(matches, path->data, path->size);
+        path->size = prefix;
+    }
+    dir_walk_free(entries, count);
+}
+
+/**
+ * \brief Add the pathnames under path matching the components of pattern
+ * @param path: the directory prefix matched so far, ends with '/' unless
+ * empty
+ */
+static void glob_walk(struct vec *path, char *pattern,
+                      struct glob_matches *matches)
+{
+    size_t prefix = path->size;
+    char *end = component_end(pattern);
+    if (end - pattern == 2 && pattern[0] == '*' && pattern[1] == '*')
+    {
+        glob_globstar(path, end, matches);
+        return;
+    }
+    char save = *end;
+    *end = '\0';
+    int is_glob = pattern_has_glob(pattern);
+    *end = save;
+    if (!is_glob)
+    {
+        push_literal(path, pattern, end - pattern);
+        if (*end == '/')
+        {
+            vec_push(path, '/');
+            glob_walk(path, end + 1, matches);
+        }
+        else
+        {
+            struct stat st;
+            // Only the directories leading to the last component are read,
+            // a literal last component must exist on its own
+            if (lstat(path_cstring(path), &st) == 0)
+                matches_add(matches, path->data, path->size);
+        }
+        path->size = prefix;
+        return;
+    }
+
+    const char *dir_path = prefix == 0 ? "." : path_cstring(path);
+    struct dir_listing *listing = listing_get(dir_path);
+    if (!listing)
+        return;
+    *end = '\0';
+    struct pattern *compiled = pattern_compile(pattern);
+    int dot = pattern[0] == '.' || (pattern[0] == '\\' && pattern[1] == '.');
+    *end = save;
+    // The listing may be replaced while walking the subdirectories
+    char *copy = NULL;
+    if (*end == '/')
+    {
+        copy = xmalloc(listing->size);
+        memcpy(copy, listing->names, listing->size);
+    }
+    size_t count = listing->count;
+    char *name = copy ? copy : listing->names;
+    for (size_t i = 0; i < count; i++, name += strlen(name) + 1)
+    {
+        // A leading dot is only matched explicitly
+        if ((name[0] == '.' && !dot) || !pattern_match(compiled, name))
+            continue;
+        for (size_t j = 0; name[j] != '\0'; j++)
+            vec_push(path, name[j]);
+        if (*end == '/')
+        {
+            vec_push(path, '/');
+            glob_walk(path, end + 1, matches);
+        }
+        else
+            matches_add(matches, path->data, path->size);
+        path->size = prefix;
+    }
+    free(copy);
+    pattern_free(compiled);
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * \brief Turn a word into a pattern where quoted characters are escaped
+ * @return: the pattern, allocated in the scratch arena, NULL if the word
+ * has no unquoted glob character
+ */
+static char *word_pattern(const char *word, size_t len)
+{
+    // Most words have no glob character at all
+    size_t i = 0;
+    while (i < len && word[i] != '*' && word[i] != '?' && word[i] != '[')
+        i++;
+    if (i == len)
+        return NULL;
+    // Each character is escaped at most once
+    char *res = arena_alloc(&global->scratch, 2 * len + 1);
+    size_t size = 0;
+    int context = NONE;
+    int unquoted_glob = 0;
+    for (i = 0; i < len; i++)
+    {
+        char c = word[i];
+        if (c == '\'' && context != DOUBLE)
+        {
+            context = context == NONE ? SIMPLE : NONE;
+            continue;
+        }
+        if (c == '\"' && context != SIMPLE)
+        {
+            context = context == NONE ? DOUBLE : NONE;
+            continue;
+        }
+        if (c == '\\' && context != SIMPLE && i + 1 < len
+            && (context == NONE || strchr("$`\"\\", word[i + 1])))
+            c = word[++i];
+        else if (context == NONE)
+        {
+            if (c == '*' || c == '?' || c == '[')
+                unquoted_glob = 1;
+            res[size++] = c;
+            continue;
+        }
+        if (strchr("*?[]\\", c))
+            res[size++] = '\\';
+        res[size++] = c;
+    }
+    res[size] = '\0';
+    if (unquoted_glob && pattern_has_glob(res))
+        return res;
+    return NULL;
+}
+
+int is_assign_word(const char *word)
+{
+    size_t i = 0;
+    if (!(word[i] == '_' || (word[i] >= 'a' && word[i] <= 'z')
+          || (word[i] >= 'A' && word[i] <= 'Z')))
+        return 0;
+    while (word[i] == '_' || (word[i] >= 'a' && word[i] <= 'z')
+           || (word[i] >= 'A' && word[i] <= 'Z')
+           || (word[i] >= '0' && word[i] <= '9'))
+        i++;
+    // The subscript of an array element is not a pattern
+    if (word[i] == '[')
+    {
+        while (word[i] != '\0' && word[i] != ']')
+            i++;
+        if (word[i] == ']')
+            i++;
+    }
+    if (word[i] == '+')
+        i++;
+    return word[i] == '=';
+}
+
+/**
+ * \brief Expand the pattern of a word into res
+ * @return: 1 if the word matched pathnames, 0 if it must be kept as is
+ */
+static int glob_word(char *pattern, struct vec *res)
+{
+    struct glob_matches matches = { NULL, 0, 0 };
+    struct vec *path = vec_init();
+    if (pattern[0] == '/')
+    {
+        vec_push(path, '/');
+        glob_walk(path, pattern + 1, &matches);
+    }
+    else
+        glob_walk(path, pattern, &matches);
+    vec_free(path);
+    if (matches.size == 0)
+        return 0;
+    qsort(matches.paths, matches.size, sizeof(char *), compare_paths);
+    for (size_t i = 0; i < matches.size; i++)
+    {
+        if (i > 0)
+            vec_push(res, ' ');
+        word_quote(res, matches.paths[i], strlen(matches.paths[i]));
+        free(matches.paths[i]);
+    }
+    free(matches.paths);
+    return 1;
+}
+
+char *expand_globs(char *str)
+{
+    struct vec *res = NULL;
+    size_t copied = 0;
+    size_t word = 0;
+    size_t i = 0;
+    int context = NONE;
+    int assigns = 1;
+    while (str[i] != '\0')
+    {
+        if (str[i] == '\\' && str[i + 1] != '\0' && context != SIMPLE)
+            i++;
+        else if (str[i] == '\'' && context != DOUBLE)
+            context = context == NONE ? SIMPLE : NONE;
+        else if (str[i] == '\"' && context != SIMPLE)
+            context = context == NONE ? DOUBLE : NONE;
+        i++;
+        if (context != NONE || (str[i] != ' ' && str[i] != '\0'))
+            continue;
+
+        // End of a word: replace it by the pathnames it matches
+        if (assigns)
+            assigns = is_assign_word(str + word);
+        struct arena_mark mark = arena_mark(&global->scratch);
+        char *pattern = assigns ? NULL : word_pattern(str + word, i - word);
+        if (pattern)
+        {
+            if (!res)
+                res = vec_init();
+            size_t start = res->size;
+            for (size_t j = copied; j < word; j++)
+                vec_push(res, str[j]);
+            if (glob_word(pattern, res))
+                copied = i;
+            else
+                res->size = start;
+        }
+        arena_release(&global->scratch, mark);
+        while (str[i] == ' ')
+            i++;
+        word = i;
+    }
+    if (!res || copied == 0)
+    {
+        if (res)
+        {
+            vec_free(res);
+        }
+        return str;
+    }
+    for (size_t j = copied; str[j] != '\0'; j++)
+        vec_push(res, str[j]);
+    char *new = strdup(vec_cstring(res));
+    vec_free(res);
+    free(str);
+    return new;
+}
@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utils/alloc.h>
+#include <utils/intern.h>
+
+#include "ast.h"
+
+/**
+ * \brief The size of the bucket array when the table is first used
+ */
+#define CMD_HASH_MIN_BUCKETS 64
+
+/**
+ * \brief The command hash table, chained so that entries do not move: the
+ * dispatch caches point to them
+ * @details first and last link the entries in the order they were added,
+ * which is the order hash lists them in
+ */
+static struct hashed_cmd **buckets = NULL;
+static size_t buckets_nb = 0;
+static size_t entries_nb = 0;
+static struct hashed_cmd *first = NULL;
+static struct hashed_cmd **last = &first;
+
+static size_t bucket_of(const char *key)
+{
+    size_t hash = (size_t)key;
+    hash ^= hash >> 16;
+    hash *= 0x45d9f3b;
+    return (hash >> 4) & (buckets_nb - 1);
+}
+
+static void buckets_grow(void)
+{
+    free(buckets);
+    buckets_nb = buckets_nb ? buckets_nb * 2 : CMD_HASH_MIN_BUCKETS;
+    buckets = zalloc(buckets_nb * sizeof(struct hashed_cmd *));
+    for (struct hashed_cmd *cur = first; cur; cur = cur->order)
+    {
+        size_t i = bucket_of(cur->name);
+        cur->next = buckets[i];
+        buckets[i] = cur;
+    }
+}
+
+const char *path_dirs(void)
+{
+    struct list *var = find_var("PATH");
+    if (var != NULL)
+        return var->value;
+    // The variables of the environment are not imported in the shell
+    const char *path = getenv("PATH");
+    return path ? path : "/bin:/usr/bin";
+}
+
+char *path_search(const char *name)
+{
+    const char *path = path_dirs();
+    size_t name_len = strlen(name);
+    while (1)
+    {
+        const char *end = strchr(path, ':');
+        size_t dir_len = end ? (size_t)(end - path) : strlen(path);
+        // An empty directory is the current one
+        char *file = xmalloc(dir_len + name_len + 3);
+        if (dir_len == 0)
+            file[dir_len++] = '.';
+        else
+            memcpy(file, path, dir_len);
+        file[dir_len] = '/';
+        memcpy(file + dir_len + 1, name, name_len + 1);
+        struct stat st;
+        if (stat(file, &st) == 0 && S_ISREG(st.st_mode)
+            && access(file, X_OK) == 0)
+            return file;
+        free(file);
+        if (end == NULL)
+            return NULL;
+        path = end + 1;
+    }
+}
+
+struct hashed_cmd *cmd_hash_find(const char *key)
+{
+    if (buckets_nb == 0)
+        return NULL;
+    struct hashed_cmd *cur = buckets[bucket_of(key)];
+    while (cur && cur->name != key)
+        cur = cur->next;
+    return cur;
+}
+
+struct hashed_cmd *cmd_hash_set(const char *key, char *path)
+{
+    struct hashed_cmd *entry = cmd_hash_find(key);
+    if (entry)
+    {
+        // The commands which resolved to it must look it up again
+        global->dispatch_generation++;
+        free(entry->path);
+        entry->path = path;
+        entry->hits = 0;
+        return entry;
+    }
+    if (entries_nb >= buckets_nb)
+        buckets_grow();
+    entry = zalloc(sizeof(struct hashed_cmd));
+    entry->name = key;
+    entry->path = path;
+    size_t i = bucket_of(key);
+    entry->next = buckets[i];
+    buckets[i] = entry;
+    *last = entry;
+    last = &entry->order;
+    entries_nb++;
+    return entry;
+}
+
+struct hashed_cmd *cmd_hash_get(const char *key)
+{
+    struct hashed_cmd *entry = cmd_hash_find(key);
+    if (entry)
+        return entry;
+    char *path = path_cache_lookup(key);
+    if (path == NULL)
+    {
+        path = path_search(key);
+        if (path == NULL)
+            return NULL;
+        path_cache_store(key, path);
+    }
+    return cmd_hash_set(key, path);
+}
+
+void cmd_hash_clear(void)
+{
+    while (first)
+    {
+        struct hashed_cmd *next = first->order;
+        free(first->path);
+        free(first);
+        first = next;
+    }
+    last = &first;
+    free(buckets);
+    buckets = NULL;
+    buckets_nb = 0;
+    entries_nb = 0;
+    global->dispatch_generation++;
+    // Check the directories of PATH again before trusting the file
+    path_cache_close();
+}
+
+int cmd_hash_print(void)
+{
+    int header = 0;
+    for (struct hashed_cmd *cur = first; cur; cur = cur->order)
+    {
+        if (!header)
+            printf("hits\tcommand\n");
+        header = 1;
+        printf("%4zu\t%s\n", cur->hits, cur->path);
+    }
+    if (!header)
+        printf("hash: hash table empty\n");
+    fflush(stdout);
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utils/alloc.h>
+
+#include "ast.h"
+
+// Drop the cached values of $*, $@ and "$@" once the parameters change
+static void params_changed(struct params *params)
+{
+    free(params->joined);
+    free(params->starred);
+    free(params->quoted);
+    params->joined = NULL;
+    params->starred = NULL;
+    params->quoted = NULL;
+    sprintf(params->count, "%zu", params->size - params->start);
+}
+
+struct params *params_new(char **args, size_t count)
+{
+    struct params *params = zalloc(sizeof(struct params));
+    params_set(params, args, count);
+    return params;
+}
+
+void params_set(struct params *params, char **args, size_t count)
+{
+    // The new values may be the current ones, copy them first
+    char **copy = xmalloc((count + 1) * sizeof(char *));
+    for (size_t i = 0; i < count; i++)
+        copy[i] = strdup(args[i]);
+    for (size_t i = params->start; i < params->size; i++)
+        free(params->args[i]);
+    free(params->args);
+    params->args = copy;
+    params->start = 0;
+    params->size = count;
+    params_changed(params);
+}
+
+int params_shift(struct params *params, size_t n)
+{
+    if (n > params->size - params->start)
+        return -1;
+    for (size_t i = 0; i < n; i++)
+        free(params->args[params->start++]);
+    params_changed(params);
+    return 0;
+}
+
+void params_free(struct params *params)
+{
+    if (params == NULL)
+        return;
+    for (size_t i = params->start; i < params->size; i++)
+        free(params->args[i]);
+    free(params->args);
+    free(params->joined);
+    free(params->starred);
+    free(params->quoted);
+    free(params);
+}
+
+char *fields_join(char *const *fields, size_t count, const char *sep,
+                  const char *escape)
+{
+    size_t sep_len = strlen(sep);
+    size_t len = 1;
+    for (size_t i = 0; i < count; i++)
+    {
+        len += strlen(fields[i]) * 2 + sep_len;
+        if (!escape)
+            len -= strlen(fields[i]);
+    }
+    char *res = xmalloc(len);
+    char *end = res;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (i > 0)
+        {
+            memcpy(end, sep, sep_len);
+            end += sep_len;
+        }
+        for (const char *field = fields[i]; *field != '\0'; field++)
+        {
+            if (escape && strchr(escape, *field))
+                *end++ = '\\';
+            *end++ = *field;
+        }
+    }
+    *end = '\0';
+    return res;
+}
+
+static char *params_join(struct params *params, const char *sep,
+                         const char *escape)
+{
+    return fields_join(params->args + params->start,
+                       params->size - params->start, sep, escape);
+}
+
+char *params_value(const char *name, size_t len, int quoted)
+{
+    struct params *params = global->params;
+    if (params == NULL || len == 0)
+        return NULL;
+    if (len == 1 && name[0] == '#')
+        return params->count;
+    if (len == 1 && (name[0] == '@' || name[0] == '*'))
+    {
+        if (!quoted)
+        {
+            if (!params->joined)
+                params->joined = params_join(params, " ", NULL);
+            return params->joined;
+        }
+        if (name[0] == '@')
+        {
+            // Close and reopen the double quotes between the parameters, so
+            // that each one stays a field of its own
+            if (!params->quoted)
+                params->quoted = params_join(params, QUOTED_SEP, QUOTED_ESCAPE);
+            return params->quoted;
+        }
+        struct list *ifs = find_var("IFS");
+        char sep[2] = { ifs ? ifs->value[0] : ' ', '\0' };
+        if (!params->starred || params->starred_generation
+            != global->ifs_generation)
+        {
+            free(params->starred);
+            params->starred = params_join(params, sep, QUOTED_ESCAPE);
+            params->starred_generation = global->ifs_generation;
+        }
+        return params->starred;
+    }
+    size_t index = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (name[i] < '0' || name[i] > '9')
+            return NULL;
+        index = index * 10 + name[i] - '0';
+    }
+    if (index == 0 || index > params->size - params->start)
+        return NULL;
+    return params->args[params->start + index - 1];
+}
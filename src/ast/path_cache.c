@@ -0,0 +1,279 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utils/alloc.h>
+
+#include "ast.h"
+
+/**
+ * \brief The version of the layout of the file, part of its magic
+ */
+#define PATH_CACHE_MAGIC "42shpc01"
+
+/**
+ * \brief The limits of the file: entries which do not fit are not kept
+ */
+#define PATH_CACHE_SLOTS 1024
+#define PATH_CACHE_DIRS 64
+#define PATH_CACHE_NAME 64
+#define PATH_CACHE_PATH 448
+
+/**
+ * \brief A directory of PATH as it was when the entries were found
+ */
+struct cache_dir
+{
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+};
+
+/**
+ * \brief The start of the file, which tells whether its entries are valid
+ * @details The entries are dropped as soon as PATH or one of its directories
+ * differs: a directory changes whenever a file is added to it, removed from
+ * it or renamed in it
+ */
+struct cache_header
+{
+    char magic[8];
+    uint64_t path_hash;
+    uint32_t dirs_nb;
+    uint32_t slots_nb;
+    struct cache_dir dirs[PATH_CACHE_DIRS];
+};
+
+/**
+ * \brief A command found in PATH, hash being 0 for empty slots
+ */
+struct cache_slot
+{
+    uint64_t hash;
+    char name[PATH_CACHE_NAME];
+    char path[PATH_CACHE_PATH];
+};
+
+struct cache_file
+{
+    struct cache_header header;
+    struct cache_slot slots[PATH_CACHE_SLOTS];
+};
+
+/**
+ * \brief The mapped file, NULL while it is not opened or if it is disabled
+ */
+static struct cache_file *cache = NULL;
+static int cache_fd = -1;
+// The header matching the environment of this shell: another one with a
+// different PATH may have taken the file over since it was opened
+static struct cache_header expected;
+// Set once opening failed, or if the cache is not enabled, until PATH
+// changes
+static int cache_disabled = 0;
+
+// FNV-1a, never 0 so that it tells used slots apart
+static uint64_t hash_of(const char *str)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (; *str != '\0'; str++)
+    {
+        hash ^= (unsigned char)*str;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash ? hash : 1;
+}
+
+static int cache_lock(int type)
+{
+    struct flock lock = { 0 };
+    lock.l_type = type;
+    lock.l_whence = SEEK_SET;
+    return fcntl(cache_fd, F_SETLKW, &lock);
+}
+
+/**
+ * \brief Fill header with the current PATH and the state of its directories
+ * @return: 0 on success, -1 if PATH can not be cached: it has a relative
+ * directory, which depends on the current one, or too many of them
+ */
+static int header_build(struct cache_header *header)
+{
+    const char *path = path_dirs();
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, PATH_CACHE_MAGIC, sizeof(header->magic));
+    header->path_hash = hash_of(path);
+    header->slots_nb = PATH_CACHE_SLOTS;
+    while (1)
+    {
+        const char *end = strchr(path, ':');
+        size_t len = end ? (size_t)(end - path) : strlen(path);
+        if (len == 0 || path[0] != '/' || len >= PATH_CACHE_PATH
+            || header->dirs_nb == PATH_CACHE_DIRS)
+            return -1;
+        char dir[PATH_CACHE_PATH];
+        memcpy(dir, path, len);
+        dir[len] = '\0';
+        struct cache_dir *state = &header->dirs[header->dirs_nb++];
+        struct stat st;
+        // A missing directory is recorded as such, it may be created later
+        if (stat(dir, &st) == 0)
+        {
+            state->dev = st.st_dev;
+            state->ino = st.st_ino;
+            state->mtime_sec = st.st_mtim.tv_sec;
+            state->mtime_nsec = st.st_mtim.tv_nsec;
+        }
+        if (end == NULL)
+            return 0;
+        path = end + 1;
+    }
+}
+
+// Map the file, emptying it if it does not match the current PATH
+static int cache_open(const char *file)
+{
+    if (header_build(&expected) == -1)
+        return -1;
+    cache_fd = open(file, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (cache_fd == -1)
+        return -1;
+    struct stat st;
+    // Only trust a file of the user
+    if (fstat(cache_fd, &st) == -1 || st.st_uid != getuid()
+        || !S_ISREG(st.st_mode) || cache_lock(F_WRLCK) == -1)
+        return -1;
+    if ((size_t)st.st_size != sizeof(struct cache_file)
+        && ftruncate(cache_fd, sizeof(struct cache_file)) == -1)
+        return -1;
+    void *mapped = mmap(NULL, sizeof(struct cache_file),
+                        PROT_READ | PROT_WRITE, MAP_SHARED, cache_fd, 0);
+    if (mapped == MAP_FAILED)
+        return -1;
+    cache = mapped;
+    if (memcmp(&cache->header, &expected, sizeof(expected)) != 0)
+    {
+        memset(cache->slots, 0, sizeof(cache->slots));
+        cache->header = expected;
+    }
+    cache_lock(F_UNLCK);
+    return 0;
+}
+
+void path_cache_close(void)
+{
+    if (cache)
+        munmap(cache, sizeof(struct cache_file));
+    if (cache_fd != -1)
+        close(cache_fd);
+    cache = NULL;
+    cache_fd = -1;
+    cache_disabled = 0;
+}
+
+/**
+ * \brief Open the file named by SH42_PATH_CACHE the first time it is needed
+ * @details The directories of PATH are checked then, and again each time
+ * PATH changes or hash -r is run, which close the file
+ */
+static int cache_ready(void)
+{
+    if (cache)
+        return 1;
+    if (cache_disabled)
+        return 0;
+    const char *file = getenv("SH42_PATH_CACHE");
+    if (file == NULL || file[0] == '\0' || cache_open(file) == -1)
+    {
+        path_cache_close();
+        cache_disabled = 1;
+        return 0;
+    }
+    return 1;
+}
+
+// Return the slot of name, or the empty one where it would go, NULL if the
+// table is full
+static struct cache_slot *slot_find(const char *name, uint64_t hash)
+{
+    for (size_t n = 0; n < PATH_CACHE_SLOTS; n++)
+    {
+        struct cache_slot *slot =
+            &cache->slots[(hash + n) & (PATH_CACHE_SLOTS - 1)];
+        if (slot->hash == 0
+            || (slot->hash == hash && strcmp(slot->name, name) == 0))
+            return slot;
+    }
+    return NULL;
+}
+
+// Return if path is name in one of the directories of PATH, and still an
+// executable file
+static int path_valid(const char *path, const char *name)
+{
+    size_t len = strlen(path);
+    size_t name_len = strlen(name);
+    if (len <= name_len || path[len - name_len - 1] != '/'
+        || strcmp(path + len - name_len, name) != 0)
+        return 0;
+    size_t dir_len = len - name_len - 1;
+    const char *dirs = path_dirs();
+    while (1)
+    {
+        const char *end = strchr(dirs, ':');
+        size_t cur_len = end ? (size_t)(end - dirs) : strlen(dirs);
+        if (cur_len == dir_len && strncmp(dirs, path, dir_len) == 0)
+            break;
+        if (end == NULL)
+            return 0;
+        dirs = end + 1;
+    }
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode)
+        && access(path, X_OK) == 0;
+}
+
+char *path_cache_lookup(const char *name)
+{
+    if (strlen(name) >= PATH_CACHE_NAME || !cache_ready())
+        return NULL;
+    uint64_t hash = hash_of(name);
+    char *res = NULL;
+    if (cache_lock(F_RDLCK) == -1)
+        return NULL;
+    struct cache_slot *slot = NULL;
+    if (memcmp(&cache->header, &expected, sizeof(expected)) == 0)
+        slot = slot_find(name, hash);
+    // The file may have been written by anything: check the path rather
+    // than trust it
+    if (slot && slot->hash == hash
+        && memchr(slot->path, '\0', PATH_CACHE_PATH)
+        && path_valid(slot->path, name))
+        res = strdup(slot->path);
+    cache_lock(F_UNLCK);
+    return res;
+}
+
+void path_cache_store(const char *name, const char *path)
+{
+    if (strlen(name) >= PATH_CACHE_NAME || strlen(path) >= PATH_CACHE_PATH
+        || !cache_ready())
+        return;
+    uint64_t hash = hash_of(name);
+    if (cache_lock(F_WRLCK) == -1)
+        return;
+    struct cache_slot *slot = NULL;
+    if (memcmp(&cache->header, &expected, sizeof(expected)) == 0)
+        slot = slot_find(name, hash);
+    if (slot)
+    {
+        strcpy(slot->name, name);
+        strcpy(slot->path, path);
+        slot->hash = hash;
+    }
+    cache_lock(F_UNLCK);
+}
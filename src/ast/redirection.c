@@ -6,6 +6,11 @@
 #include <unistd.h>
 #include <utils/vec.h>
 
+int fd_save(int fd)
+{
+    return fcntl(fd, F_DUPFD_CLOEXEC, FD_SAVE_MIN);
+}
+
 /**
  * \brief Generic function for left redirection
  * @paramm append: if true redirection in append mode
@@ -14,7 +19,7 @@ static int redir_left(struct ast *left, int fd, char *right, int append)
 {
     if (fd == -1)
         fd = STDOUT_FILENO; // Default case: STDOUT
-    int save_fd = dup(fd);
+    int save_fd = fd_save(fd);
 
     int file_fd = 0;
     if (append == 1)
@@ -46,7 +51,7 @@ int redir_simple_right(struct ast *left, int fd, char *right)
 {
     if (fd == -1)
         fd = STDIN_FILENO; // Default case: STDIN
-    int save_fd = dup(fd);
+    int save_fd = fd_save(fd);
 
     int file_fd = open(right, O_RDONLY);
     if (file_fd == -1)
@@ -73,7 +78,7 @@ int redir_ampersand_left(struct ast *left, int fd, char *right)
 {
     if (fd == -1)
         fd = STDOUT_FILENO;
-    int save_fd = dup(fd);
+    int save_fd = fd_save(fd);
     int file_fd = strtol(right, NULL, 10);
     if (file_fd < 0 || file_fd > 3)
     {
@@ -101,7 +106,7 @@ int redir_ampersand_right(struct ast *left, int fd, char *right)
     if (fd == -1)
         fd = STDIN_FILENO;
 
-    int save_fd = dup(fd);
+    int save_fd = fd_save(fd);
     int file_fd = open(right, O_CREAT | O_RDWR);
 
     if (file_fd == -1)
@@ -3,6 +3,19 @@
 
 #include "ast.h"
 
+/**
+ * \brief The lowest descriptor the copies of redirected descriptors get,
+ * leaving the lower ones to the scripts
+ */
+#define FD_SAVE_MIN 10
+
+/**
+ * \brief Copy fd, so that it can be restored after a redirection
+ * @details The copy is closed on exec: the commands launched while the
+ * redirection is applied do not inherit it
+ */
+int fd_save(int fd);
+
 /**
  * \brief Simple left redirection
  * @details redirection '>'
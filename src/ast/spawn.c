@@ -0,0 +1,395 @@
+#include "spawn.h"
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <utils/alloc.h>
+#include <utils/vec.h>
+
+#include "redirection.h"
+
+/**
+ * \brief The descriptors passed to the commands the server launches, those
+ * a script can redirect
+ */
+#define SPAWN_FDS 10
+
+/**
+ * \brief The descriptors the server closes when it starts, those it may
+ * have inherited from the shell
+ */
+#define SPAWN_CLOSE_MAX 64
+
+extern char **environ;
+
+/**
+ * \brief A command sent to the server, followed by size bytes: the path of
+ * the executable, the arguments and the environment, each NUL terminated
+ * @details The descriptors in fds, a bit per descriptor, and the working
+ * directory come with it
+ */
+struct spawn_request
+{
+    uint32_t size;
+    uint32_t argc;
+    uint32_t envc;
+    uint32_t fds;
+};
+
+/**
+ * \brief What the server answers once the command exited
+ */
+struct spawn_reply
+{
+    int32_t err;
+    int32_t wstatus;
+};
+
+/**
+ * \brief The socket of the server, and the process it belongs to: the
+ * children of the shell do not share it
+ */
+static int server_fd = -1;
+static pid_t server_owner = 0;
+static pid_t server_pid = 0;
+
+/**
+ * \brief Return the arguments running file with sh, as execvp does for the
+ * files which are not executables, allocated
+ */
+static char **script_args(const char *file, char **args)
+{
+    size_t argc = 0;
+    while (args[argc] != NULL)
+        argc++;
+    char **sh_args = xmalloc((argc + 2) * sizeof(char *));
+    sh_args[0] = "sh";
+    sh_args[1] = (char *)file;
+    // The arguments following the name, and their NULL terminator
+    memcpy(sh_args + 2, args + 1, argc * sizeof(char *));
+    return sh_args;
+}
+
+int spawn_command(pid_t *pid, const char *path, char **args,
+                  const posix_spawn_file_actions_t *actions,
+                  const posix_spawnattr_t *attr, char **envp)
+{
+    int err = path ? posix_spawn(pid, path, actions, attr, args, envp)
+                   : posix_spawnp(pid, args[0], actions, attr, args, envp);
+    if (err == ENOEXEC)
+    {
+        char **sh_args = script_args(path ? path : args[0], args);
+        err = posix_spawn(pid, "/bin/sh", actions, attr, sh_args, envp);
+        free(sh_args);
+    }
+    return err;
+}
+
+int exec_command(const char *path, char **args)
+{
+    spawn_server_stop();
+    // Nothing is written once the process is replaced
+    fflush(NULL);
+    if (path)
+        execv(path, args);
+    else
+        execvp(args[0], args);
+    int err = errno;
+    if (err != ENOEXEC || path == NULL)
+        return err;
+    char **sh_args = script_args(path, args);
+    execv("/bin/sh", sh_args);
+    err = errno;
+    free(sh_args);
+    return err;
+}
+
+// Receive the request and its descriptors, the working directory last
+static int server_receive(int sock, struct spawn_request *req, int *fds,
+                          size_t *fds_nb)
+{
+    union
+    {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int) * (SPAWN_FDS + 1))];
+    } control;
+    struct iovec iov = { req, sizeof(*req) };
+    struct msghdr msg = { 0 };
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    if (recvmsg(sock, &msg, MSG_WAITALL) != sizeof(*req))
+        return -1;
+    *fds_nb = 0;
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET
+        && cmsg->cmsg_type == SCM_RIGHTS)
+    {
+        *fds_nb = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        memcpy(fds, CMSG_DATA(cmsg), *fds_nb * sizeof(int));
+    }
+    return 0;
+}
+
+/**
+ * \brief Split the strings of a request into the path, the arguments and
+ * the environment
+ * @return: 0 on success, -1 if data does not hold as many strings as req
+ * says
+ */
+static int request_split(struct spawn_request *req, char *data, char **path,
+                         char **args, char **envp)
+{
+    size_t count = 1 + req->argc + req->envc;
+    size_t pos = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        char *end = memchr(data + pos, '\0', req->size - pos);
+        if (end == NULL)
+            return -1;
+        if (i == 0)
+            *path = data + pos;
+        else if (i < 1 + req->argc)
+            *args++ = data + pos;
+        else
+            *envp++ = data + pos;
+        pos = end - data + 1;
+    }
+    *args = NULL;
+    *envp = NULL;
+    return pos == req->size ? 0 : -1;
+}
+
+// Launch the command of a request with the descriptors fds and wait for it
+static struct spawn_reply server_spawn(struct spawn_request *req, char *data,
+                                       int *fds, const posix_spawnattr_t *attr)
+{
+    struct spawn_reply reply = { EINVAL, 0 };
+    char *path = NULL;
+    char **args = xmalloc((req->argc + 1) * sizeof(char *));
+    char **envp = xmalloc((req->envc + 1) * sizeof(char *));
+    if (req->argc > 0 && request_split(req, data, &path, args, envp) == 0)
+    {
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        size_t received = 0;
+        for (int fd = 0; fd < SPAWN_FDS; fd++)
+        {
+            if (req->fds & (1u << fd))
+                posix_spawn_file_actions_adddup2(&actions, fds[received++],
+                                                 fd);
+            else
+                posix_spawn_file_actions_addclose(&actions, fd);
+        }
+        // The working directory comes after the descriptors
+        for (size_t i = 0; i <= received; i++)
+            posix_spawn_file_actions_addclose(&actions, fds[i]);
+        pid_t pid = 0;
+        reply.err = ENOENT;
+        if (fchdir(fds[received]) == 0)
+            reply.err = spawn_command(&pid, path, args, &actions, attr, envp);
+        posix_spawn_file_actions_destroy(&actions);
+        if (reply.err == 0 && waitpid(pid, &reply.wstatus, 0) == -1)
+            reply.err = errno;
+    }
+    free(args);
+    free(envp);
+    return reply;
+}
+
+/**
+ * \brief Serve the requests of the shell until it closes the socket
+ * @details The descriptors 0 to 9 of the server are kept on /dev/null, so
+ * that the ones received never take their place
+ */
+static void server_loop(int sock)
+{
+    signal(SIGINT, SIG_IGN);
+    signal(SIGQUIT, SIG_IGN);
+    sock = fcntl(sock, F_DUPFD_CLOEXEC, SPAWN_CLOSE_MAX);
+    for (int fd = 0; fd < SPAWN_CLOSE_MAX; fd++)
+        close(fd);
+    if (sock == -1 || open("/dev/null", O_RDWR) != 0)
+        _exit(1);
+    for (int fd = 1; fd < SPAWN_FDS; fd++)
+        dup2(0, fd);
+    // The commands get the signals the server ignores back
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t defaults;
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGINT);
+    sigaddset(&defaults, SIGQUIT);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+    while (1)
+    {
+        struct spawn_request req;
+        int fds[SPAWN_FDS + 1];
+        size_t fds_nb = 0;
+        if (server_receive(sock, &req, fds, &fds_nb) == -1)
+            _exit(0);
+        char *data = xmalloc(req.size + 1);
+        if (recv(sock, data, req.size, MSG_WAITALL) != (ssize_t)req.size)
+            _exit(0);
+        struct spawn_reply reply = { EINVAL, 0 };
+        size_t expected = 1;
+        for (int fd = 0; fd < SPAWN_FDS; fd++)
+            expected += (req.fds >> fd) & 1;
+        if (fds_nb == expected)
+            reply = server_spawn(&req, data, fds, &attr);
+        free(data);
+        for (size_t i = 0; i < fds_nb; i++)
+            close(fds[i]);
+        if (send(sock, &reply, sizeof(reply), MSG_NOSIGNAL) == -1)
+            _exit(0);
+    }
+}
+
+int spawn_server_start(void)
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+        return -1;
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(fds[0]);
+        server_loop(fds[1]);
+    }
+    close(fds[1]);
+    if (pid == -1)
+    {
+        close(fds[0]);
+        return -1;
+    }
+    server_pid = pid;
+    server_fd = fcntl(fds[0], F_DUPFD_CLOEXEC, FD_SAVE_MIN);
+    close(fds[0]);
+    server_owner = getpid();
+    return server_fd == -1 ? -1 : 0;
+}
+
+// Stop using the server, which exits once it reads the end of the socket
+static void server_lost(void)
+{
+    close(server_fd);
+    server_fd = -1;
+}
+
+void spawn_server_stop(void)
+{
+    if (server_pid == 0 || getpid() != server_owner)
+        return;
+    if (server_fd != -1)
+        server_lost();
+    waitpid(server_pid, NULL, 0);
+    server_pid = 0;
+}
+
+// Append the strings of array to data, return the number of strings
+static size_t data_add(struct vec *data, char *const *array)
+{
+    size_t count = 0;
+    for (; array[count] != NULL; count++)
+        vec_append(data, array[count], strlen(array[count]) + 1);
+    return count;
+}
+
+// Send the request with the descriptors fds, then its strings
+static int server_send(struct spawn_request *req, int *fds, size_t fds_nb,
+                       const char *data)
+{
+    union
+    {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int) * (SPAWN_FDS + 1))];
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct iovec iov = { req, sizeof(*req) };
+    struct msghdr msg = { 0 };
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(fds_nb * sizeof(int));
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(fds_nb * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, fds_nb * sizeof(int));
+    if (sendmsg(server_fd, &msg, MSG_NOSIGNAL) != sizeof(*req))
+        return -1;
+    for (size_t sent = 0; sent < req->size;)
+    {
+        ssize_t w = send(server_fd, data + sent, req->size - sent,
+                         MSG_NOSIGNAL);
+        if (w == -1 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return -1;
+        sent += w;
+    }
+    return 0;
+}
+
+int spawn_server_run(const char *path, char **args, int *err, int *wstatus)
+{
+    // The server would search its own PATH, not the one of the shell
+    if (path == NULL || server_fd == -1 || getpid() != server_owner)
+        return -1;
+    int fds[SPAWN_FDS + 1];
+    size_t fds_nb = 0;
+    struct spawn_request req = { 0, 0, 0, 0 };
+    for (int fd = 0; fd < SPAWN_FDS; fd++)
+    {
+        // As with exec, the descriptors closed on exec are not passed
+        int flags = fcntl(fd, F_GETFD);
+        if (flags == -1 || flags & FD_CLOEXEC)
+            continue;
+        req.fds |= 1u << fd;
+        fds[fds_nb++] = fd;
+    }
+    // A directory which can not be opened is left to the local launch
+    fds[fds_nb] = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fds[fds_nb] == -1)
+        return -1;
+    struct vec data = { NULL, 0, 0 };
+    char *const path_array[] = { (char *)path, NULL };
+    data_add(&data, path_array);
+    req.argc = data_add(&data, args);
+    req.envc = data_add(&data, environ);
+    req.size = data.size;
+    int sent = server_send(&req, fds, fds_nb + 1, data.data);
+    close(fds[fds_nb]);
+    vec_destroy(&data);
+    if (sent == -1)
+    {
+        server_lost();
+        return -1;
+    }
+    struct spawn_reply reply;
+    ssize_t got = 0;
+    // The shell may be interrupted while the command runs
+    do
+        got = recv(server_fd, &reply, sizeof(reply), MSG_WAITALL);
+    while (got == -1 && errno == EINTR);
+    if (got != sizeof(reply))
+    {
+        // The command was sent, it must not be launched again
+        warnx("spawn server: lost while running '%s'", args[0]);
+        server_lost();
+        reply.err = EPIPE;
+    }
+    *err = reply.err;
+    *wstatus = reply.wstatus;
+    return 0;
+}
@@ -0,0 +1,52 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include <spawn.h>
+#include <sys/types.h>
+
+/**
+ * \brief Start the command args, as execvp would
+ * @details Files which are not executables, such as scripts without a #!
+ * line, are run with sh
+ * @param path: the executable of the command, NULL to search PATH for
+ * args[0]
+ * @param actions: the file actions applied in the child, NULL for none
+ * @return: 0 on success, the error of posix_spawn otherwise
+ */
+int spawn_command(pid_t *pid, const char *path, char **args,
+                  const posix_spawn_file_actions_t *actions,
+                  const posix_spawnattr_t *attr, char **envp);
+
+/**
+ * \brief Execute the command args in place of the shell, once nothing is
+ * left to run after it
+ * @return: only if it could not be executed, the error of exec
+ */
+int exec_command(const char *path, char **args);
+
+/**
+ * \brief Fork the spawn server, which launches the commands of the shell
+ * @details It is forked while the shell is still small: the commands it
+ * starts do not pay for the memory the shell uses later on
+ * @return: 0 on success, -1 on error
+ */
+int spawn_server_start(void);
+
+/**
+ * \brief Close the socket of the server and wait for it to exit
+ */
+void spawn_server_stop(void);
+
+/**
+ * \brief Run a command through the spawn server, with the descriptors 0 to
+ * 9, the environment and the working directory of the shell
+ * @param path: the executable of the command, resolved by the shell: a
+ * command without one is not sent
+ * @param err: set to the error of posix_spawn, 0 if it was launched
+ * @param wstatus: set to the status the command exited with
+ * @return: 0 if the server ran it, -1 if it can not be used, for this
+ * command, in this process or any more
+ */
+int spawn_server_run(const char *path, char **args, int *err, int *wstatus);
+
+#endif /* ! SPAWN_H */
@@ -0,0 +1,278 @@
+#include <stdint.h>
+#include <string.h>
+#include <utils/alloc.h>
+#include <utils/vec.h>
+
+#include "ast.h"
+
+/**
+ * \brief Classes of the characters for field splitting
+ * @details IFS_END is the class of '\0', so that scanning a field only
+ * needs one table lookup per character
+ */
+enum ifs_class
+{
+    IFS_NONE = 0,
+    IFS_SPACE,
+    IFS_DELIM,
+    IFS_END
+};
+
+/**
+ * \brief The class tables of both split modes, rebuilt when IFS changes
+ */
+static unsigned char classes[2][256];
+static size_t classes_generation = SIZE_MAX;
+
+static void classes_build(void)
+{
+    struct list *ifs = find_var("IFS");
+    const char *value = ifs ? ifs->value : " \t\n";
+    memset(classes, IFS_NONE, sizeof(classes));
+    for (size_t i = 0; value[i] != '\0'; i++)
+    {
+        unsigned char c = value[i];
+        int space = c == ' ' || c == '\t' || c == '\n';
+        classes[SPLIT_FIELDS][c] = space ? IFS_SPACE : IFS_DELIM;
+        if (space)
+            classes[SPLIT_WORDS][c] = IFS_SPACE;
+    }
+    // Spaces separate the words of command lines, whatever IFS is
+    classes[SPLIT_WORDS][' '] = IFS_SPACE;
+    classes[SPLIT_FIELDS]['\0'] = IFS_END;
+    classes[SPLIT_WORDS]['\0'] = IFS_END;
+    classes_generation = global->ifs_generation;
+}
+
+// Allocate the array of capacity fields in arena, or with malloc if it is
+// NULL
+static char **fields_alloc(struct arena *arena, size_t capacity)
+{
+    if (arena)
+        return arena_alloc(arena, capacity * sizeof(char *));
+    return xmalloc(capacity * sizeof(char *));
+}
+
+static void fields_add(char ***fields, size_t *count, size_t *capacity,
+                       char *field, struct arena *arena)
+{
+    // Keep room for the NULL terminator
+    if (*count + 1 >= *capacity)
+    {
+        *capacity *= 2;
+        if (arena)
+        {
+            char **grown = fields_alloc(arena, *capacity);
+            memcpy(grown, *fields, *count * sizeof(char *));
+            *fields = grown;
+        }
+        else
+            *fields = xrealloc(*fields, *capacity * sizeof(char *));
+    }
+    (*fields)[(*count)++] = field;
+}
+
+char **field_split(char *str, enum split_mode mode, size_t *count)
+{
+    if (classes_generation != global->ifs_generation)
+        classes_build();
+    const unsigned char *class = classes[mode];
+    size_t capacity = 16;
+    char **fields = xmalloc(capacity * sizeof(char *));
+    *count = 0;
+    unsigned char *s = (unsigned char *)str;
+    while (class[*s] == IFS_SPACE)
+        s++;
+    while (*s != '\0')
+    {
+        unsigned char *start = s;
+        while (class[*s] == IFS_NONE)
+            s++;
+        fields_add(&fields, count, &capacity, (char *)start, NULL);
+        if (*s == '\0')
+            break;
+        // A delimiter is blanks around at most one non blank IFS character
+        int delim = class[*s] == IFS_DELIM;
+        *s++ = '\0';
+        while (class[*s] == IFS_SPACE)
+            s++;
+        if (!delim && class[*s] == IFS_DELIM)
+        {
+            s++;
+            while (class[*s] == IFS_SPACE)
+                s++;
+        }
+    }
+    fields[*count] = NULL;
+    return fields;
+}
+
+/**
+ * \brief Copy the words of the array assignment starting at s[i] to s[*j]
+ * with their quotes, up to the closing parenthesis
+ * @return: the index following the copied text
+ */
+static size_t copy_compound(unsigned char *s, size_t i, size_t *j)
+{
+    char quote = 0;
+    int depth = 0;
+    do
+    {
+        if (s[i] == '\\' && quote != '\'' && s[i + 1] != '\0')
+            s[(*j)++] = s[i++];
+        else if ((s[i] == '\'' || s[i] == '"') && (!quote || quote == s[i]))
+            quote = quote ? 0 : s[i];
+        else if (!quote && (s[i] == '(' || s[i] == ')'))
+            depth += s[i] == '(' ? 1 : -1;
+        s[(*j)++] = s[i++];
+    } while (s[i] != '\0' && depth > 0);
+    return i;
+}
+
+char **word_split(char *str, size_t *count, struct arena *arena)
+{
+    if (classes_generation != global->ifs_generation)
+        classes_build();
+    const unsigned char *class = classes[SPLIT_WORDS];
+    size_t capacity = 16;
+    char **words = fields_alloc(arena, capacity);
+    *count = 0;
+    // The words are unquoted while they are split: the write index never
+    // passes the read one
+    unsigned char *s = (unsigned char *)str;
+    size_t i = 0;
+    size_t j = 0;
+    while (1)
+    {
+        while (class[s[i]] == IFS_SPACE)
+            i++;
+        if (s[i] == '\0')
+            break;
+        size_t start = j;
+        char quote = 0;
+        while (s[i] != '\0' && (quote || class[s[i]] != IFS_SPACE))
+        {
+            if (s[i] == '\\' && quote != '\'' && s[i + 1] != '\0')
+            {
+                // A backslash only keeps a single quote literal between
+                // double quotes, as remove_quotes does
+                if (quote == '"' && s[i + 1] == '\'')
+                    s[j++] = s[i];
+                s[j++] = s[i + 1];
+                i += 2;
+            }
+            else if (!quote && s[i] == '(' && j > start && s[j - 1] == '=')
+                i = copy_compound(s, i, &j);
+            else if ((s[i] == '\'' || s[i] == '"') && (!quote || quote == s[i]))
+            {
+                quote = quote ? 0 : s[i];
+                i++;
+            }
+            else
+                s[j++] = s[i++];
+        }
+        if (s[i] != '\0')
+            i++;
+        s[j++] = '\0';
+        fields_add(&words, count, &capacity, str + start, arena);
+    }
+    words[*count] = NULL;
+    return words;
+}
+
+void word_quote(struct vec *out, const char *str, size_t len)
+{
+    size_t i = 0;
+    while (i < len && !strchr("\\\'\" \t\n", str[i]))
+        i++;
+    if (i == len)
+    {
+        vec_append(out, str, len);
+        return;
+    }
+    // Single quotes keep everything but themselves literal
+    vec_push(out, '\'');
+    for (i = 0; i < len; i++)
+    {
+        if (str[i] == '\'')
+            vec_append(out, "'\\''", 4);
+        else
+            vec_push(out, str[i]);
+    }
+    vec_push(out, '\'');
+}
+
+// Return the class of c in a value, spaces also separate the elements that
+// were joined into it
+static int value_class(const unsigned char *class, unsigned char c, int joined)
+{
+    return joined && c == ' ' ? IFS_SPACE : class[c];
+}
+
+size_t fields_append(struct vec *out, const char *value, size_t len,
+                     const char *after, int joined)
+{
+    if (classes_generation != global->ifs_generation)
+        classes_build();
+    const unsigned char *class = classes[SPLIT_FIELDS];
+    const unsigned char *s = (const unsigned char *)value;
+    size_t i = 0;
+    while (i < len && value_class(class, s[i], joined) == IFS_SPACE)
+        i++;
+    // Leading blanks separate the value from the text before it
+    if (i > 0 && out->size > 0 && out->data[out->size - 1] != ' ')
+        vec_push(out, ' ');
+    size_t count = 0;
+    while (i < len)
+    {
+        size_t start = i;
+        while (i < len && value_class(class, s[i], joined) == IFS_NONE)
+            i++;
+        // A delimiter with nothing before it ends an empty field
+        if (i == start)
+            vec_append(out, "''", 2);
+        else
+            word_quote(out, value + start, i - start);
+        count++;
+        if (i == len)
+            break;
+        int delim = value_class(class, s[i++], joined) == IFS_DELIM;
+        while (i < len && value_class(class, s[i], joined) == IFS_SPACE)
+            i++;
+        if (!delim && i < len && value_class(class, s[i], joined) == IFS_DELIM)
+        {
+            i++;
+            while (i < len && value_class(class, s[i], joined) == IFS_SPACE)
+                i++;
+        }
+        // A trailing delimiter only separates the value from the text after
+        // it
+        if (i < len || (after[0] != ' ' && after[0] != '\0'))
+            vec_push(out, ' ');
+    }
+    return count;
+}
+
+int word_is_split(const char *str, size_t pos)
+{
+    int name_seen = 0;
+    int declaration = 0;
+    size_t i = 0;
+    while (str[i] != '\0')
+    {
+        while (str[i] == ' ' || str[i] == '\t' || str[i] == '\n')
+            i++;
+        size_t len = word_len(str + i);
+        int assign = (!name_seen || declaration) && is_assign_word(str + i);
+        if (pos < i + len)
+            return !assign;
+        if (!assign && !name_seen)
+        {
+            name_seen = 1;
+            declaration = (len == 6 && strncmp(str + i, "export", 6) == 0)
+                || (len == 7 && strncmp(str + i, "declare", 7) == 0);
+        }
+        i += len;
+    }
+    return 1;
+}
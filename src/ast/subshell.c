@@ -49,6 +49,7 @@ int subshell(char *args)
     if (pid == 0)
     {
         int return_value = 0;
+        global->exec_tail = ast_tail_cmd(parser->ast);
         ast_eval(parser->ast, &return_value);
         parser_free(parser);
         exit(return_value);
@@ -58,15 +59,43 @@ int subshell(char *args)
     int cpid = waitpid(pid, &wstatus, 0);
     if (cpid == -1)
         errx(1, "Failed waiting for child\n%s", strerror(errno));
-    struct list *ret = zalloc(sizeof(struct list));
-    ret->name = strdup("?");
-    ret->value = my_itoa(WEXITSTATUS(wstatus));
-    ret->next = NULL;
-    add_var(ret);
+    set_status(WEXITSTATUS(wstatus));
     return WEXITSTATUS(wstatus);
 }
 
-char *cmd_sub(char *str, size_t quote_pos, size_t quote_end, int is_dollar)
+/**
+ * \brief Read the output of a command substitution until end of file
+ * @details The output is read straight after the end of out, which grows
+ * geometrically. A shell word can not hold a NUL byte: those are dropped,
+ * as other shells do, and the rest of the output is kept.
+ */
+static void read_output(int fd, struct vec *out)
+{
+    while (1)
+    {
+        vec_reserve(out, BUFFER_SIZE);
+        char *data = out->data + out->size;
+        ssize_t r = read(fd, data, out->capacity - out->size);
+        if (r == -1 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            break;
+        char *nul = memchr(data, '\0', r);
+        if (nul == NULL)
+        {
+            out->size += r;
+            continue;
+        }
+        for (ssize_t i = 0; i < r; i++)
+        {
+            if (data[i] != '\0')
+                out->data[out->size++] = data[i];
+        }
+    }
+}
+
+char *cmd_sub(char *str, size_t quote_pos, size_t quote_end, int is_dollar,
+              int split, size_t *next)
 {
     char *cmd = strndup(str + quote_pos + 1, quote_end - quote_pos - 1);
 
@@ -81,6 +110,9 @@ char *cmd_sub(char *str, size_t quote_pos, size_t quote_end, int is_dollar)
 
     if (state != PARSER_OK)
     {
+        parser_free(parser);
+        close(fds[0]);
+        close(fds[1]);
         free(cmd);
         return NULL;
     }
@@ -90,71 +122,94 @@ char *cmd_sub(char *str, size_t quote_pos, size_t quote_end, int is_dollar)
         if (dup2(fds[1], STDOUT_FILENO) == -1)
             errx(1, "dup2 failed");
         close(fds[0]);
+        if (fds[1] != STDOUT_FILENO)
+            close(fds[1]);
         int return_value = 0;
+        global->exec_tail = ast_tail_cmd(parser->ast);
         ast_eval(parser->ast, &return_value);
         parser_free(parser);
         exit(return_value);
     }
     parser_free(parser);
 
-    char *res = zalloc(sizeof(char) * BUFFER_SIZE);
-    int size = 0;
-    int capacity = BUFFER_SIZE;
     close(fds[1]);
-    char buf[BUFFER_SIZE];
-    ssize_t r;
-    while ((r = read(fds[0], &buf, BUFFER_SIZE)) != 0)
-    {
-        if (r == EOF)
-            break;
-        size += r;
-        if (size >= capacity)
-        {
-            capacity *= 2;
-            res = realloc(res, capacity);
-        }
-        strncat(res, buf, r);
-    }
+    struct vec out = { NULL, 0, 0 };
+    read_output(fds[0], &out);
     close(fds[0]);
 
     int wstatus;
     int cpid = waitpid(pid, &wstatus, 0);
     if (cpid == -1)
         errx(1, "Failed waiting for child\n%s", strerror(errno));
-    struct list *ret = zalloc(sizeof(struct list));
-    ret->name = strdup("?");
-    ret->value = my_itoa(WEXITSTATUS(wstatus));
-    ret->next = NULL;
-    add_var(ret);
-
-    while (size > 0 && res[size - 1] == '\n')
-        res[--size] = 0;
-
-    int spaces = 0;
-    int i = quote_pos - is_dollar - 1;
-    while (i >= 0 && strlen(cmd) == 0 && str[i--] == ' ')
-        spaces++;
-
-    char *before = strndup(str, quote_pos - is_dollar - spaces);
-    char *after = strdup(str + quote_end + 1);
-    char *new =
-        zalloc(sizeof(char) * (strlen(before) + strlen(after) + size + 1));
-    sprintf(new, "%s%s%s", before, res, after);
-
-    free(before);
-    free(after);
-    free(res);
+    set_status(WEXITSTATUS(wstatus));
+
+    while (out.size > 0 && out.data[out.size - 1] == '\n')
+        out.size--;
+
+    size_t before = quote_pos - is_dollar;
+    if (cmd[0] == '\0')
+    {
+        while (before > 0 && str[before - 1] == ' ')
+            before--;
+    }
+    const char *after = str + quote_end + 1;
+    struct vec res = { NULL, 0, 0 };
+    vec_reserve(&res, before + out.size + strlen(after) + 1);
+    vec_append(&res, str, before);
+    if (!split)
+        vec_append(&res, out.data, out.size);
+    else if (fields_append(&res, out.data, out.size, after, 0) == 0
+             && res.size > 0 && res.data[res.size - 1] == ' '
+             && (after[0] == ' ' || after[0] == '\0'))
+        res.size--; // No field does not leave two spaces in a row
+    *next = res.size;
+    vec_append(&res, after, strlen(after));
+
+    free(out.data);
     free(cmd);
 
-    return new;
+    return vec_release(&res);
+}
+
+/**
+ * \brief How the next substitute_cmds splits the output of the
+ * substitutions, set by substitute_fields
+ */
+static enum expand_split split_next = EXPAND_KEEP;
+
+// Return if str[pos] is between quotes
+static int is_quoted(const char *str, size_t pos)
+{
+    char quote = 0;
+    for (size_t i = 0; i < pos; i++)
+    {
+        if (str[i] == '\\' && quote != '\'' && i + 1 < pos)
+            i++;
+        else if ((str[i] == '\'' || str[i] == '"')
+                 && (!quote || quote == str[i]))
+            quote = quote ? 0 : str[i];
+    }
+    return quote != 0;
+}
+
+// Return if the output of the substitution starting at str[pos] is split
+static int output_splits(enum expand_split splits, const char *str, size_t pos)
+{
+    if (splits == EXPAND_KEEP || is_quoted(str, pos))
+        return 0;
+    return splits == EXPAND_SPLIT || word_is_split(str, pos);
 }
 
 char *substitute_cmds(char *s)
 {
-    if (strlen(s) == 0)
+    // Let the failure of a previous expansion go through
+    enum expand_split splits = split_next;
+    split_next = EXPAND_KEEP;
+    if (s == NULL)
+        return NULL;
+    if (strpbrk(s, "`(") == NULL)
         return s;
-    char *str = strdup(s);
-    free(s);
+    char *str = s;
     size_t i = 0;
     int context = NONE;
     while (str[i] != 0)
@@ -184,15 +239,22 @@ char *substitute_cmds(char *s)
                 return NULL;
             }
 
-            char *tmp = cmd_sub(str, i, next - str, 0);
+            // The output is not scanned for substitutions
+            int split = output_splits(splits, str, i);
+            char *tmp = cmd_sub(str, i, next - str, 0, split, &i);
             if (tmp == NULL)
+            {
+                free(str);
                 return NULL;
+            }
             free(str);
             str = tmp;
-            i = 0;
+            continue;
         }
         i++;
     }
+    if (str[0] == '\0')
+        return str;
     i = strlen(str) - 1;
     context = NONE;
     int closing = 0;
@@ -238,57 +300,196 @@ char *substitute_cmds(char *s)
                     return NULL;
                 }
             }
-            char *tmp = cmd_sub(str, i, next - str, 1);
+            size_t end = 0;
+            int split = output_splits(splits, str, i - 1);
+            char *tmp = cmd_sub(str, i, next - str, 1, split, &end);
             if (tmp == NULL)
+            {
+                free(str);
                 return NULL;
+            }
             free(str);
             str = tmp;
             closing = 0;
             opening = 0;
-            i = strlen(str);
+            i = end + strlen(str + end);
+            // Nothing may be left before the substitution
+            if (i == 0)
+                break;
         }
         i--;
     }
     return str;
 }
 
-char *arithmetic_exp(char *cmd)
+char *substitute_fields(char *s, enum expand_split split)
 {
-    size_t equ_index = 0;
-    while (cmd[equ_index] != '\0' && (cmd[equ_index] != '='))
-        ++equ_index;
-    int i = equ_index + 1;
+    split_next = split;
+    return substitute_cmds(s);
+}
 
-    if (equ_index == strlen(cmd))
+size_t arith_end(const char *str, size_t start)
+{
+    int depth = 0;
+    for (size_t i = start; str[i] != '\0'; i++)
     {
-        int doll_idx = 0;
-        while (cmd[doll_idx] != '\0' && cmd[doll_idx] != '$')
-            doll_idx++;
-        i = doll_idx;
-        equ_index = doll_idx;
+        if (str[i] == '(')
+            depth++;
+        else if (str[i] == ')' && depth > 0)
+            depth--;
+        else if (str[i] == ')')
+            return str[i + 1] == ')' ? i : 0;
     }
+    return 0;
+}
 
-    if (cmd[equ_index] == '\0' || cmd[i] == '\0' || cmd[i++] != '$')
-        return cmd;
-    if (cmd[i] == '\0' || cmd[i] != '(')
-        return cmd;
-    if (cmd[i + 1] == '\0' || cmd[i + 1] != '(')
-        return cmd;
-    int res = eval_exp(cmd + i);
-    if (res == INT_MIN)
+// Return the index of the next "$((" of str outside simple quotes
+static size_t arith_next(char *str, size_t i, size_t *end)
+{
+    int context = NONE;
+    for (; str[i] != '\0'; i++)
     {
-        fprintf(stderr, "42sh: Invalid arithmetic expression\n");
-        free(cmd);
+        if (str[i] == '\'' && context != DOUBLE)
+            context = context == NONE ? SIMPLE : NONE;
+        else if (str[i] == '\"' && context != SIMPLE)
+            context = context == NONE ? DOUBLE : NONE;
+        if (context != SIMPLE && strncmp(str + i, "$((", 3) == 0
+            && not_as_escape(str, (int)i - 1))
+        {
+            *end = arith_end(str, i + 3);
+            return i;
+        }
+    }
+    return i;
+}
+
+static struct arith_prog *arith_lookup(char *expr, size_t len,
+                                       struct arith_cache **cache)
+{
+    if (!cache)
+        return arith_compile(expr, len);
+    struct arith_cache *prev = NULL;
+    size_t count = 0;
+    for (struct arith_cache *cur = *cache; cur; cur = cur->next)
+    {
+        if (strlen(cur->expr) == len && strncmp(cur->expr, expr, len) == 0)
+        {
+            // Move the hit in front
+            if (prev)
+            {
+                prev->next = cur->next;
+                cur->next = *cache;
+                *cache = cur;
+            }
+            return cur->prog;
+        }
+        // Drop the least recently used entry of a full cache
+        if (++count == ARITH_CACHE_SIZE && cur->next)
+        {
+            arith_cache_free(cur->next);
+            cur->next = NULL;
+        }
+        prev = cur;
+    }
+    struct arith_prog *prog = arith_compile(expr, len);
+    if (!prog)
         return NULL;
+    struct arith_cache *new = zalloc(sizeof(struct arith_cache));
+    new->expr = strndup(expr, len);
+    new->prog = prog;
+    new->next = *cache;
+    *cache = new;
+    return prog;
+}
+
+void arith_cache_free(struct arith_cache *cache)
+{
+    while (cache)
+    {
+        struct arith_cache *next = cache->next;
+        free(cache->expr);
+        arith_free(cache->prog);
+        free(cache);
+        cache = next;
     }
-    char *to_sprintf = zalloc(sizeof(char) * (equ_index + 21));
-    char *before_eq = NULL;
-    if (cmd[equ_index] == '=')
-        before_eq = strndup(cmd, equ_index + 1);
-    else
-        before_eq = strndup(cmd, equ_index);
-    sprintf(to_sprintf, "%s%d", before_eq, res);
-    free(cmd);
-    free(before_eq);
-    return to_sprintf;
+}
+
+void arithmetic_compile(char *str, struct arith_cache **cache)
+{
+    size_t end = 0;
+    size_t i = arith_next(str, 0, &end);
+    while (str[i] != '\0' && end != 0)
+    {
+        char *expr = str + i + 3;
+        size_t len = end - i - 3;
+        // Only the expressions left untouched by the other expansions
+        if (!memchr(expr, '$', len) && !memchr(expr, '`', len))
+            arith_lookup(expr, len, cache);
+        i = arith_next(str, end + 2, &end);
+    }
+}
+
+int arithmetic_eval(char *expr, struct arith_cache **cache, int64_t *res)
+{
+    char *str = NULL;
+    if (strchr(expr, '$') || strchr(expr, '`'))
+    {
+        str = expand_vars(strdup(expr), NULL, NULL);
+        str = substitute_cmds(str);
+        if (str == NULL)
+            return -1;
+        expr = str;
+    }
+    struct arith_prog *prog = arith_lookup(expr, strlen(expr), cache);
+    int status = -1;
+    double value = 0;
+    if (prog && prog->is_float)
+    {
+        status = arith_run_real(prog, &value);
+        *res = value != 0;
+    }
+    else if (prog)
+        status = arith_run(prog, res);
+    if (status == -1)
+        fprintf(stderr, "42sh: Invalid arithmetic expression\n");
+    if (!cache)
+        arith_free(prog);
+    free(str);
+    return status;
+}
+
+int arithmetic_cmd(char *expr, struct arith_cache **cache)
+{
+    int64_t res = 0;
+    if (arithmetic_eval(expr, cache, &res) == -1)
+        return 1;
+    return res == 0;
+}
+
+int arith_append(struct vec *out, const char *expr, size_t len,
+                 struct arith_cache **cache)
+{
+    char *str = strndup(expr, len);
+    if (memchr(expr, '$', len) || memchr(expr, '`', len))
+        str = substitute_cmds(expand_vars(str, NULL, NULL));
+    struct arith_prog *prog =
+        str ? arith_lookup(str, strlen(str), cache) : NULL;
+    char number[ARITH_BUF_SIZE];
+    int status = prog ? arith_eval_string(prog, number) : -1;
+    if (!cache)
+        arith_free(prog);
+    if (status == -1)
+    {
+        // The expansions of expr report their own errors. An expansion error
+        // stops a non interactive shell, as in dash.
+        if (str != NULL)
+            fprintf(stderr, "42sh: Invalid arithmetic expression\n");
+        free(str);
+        global->current_mode->mode = EXIT;
+        set_status(2);
+        return -1;
+    }
+    free(str);
+    vec_append(out, number, strlen(number));
+    return 0;
 }
@@ -1,10 +1,17 @@
 #include <ctype.h>
+#include <errno.h>
+#include <evalexpr/eval_exp.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <utils/alloc.h>
+#include <utils/intern.h>
+#include <utils/pattern.h>
+#include <utils/slab.h>
 #include <utils/utils.h>
+#include <utils/vec.h>
 
 #include "ast.h"
 
@@ -12,156 +19,569 @@
 #define SIMPLE 1
 #define DOUBLE 2
 
-struct global *global;
+/**
+ * \brief How the next expand_vars splits its values and where it looks up
+ * its arithmetic expressions, set by expand_fields
+ */
+static enum expand_split split_next = EXPAND_KEEP;
+static struct arith_cache **arith_next = NULL;
 
-char *my_strstr(char *str, char *var)
+/**
+ * \brief Append the value of a parameter to out
+ * @param after: the text following the parameter
+ * @param split: 1 to split the value into fields, 2 if it also joins
+ * elements with spaces
+ */
+static void append_value(struct vec *out, const char *value, size_t len,
+                         const char *after, int split)
 {
+    if (split)
+        len = fields_append(out, value, len, after, split == 2);
+    else
+        vec_append(out, value, len);
+    // An empty value does not leave two spaces in a row
+    if (len == 0 && out->size > 0 && out->data[out->size - 1] == ' '
+        && (after[0] == ' ' || after[0] == '\0'))
+        out->size--;
+}
+
+// Return the split mode of the value of a parameter, see append_value
+static int split_mode(int split, const char *name, size_t len, int all)
+{
+    if (!split)
+        return 0;
+    return all || (len == 1 && (name[0] == '@' || name[0] == '*')) ? 2 : 1;
+}
+
+/**
+ * \brief Append the positional parameters to out, each split into fields of
+ * its own, as an unquoted $@ expands to
+ * @param after: the text following the parameter
+ */
+static void append_params(struct vec *out, const char *after)
+{
+    const char *count = params_value("#", 1, 0);
+    size_t n = count ? strtoul(count, NULL, 10) : 0;
+    size_t fields = 0;
+    for (size_t k = 1; k <= n; k++)
+    {
+        char name[32];
+        int len = sprintf(name, "%zu", k);
+        const char *value = params_value(name, len, 0);
+        size_t start = out->size;
+        if (fields > 0)
+            vec_push(out, ' ');
+        size_t added = fields_append(out, value, strlen(value),
+                                     k < n ? " " : after, 0);
+        // A parameter without fields leaves no separator
+        if (added == 0 && fields > 0)
+            out->size = start;
+        fields += added;
+    }
+    if (fields == 0)
+        append_value(out, "", 0, after, 0);
+}
+
+// Return the value of the len first characters of name, NULL if it is unset
+static char *param_value(const char *name, size_t len, int quoted, char *var,
+                         char *var_rep)
+{
+    if (var != NULL && strlen(var + 1) == len
+        && strncmp(name, var + 1, len) == 0)
+        return var_rep;
+    char *value = params_value(name, len, quoted);
+    if (value)
+        return value;
+    const char *key = intern_find(name, len);
+    for (struct list *cur = global->vars; key && cur; cur = cur->next)
+    {
+        if (cur->name == key)
+            return cur->array ? array_first(cur->array) : cur->value;
+    }
+    return NULL;
+}
+
+/**
+ * \brief Append the value of the parameter of len characters following the
+ * '$' at *i to out
+ * @param i: set to the index following the parameter
+ */
+static void sub_replace(struct vec *out, const char *str, size_t *i,
+                        size_t len, int quoted, int split, char *var,
+                        char *var_rep)
+{
+    char *value = param_value(str + *i + 1, len, quoted, var, var_rep);
+    if (!value)
+        value = "";
+    split = split_mode(split, str + *i + 1, len, 0);
+    *i += len + 1;
+    if (split == 2)
+    {
+        append_params(out, str + *i);
+        return;
+    }
+    append_value(out, value, strlen(value), str + *i, split);
+}
+
+// Return the length of the parameter name at the start of str
+static size_t param_name_len(const char *str)
+{
+    size_t i = 0;
+    if (isdigit(str[0]))
+    {
+        while (isdigit(str[i]))
+            i++;
+        return i;
+    }
+    if (str[0] != '\0' && strchr("@*#?$!-", str[0]))
+        return 1;
+    while (isalnum(str[i]) || str[i] == '_')
+        i++;
+    return i;
+}
+
+// Return the index of the '}' closing the ${ at start, 0 if there is none
+static size_t param_end(const char *str, size_t start)
+{
+    int depth = 0;
     int context = NONE;
-    for (int i = 0; str[i] != 0; i++)
+    for (size_t i = start + 2; str[i] != '\0'; i++)
     {
-        if (str[i] == '\"')
-        {
-            if (context == NONE)
-                context = DOUBLE;
-            else if (context == DOUBLE)
-                context = NONE;
-        }
-        if (str[i] == '\'')
-        {
-            if (context == NONE)
-                context = SIMPLE;
-            else if (context == SIMPLE)
-                context = NONE;
+        if (str[i] == '\\' && context != SIMPLE && str[i + 1] != '\0')
+            i++;
+        else if (str[i] == '\'' && context != DOUBLE)
+            context = context == NONE ? SIMPLE : NONE;
+        else if (str[i] == '\"' && context != SIMPLE)
+            context = context == NONE ? DOUBLE : NONE;
+        else if (context == SIMPLE)
             continue;
+        else if (str[i] == '{' && str[i - 1] == '$')
+            depth++;
+        else if (str[i] == '}' && depth-- == 0)
+            return i;
+    }
+    return 0;
+}
+
+/**
+ * \brief Fail the expansion of a parameter, which stops a non interactive
+ * shell
+ */
+static int param_error(const char *name, size_t len, const char *msg)
+{
+    fprintf(stderr, "42sh: %.*s: %s\n", (int)len, name, msg);
+    global->current_mode->mode = EXIT;
+    set_status(2);
+    return -1;
+}
+
+// Return if str has quotes, escapes or substitutions
+static int is_plain_word(const char *str)
+{
+    return strpbrk(str, "\\\'\"$`") == NULL;
+}
+
+// Return if the expansion of str still has quotes or command substitutions
+static int has_syntax(const char *str)
+{
+    return strpbrk(str, "\\\'\"`") != NULL || strstr(str, "$(") != NULL;
+}
+
+/**
+ * \brief Remove from value the shortest or longest prefix or suffix
+ * matching pattern
+ * @details The result is a slice of value, patterns without glob characters
+ * are compared in place
+ * @return: 0 on success, -1 on expansion error
+ */
+static int param_trim(const char *value, const char *pattern, int suffix,
+                      int longest, char *var, char *var_rep, size_t *start,
+                      size_t *len)
+{
+    size_t size = strlen(value);
+    *start = 0;
+    *len = size;
+    char *word = NULL;
+    if (!is_plain_word(pattern) || pattern_has_glob(pattern))
+    {
+        word = expand_vars(strdup(pattern), var, var_rep);
+        if (!word)
+            return -1;
+        word = pattern_unquote(word);
+        pattern = word;
+    }
+    if (!pattern_has_glob(pattern))
+    {
+        // A literal only matches one way, so shortest and longest are equal
+        size_t lit_len = 0;
+        for (size_t i = 0; pattern[i] != '\0'; i++, lit_len++)
+        {
+            if (pattern[i] == '\\' && pattern[i + 1] != '\0')
+                i++;
         }
-        if (context == SIMPLE)
-            continue;
-        if (str[i] == var[0])
+        if (word)
         {
-            int j = 0;
-            for (; var[j] != 0 && str[i + j] != 0; j++)
-            {
-                if (var[j] != str[i + j])
-                    break;
-            }
-            if (var[j] == 0)
+            size_t j = 0;
+            for (size_t i = 0; word[i] != '\0'; i++)
             {
-                int n = i + j;
-                if (str[n] == 0 || !isalnum(str[n]) || str[n - 1] == '}')
-                    return str + i;
+                if (word[i] == '\\' && word[i + 1] != '\0')
+                    i++;
+                word[j++] = word[i];
             }
+            word[j] = '\0';
+            pattern = word;
         }
+        const char *at = suffix ? value + size - lit_len : value;
+        if (lit_len <= size && strncmp(at, pattern, lit_len) == 0)
+        {
+            *start = suffix ? 0 : lit_len;
+            *len = size - lit_len;
+        }
+        free(word);
+        return 0;
     }
-    return NULL;
+
+    struct pattern *compiled = pattern_compile(pattern);
+    char *buf = suffix ? NULL : strdup(value);
+    for (size_t n = 0; n <= size; n++)
+    {
+        // n is the length of the removed part
+        size_t k = longest ? size - n : n;
+        int match = 0;
+        if (suffix)
+            match = pattern_match(compiled, value + size - k);
+        else
+        {
+            char save = buf[k];
+            buf[k] = '\0';
+            match = pattern_match(compiled, buf);
+            buf[k] = save;
+        }
+        if (match)
+        {
+            *start = suffix ? 0 : k;
+            *len = size - k;
+            break;
+        }
+    }
+    free(buf);
+    pattern_free(compiled);
+    free(word);
+    return 0;
 }
 
-char *replace_vars(char *str, char *var, char *replace)
+// Return the index of the ']' closing the '[' at the start of str, 0 if
+// there is none before the end of the parameter at end
+static size_t subscript_end(const char *str, const char *end)
 {
-    if (var == NULL)
-        return strdup(str);
-    char *substring = NULL;
-    size_t to_copy = 0;
-    char *cmd = strdup(str);
-    while ((substring = my_strstr(cmd, var)) != NULL)
-    {
-        to_copy = substring - cmd; // determine length before substring
-        char *before = strndup(cmd, to_copy);
-        char *after = strdup(substring + strlen(var));
-        char *tmp =
-            zalloc(sizeof(char)
-                   * (strlen(before) + strlen(replace) + strlen(after) + 1));
-        sprintf(tmp, "%s%s%s", before, replace, after);
-        free(cmd);
-        free(before);
-        free(after);
-        cmd = tmp;
-    }
-    return cmd;
-}
-
-int is_var_sep(char c)
-{
-    if (is_separator(c))
-        return 1;
-    return c == '$' || c == '=' || c == '\'' || c == '\"' || c == ')'
-        || c == '`' || c == '-' || c == '+' || c == '%' || c == '*' || c == '/'
-        || c == '&' || c == '|' || c == '^';
+    int depth = 0;
+    for (size_t i = 0; str + i < end; i++)
+    {
+        if (str[i] == '[')
+            depth++;
+        else if (str[i] == ']' && --depth == 0)
+            return i;
+    }
+    return 0;
 }
 
-static char *replace_at_by(char *str, int status, int len, char *replace)
+/**
+ * \brief Get the element of the array name selected by subscript, or all of
+ * them for @ and *, joined like the positional parameters
+ * @param value: set to the value, NULL if unset, owned by *owned if it was
+ * allocated
+ * @param count: set to the number of elements selected
+ * Return 0 on success, -1 on a bad subscript
+ */
+static int element_value(const char *name, size_t len, const char *subscript,
+                         int keys, int quoted, char **value, char **owned,
+                         size_t *count)
 {
-    char *new = zalloc(sizeof(char) * (strlen(str) + strlen(replace) + 100));
-    int spaces = 0;
-    if (strcmp(replace, "") == 0
-        && (str[status + len] == ' ' || str[status + len] == 0))
-        spaces++;
-    if (strncmp(str + status + 1, "@", 1) == 0)
+    struct list *var = NULL;
+    const char *key = intern_find(name, len);
+    for (struct list *cur = global->vars; key && !var && cur; cur = cur->next)
+    {
+        if (cur->name == key)
+            var = cur;
+    }
+    *value = NULL;
+    *count = 0;
+    int all = (subscript[0] == '@' || subscript[0] == '*')
+        && subscript[1] == '\0';
+    if (var == NULL)
+        return 0;
+    if (var->array == NULL)
+    {
+        // A string is an array of one element
+        if (all || strcmp(subscript, "0") == 0)
+        {
+            *value = keys ? "0" : var->value;
+            *count = 1;
+        }
+        return 0;
+    }
+    if (!all)
     {
-        if (status > 0 && str[status - 1] == '\"' && str[status + len] == '\"')
-            spaces++;
-        if (status > 1 && str[status - 2] == ' ')
-            spaces++;
+        if (array_get(var->array, subscript, value) == -1)
+            return -1;
+        *count = *value != NULL;
+        return 0;
     }
-    char *before = strndup(str, status - spaces);
-    if (status - spaces < 0)
+    *count = var->array->count;
+    if (*count == 0)
+        return 0;
+    if (!quoted)
+        *owned = array_join(var->array, keys, " ", NULL);
+    else if (subscript[0] == '@')
+        *owned = array_join(var->array, keys, QUOTED_SEP, QUOTED_ESCAPE);
+    else
     {
-        free(before);
-        before = strdup("");
+        struct list *ifs = find_var("IFS");
+        char sep[2] = { ifs ? ifs->value[0] : ' ', '\0' };
+        *owned = array_join(var->array, keys, sep, QUOTED_ESCAPE);
     }
-    char *after = strdup(str + status + len);
-    sprintf(new, "%s%s%s", before, replace, after);
-    free(str);
-    free(before);
-    free(after);
-    return new;
+    *value = *owned;
+    return 0;
 }
 
-static char *sub_replace(char *str, int status, int *i, int brackets, char *var,
-                         char *var_rep)
+/**
+ * \brief Append the expansion of the ${...} starting at *i in str to out
+ * @param i: set to the index following the parameter
+ * @return: 0 on success, -1 on error
+ */
+static int expand_param(struct vec *out, char *str, size_t *i, int *context,
+                        int split, char *var, char *var_rep)
 {
-    char *name =
-        strndup(str + status + 1 + brackets, *i - status - brackets * 2 - 1);
-    struct list *cur = global->vars;
-    char *replace = "";
-    while (cur)
+    size_t start = *i;
+    size_t end = param_end(str, start);
+    if (end == 0)
+    {
+        vec_push(out, str[(*i)++]);
+        return 0;
+    }
+    char *name = str + start + 2;
+    int length = name[0] == '#' && name + 1 != str + end;
+    int keys = !length && name[0] == '!' && name + 1 != str + end;
+    name += length + keys;
+    size_t name_len = param_name_len(name);
+    char *op = name + name_len;
+    char *subscript = NULL;
+    size_t sub_len = 0;
+    if (op[0] == '[' && name_len > 0)
+    {
+        sub_len = subscript_end(op, str + end);
+        if (sub_len == 0)
+            return param_error(str + start, end - start + 1,
+                               "bad substitution");
+        subscript = op + 1;
+        op += sub_len + 1;
+        sub_len--;
+    }
+    size_t op_len = op[0] == ':' ? 2 : 1;
+    int all = subscript && sub_len == 1 && strchr("@*", subscript[0]);
+    if (name_len == 0 || (length && op != str + end) || (keys && !all)
+        || (op != str + end && !strchr(":-=+?#%", op[0]))
+        || (op[0] == ':' && !strchr("-=+?", op[1])))
+        return param_error(str + start, end - start + 1,
+                           "bad substitution");
+    if ((op[0] == '#' || op[0] == '%') && op[1] == op[0])
+        op_len = 2;
+    // Parse the word in place: it ends where the parameter does
+    str[end] = '\0';
+    char *word = op + op_len;
+    char *value = NULL;
+    char *owned = NULL;
+    int syntax = 0;
+    char *elements = NULL;
+    size_t count = 0;
+    if (subscript)
     {
-        if (strcmp(cur->name, name) == 0)
+        // The subscript is expanded like a word in double quotes
+        char *sub = expand_vars(strndup(subscript, sub_len), var, var_rep);
+        if (sub)
+            sub = remove_quotes(sub);
+        int status = sub ? element_value(name, name_len, sub, keys,
+                                         *context == DOUBLE, &value,
+                                         &elements, &count)
+                         : -1;
+        free(sub);
+        if (status == -1)
+            return -1;
+        // "${name[@]}" without elements expands to no field at all
+        if (all && subscript[0] == '@' && count == 0 && op == str + end
+            && !length && *context == DOUBLE && start > 0
+            && str[start - 1] == '\"' && str[end + 1] == '\"')
         {
-            replace = cur->value;
-            break;
+            // Drop the opening quote, skip the closing one
+            *context = NONE;
+            out->size--;
+            str[end] = '}';
+            *i = end + 2;
+            append_value(out, "", 0, str + *i, 0);
+            return 0;
+        }
+    }
+    else
+        value = param_value(name, name_len, 0, var, var_rep);
+    size_t from = 0;
+    size_t len = 0;
+    int is_null = value == NULL || (op[0] == ':' && value[0] == '\0');
+    char kind = op[0] == ':' ? op[1] : op[0];
+    char number[32];
+    if (length)
+    {
+        sprintf(number, "%zu", all ? count : value ? strlen(value) : 0);
+        value = number;
+    }
+    else if (op == str + end)
+        value = value ? value : "";
+    else if (kind == '#' || kind == '%')
+    {
+        if (!value)
+            value = "";
+        else if (param_trim(value, word, kind == '%', op_len == 2, var,
+                            var_rep, &from, &len)
+                 == -1)
+        {
+            free(elements);
+            return -1;
         }
-        cur = cur->next;
     }
-    if (var != NULL && strcmp(name, var + 1) == 0)
-        replace = var_rep;
-    str = replace_at_by(str, status, *i - status, replace);
-    *i = status;
-    if (*i > 0)
-        (*i)--;
-    free(name);
-    return str;
+    else if ((kind == '+') == is_null)
+        value = kind == '+' ? "" : value;
+    else
+    {
+        // A word keeping quotes is appended as is, once its own expansions
+        // are split
+        syntax = has_syntax(word);
+        if (split && syntax && (kind == '-' || kind == '+'))
+            split_next = EXPAND_SPLIT;
+        owned = expand_vars(strdup(word), var, var_rep);
+        if (!owned)
+        {
+            free(elements);
+            return -1;
+        }
+        if (kind == '?')
+        {
+            char *msg = owned[0] ? owned : "parameter not set or null";
+            param_error(name, name_len, msg);
+            free(owned);
+            free(elements);
+            return -1;
+        }
+        if (kind == '=')
+        {
+            // The name keeps its subscript if any
+            size_t var_len = subscript ? (size_t)(op - name) : name_len;
+            char *var_name = strndup(name, var_len);
+            if (subscript)
+                var_set_element(var_name, owned, 0);
+            else
+                var_set(var_name, owned);
+            free(var_name);
+        }
+        value = owned;
+    }
+    if (kind != '#' && kind != '%')
+        len = strlen(value);
+    if (length)
+        len = strlen(number);
+    str[end] = '}';
+    *i = end + 1;
+    split = split_mode(split && !length && !syntax, name, name_len, all);
+    if (split == 2 && !all && op == str + end)
+        append_params(out, str + *i);
+    else
+        append_value(out, value + from, len, str + *i, split);
+    free(owned);
+    free(elements);
+    return 0;
 }
 
 char *expand_vars(char *str, char *var, char *var_rep)
 {
-    int i = 0;
-    int status = -1;
-    int brackets = 0;
+    // The nested expansions of the ${name<op>word} forms are not split
+    enum expand_split splits = split_next;
+    struct arith_cache **cache = arith_next;
+    split_next = EXPAND_KEEP;
+    arith_next = NULL;
+    // Most words have no parameter at all
+    if (strchr(str, '$') == NULL)
+        return str;
+    // The values are appended to a new string as str is scanned, so that
+    // they are neither copied again nor scanned for parameters
+    struct vec out = { NULL, 0, 0 };
+    vec_reserve(&out, strlen(str) + 1);
+    size_t i = 0;
     int context = NONE;
     while (str[i] != 0)
     {
-        if (str[i] == '$' && str[i + 1] == '$')
+        if (context != SIMPLE && str[i] == '$'
+            && (i == 0 || str[i - 1] != '\\'))
         {
-            struct list *cur = global->vars;
-            while (cur)
+            int split = context == NONE && splits != EXPAND_KEEP
+                && (splits == EXPAND_SPLIT || word_is_split(str, i));
+            size_t end = str[i + 1] == '(' && str[i + 2] == '('
+                ? arith_end(str, i + 3)
+                : 0;
+            if (end != 0)
             {
-                if (strcmp("$", cur->name) == 0)
+                if (arith_append(&out, str + i + 3, end - i - 3, cache) == -1)
                 {
-                    str = replace_at_by(str, i, 2, cur->value);
-                    break;
+                    free(out.data);
+                    free(str);
+                    return NULL;
                 }
-                cur = cur->next;
+                i = end + 2;
+                continue;
+            }
+            if (str[i + 1] == '(')
+            {
+                size_t next = skip_nested(str, i);
+                vec_append(&out, str + i, next - i);
+                i = next;
+                continue;
             }
+            if (str[i + 1] == '{')
+            {
+                if (expand_param(&out, str, &i, &context, split, var, var_rep)
+                    == -1)
+                {
+                    free(out.data);
+                    free(str);
+                    return NULL;
+                }
+                continue;
+            }
+            // Unbraced positional parameters have a single digit
+            size_t len = isdigit(str[i + 1]) ? 1 : param_name_len(str + i + 1);
+            // "$@" without positional parameters expands to no field at all
+            if (context == DOUBLE && str[i + 1] == '@' && i > 0
+                && str[i - 1] == '\"' && str[i + 2] == '\"'
+                && params_value("#", 1, 0)[0] == '0')
+            {
+                // Drop the opening quote, skip the closing one
+                out.size--;
+                i += 3;
+                append_value(&out, "", 0, str + i, 0);
+                context = NONE;
+                continue;
+            }
+            if (len > 0)
+            {
+                sub_replace(&out, str, &i, len, context == DOUBLE, split, var,
+                            var_rep);
+                continue;
+            }
+        }
+        // Command substitutions expand their own parameters when they run
+        if (context != SIMPLE && str[i] == '`'
+            && (i == 0 || str[i - 1] != '\\'))
+        {
+            size_t next = skip_nested(str, i);
+            vec_append(&out, str + i, next - i);
+            i = next;
             continue;
         }
         if (str[i] == '\'')
@@ -178,42 +598,28 @@ char *expand_vars(char *str, char *var, char *var_rep)
             else if (context == DOUBLE)
                 context = NONE;
         }
-        if (context != SIMPLE && status == -1 && str[i] == '$'
-            && str[i + 1] != '(' && (i == 0 || str[i - 1] != '\\')
-            && (!is_var_sep(str[i + 1]) || str[i + 1] == '*'))
-        {
-            if (str[i + 1] == '{')
-                brackets = 1;
-            status = i;
-        }
-        else if (((is_var_sep(str[i]) && !(str[i] == '*' && str[i - 1] == '$'))
-                  || (((str[i] == '}' || str[i] == '{') && brackets == 0)
-                      || (brackets == 1 && str[i] == '}')))
-                 && status != -1)
-        {
-            if (str[i] == '}' && brackets == 1)
-                i++;
-
-            str = sub_replace(str, status, &i, brackets, var, var_rep);
-
-            status = -1;
-            brackets = 0;
-        }
-        i++;
-    }
-    if (status != -1)
-    {
-        str = sub_replace(str, status, &i, brackets, var, var_rep);
+        vec_push(&out, str[i++]);
     }
-    return str;
+    free(str);
+    return vec_release(&out);
 }
 
-char *remove_quotes(char *str)
+char *expand_fields(char *str, char *var, char *var_rep,
+                    enum expand_split split, struct arith_cache **cache)
+{
+    if (str == NULL)
+        return NULL;
+    split_next = split;
+    arith_next = cache;
+    return expand_vars(str, var, var_rep);
+}
+
+// Copy str without its quotes to new, which is at most as long
+static void unquote(char *str, char *new)
 {
     int i = 0;
     int context = NONE;
     int index = 0;
-    char *new = zalloc(sizeof(char) * (strlen(str) + 1));
     while (str[i] != 0)
     {
         if (str[i + 1] != '\0' && str[i] == '\\' && !isspace(str[i + 1]))
@@ -272,12 +678,39 @@ char *remove_quotes(char *str)
         new[index++] = str[i];
         i++;
     }
+    new[index] = '\0';
+}
+
+char *remove_quotes(char *str)
+{
+    if (strpbrk(str, "\\\'\"") == NULL)
+        return str;
+    char *new = xmalloc(strlen(str) + 1);
+    unquote(str, new);
     free(str);
     return new;
 }
 
+char *remove_quotes_scratch(char *str)
+{
+    char *new = arena_alloc(&global->scratch, strlen(str) + 1);
+    unquote(str, new);
+    return new;
+}
+
+// Invalidate what depends on the value of the variable name
+static void var_changed(const char *name)
+{
+    if (strcmp(name, "IFS") == 0)
+        global->ifs_generation++;
+    else if (strcmp(name, "PATH") == 0)
+        cmd_hash_clear();
+}
+
 void add_var(struct list *new)
 {
+    global->vars_generation++;
+    var_changed(new->name);
     if (!global->vars)
     {
         global->vars = new;
@@ -285,7 +718,7 @@ void add_var(struct list *new)
     }
     struct list *cur = global->vars;
     struct list *prev = NULL;
-    while (cur && strcmp(cur->name, new->name) != 0)
+    while (cur && cur->name != new->name)
     {
         prev = cur;
         cur = cur->next;
@@ -320,32 +753,123 @@ int is_var_assign(char *str)
     if ((quote && quote < equal) || (squote && squote < equal))
         return 0;
     char *tmp = str;
-    while (tmp != equal && isalnum(tmp[0]))
+    while (tmp != equal && (isalnum(tmp[0]) || tmp[0] == '_'))
         tmp++;
-    if (tmp != equal)
+    // name+=value appends to the current value
+    char *end = equal;
+    int append = end - 1 > str && end[-1] == '+';
+    if (append)
+        end--;
+    // name[subscript]=value assigns an element of an array
+    if (tmp != str && tmp[0] == '[' && end[-1] == ']')
+    {
+        char *element = arena_strndup(&global->scratch, str, end - str);
+        var_set_element(element, equal + 1, append);
+        return 1;
+    }
+    if (tmp != end)
         return 0;
 
-    struct list *var = zalloc(sizeof(struct list));
-    var->name = strndup(str, equal - str);
+    char *name = arena_strndup(&global->scratch, str, end - str);
+    struct list *old = find_var(name);
+    if (old && old->array)
+    {
+        // Assigning an array sets its first element
+        char *element = arena_alloc(&global->scratch, end - str + 4);
+        sprintf(element, "%s[0]", name);
+        var_set_element(element, equal + 1, append);
+        return 1;
+    }
+    if (old)
+    {
+        // The node and the buffer of the value are reused
+        if (append)
+            var_append(old, equal + 1, strlen(equal + 1));
+        else
+            var_replace(old, equal + 1);
+        return 1;
+    }
+    struct list *var = slab_alloc(SLAB_VAR, sizeof(struct list));
+    var->name = intern(name, strlen(name));
     var->value = strdup(equal + 1);
     add_var(var);
     return 1;
 }
 
+// Return the length of the reference to name starting str, either $name or
+// ${name}, 0 if str does not start with one
+static size_t self_reference_len(const char *str, const char *name,
+                                 size_t len)
+{
+    if (str[0] != '$')
+        return 0;
+    if (str[1] == '{')
+        return strncmp(str + 2, name, len) == 0 && str[len + 2] == '}'
+            ? len + 3
+            : 0;
+    if (strncmp(str + 1, name, len) != 0 || isalnum(str[len + 1])
+        || str[len + 1] == '_')
+        return 0;
+    return len + 1;
+}
+
+char *self_append_assign(char *str, const char *var)
+{
+    size_t len = 0;
+    while (isalnum(str[len]) || str[len] == '_')
+        len++;
+    if (len == 0 || isdigit(str[0]) || str[len] != '=')
+        return str;
+    // The variable of a for loop is replaced by its value, not read
+    if (var && strncmp(var + 1, str, len) == 0 && var[len + 1] == '\0')
+        return str;
+    char *value = str + len + 1;
+    int quoted = value[0] == '"';
+    size_t ref = self_reference_len(value + quoted, str, len);
+    if (ref == 0)
+        return str;
+    // The rest of the line must be the rest of the value: one word, which
+    // does not reference the variable again
+    const char *rest = value + quoted + ref;
+    char quote = quoted ? '"' : 0;
+    for (const char *c = rest; *c != '\0'; c++)
+    {
+        if (*c == '\\' && quote != '\'' && c[1] != '\0')
+            c++;
+        else if ((*c == '\'' || *c == '"') && (!quote || quote == *c))
+            quote = quote ? 0 : *c;
+        else if (!quote && strchr(" \t;&|<>()`", *c))
+            return str;
+        else if (*c == '$' && self_reference_len(c, str, len) != 0)
+            return str;
+    }
+    // name+=" followed by the rest
+    size_t rest_len = strlen(rest);
+    char *res = xmalloc(len + 2 + quoted + rest_len + 1);
+    memcpy(res, str, len);
+    memcpy(res + len, "+=\"", 2 + quoted);
+    memcpy(res + len + 2 + quoted, rest, rest_len + 1);
+    free(str);
+    return res;
+}
+
 void var_assign_special(char *str)
 {
     char *equal = strchr(str, '=');
-    char *before = strndup(str, equal - str);
-    struct list *var = zalloc(sizeof(struct list));
-    var->name = before;
+    struct list *var = slab_alloc(SLAB_VAR, sizeof(struct list));
+    var->name = intern(str, equal - str);
     var->value = strdup(equal + 1);
     add_var(var);
 }
 
 char *build_var(char *name, char *value)
 {
-    char *new = zalloc(sizeof(char) * (strlen(name) + 1 + strlen(value) + 1));
-    sprintf(new, "%s=%s", name, value);
+    size_t name_len = strlen(name);
+    size_t value_len = strlen(value);
+    char *new = xmalloc(name_len + 1 + value_len + 1);
+    memcpy(new, name, name_len);
+    new[name_len] = '=';
+    memcpy(new + name_len + 1, value, value_len + 1);
     return new;
 }
 
@@ -397,10 +921,13 @@ void unset_var(char *name)
     struct list *cur = global->vars;
     struct list *before = NULL;
 
-    while (cur)
+    global->vars_generation++;
+    var_changed(name);
+    const char *key = intern_find(name, strlen(name));
+    while (key && cur)
     {
         // it should work with only one var in the list
-        if (!strcmp(name, cur->name))
+        if (cur->name == key)
         {
             if (!before)
                 global->vars = cur->next;
@@ -417,9 +944,136 @@ void unset_var(char *name)
 void push_front(char *name, char *value)
 {
     struct list *tmp = global->vars;
-    struct list *var = zalloc(sizeof(struct list));
-    var->name = strdup(name);
+    struct list *var = slab_alloc(SLAB_VAR, sizeof(struct list));
+    var->name = intern(name, strlen(name));
     var->value = value;
     var->next = tmp;
     global->vars = var;
+    global->vars_generation++;
+    var_changed(name);
+}
+
+struct list *find_var(const char *name)
+{
+    const char *key = intern_find(name, strlen(name));
+    for (struct list *cur = global->vars; key && cur; cur = cur->next)
+    {
+        if (cur->name == key)
+            return cur;
+    }
+    return NULL;
+}
+
+// Make room for len characters in the value of var, at least doubling the
+// buffer when it grows so that repeated appends stay linear
+static void var_reserve(struct list *var, size_t len)
+{
+    if (var->capacity == 0)
+    {
+        var->length = strlen(var->value);
+        var->capacity = var->length + 1;
+    }
+    if (len + 1 <= var->capacity)
+        return;
+    size_t capacity = var->capacity * 2;
+    if (capacity < len + 1)
+        capacity = len + 1;
+    var->value = xrealloc(var->value, capacity);
+    var->capacity = capacity;
+}
+
+void var_replace(struct list *var, const char *value)
+{
+    size_t len = strlen(value);
+    var_reserve(var, len);
+    memmove(var->value, value, len + 1);
+    var->length = len;
+    var->is_number = 0;
+    var_changed(var->name);
+}
+
+void var_append(struct list *var, const char *value, size_t len)
+{
+    if (var->capacity == 0)
+        var_reserve(var, 0);
+    var_reserve(var, var->length + len);
+    memcpy(var->value + var->length, value, len);
+    var->length += len;
+    var->value[var->length] = '\0';
+    var->is_number = 0;
+    var_changed(var->name);
+}
+
+struct list *var_set(const char *name, const char *value)
+{
+    struct list *var = find_var(name);
+    if (!var)
+    {
+        var = slab_alloc(SLAB_VAR, sizeof(struct list));
+        var->name = intern(name, strlen(name));
+        var->value = strdup(value);
+        add_var(var);
+        return var;
+    }
+    var_replace(var, value);
+    return var;
+}
+
+// Bound the evaluation of variables whose values reference each other
+#define MAX_VAR_DEPTH 32
+
+int var_number(struct list *var, int64_t *res)
+{
+    static int depth = 0;
+    if (var->is_number)
+    {
+        *res = var->number;
+        return 0;
+    }
+    char *end = NULL;
+    errno = 0;
+    long long nb = strtoll(var->value, &end, 0);
+    while (isspace(*end))
+        end++;
+    if (errno == 0 && *end == '\0')
+    {
+        var->number = nb;
+        var->is_number = 1;
+        *res = nb;
+        return 0;
+    }
+    if (depth >= MAX_VAR_DEPTH)
+        return -1;
+    depth++;
+    int status = eval_exp(var->value, res);
+    depth--;
+    return status;
+}
+
+int var_real(struct list *var, double *res)
+{
+    if (var->is_number)
+    {
+        *res = var->number;
+        return 0;
+    }
+    char *end = NULL;
+    *res = strtod(var->value, &end);
+    while (isspace(*end))
+        end++;
+    return *end == '\0' ? 0 : -1;
+}
+
+void var_set_number(struct list *var, int64_t nb)
+{
+    // 21 characters are enough for any 64 bits integer
+    var_reserve(var, 21);
+    var->length = sprintf(var->value, "%" PRId64, nb);
+    var->number = nb;
+    var->is_number = 1;
+}
+
+void set_status(int status)
+{
+    var_set_number(var_set("?", ""), status);
 }
@@ -2,6 +2,7 @@
 #define BUILTIN_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 int echo(char *args);
 
@@ -15,4 +16,49 @@ int dot(char *args);
 
 int unset(char *args);
 
+/**
+ * \brief Replace the positional parameters by the arguments, print the
+ * variables without any
+ */
+int builtin_set(char **argv, size_t argc);
+
+/**
+ * \brief Drop the first positional parameters, one by default
+ */
+int builtin_shift(char **argv, size_t argc);
+
+/**
+ * \brief Declare variables, as indexed arrays with -a and associative ones
+ * with -A
+ */
+int builtin_declare(char **argv, size_t argc);
+
+/**
+ * \brief Store the lines of the standard input, or of the file descriptor
+ * given with -u, in an indexed array, MAPFILE by default
+ * @details -n keeps at most count lines, -s discards the first skip ones and
+ * -t removes their newline. Regular files are mapped in memory, other
+ * inputs are read by blocks.
+ */
+int builtin_mapfile(char **argv, size_t argc);
+
+/**
+ * \brief List the commands of the hash table with their hits, or add the
+ * named ones
+ * @details -r empties the table first, -p path sets the path of the names
+ * and -t prints their paths
+ */
+int builtin_hash(char **argv, size_t argc);
+
+/**
+ * \brief Print whether each name is a function, a builtin or an external
+ * command, and where it is
+ */
+int builtin_type(char **argv, size_t argc);
+
+/**
+ * \brief Run a command skipping functions, or describe it with -v and -V
+ */
+int builtin_command(char **argv, size_t argc);
+
 #endif /* !BUILTIN_H */
@@ -0,0 +1,125 @@
+#include <ast/ast.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "builtin.h"
+
+/**
+ * \brief How command and type show what a name is
+ */
+enum describe_mode
+{
+    DESCRIBE_NAME,
+    DESCRIBE_VERBOSE,
+};
+
+// Return if path is an executable file
+static int is_executable(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode)
+        && access(path, X_OK) == 0;
+}
+
+// Print what a name is, kind being how type says it
+static void print_kind(const char *name, const char *kind, const char *path,
+                       enum describe_mode mode)
+{
+    if (mode == DESCRIBE_NAME)
+        printf("%s\n", path ? path : name);
+    else if (path)
+        printf("%s is %s%s%s\n", name, kind, path, *kind ? ")" : "");
+    else
+        printf("%s is %s\n", name, kind);
+}
+
+/**
+ * \brief Print what name runs, from the hash table when it is in it
+ * @return: 0 if it was found, 1 otherwise
+ */
+static int describe(const char *name, enum describe_mode mode)
+{
+    struct dispatch dispatch = cmd_resolve(name, 1);
+    if (dispatch.kind == DISPATCH_FUNCTION)
+        print_kind(name, "a function", NULL, mode);
+    else if (dispatch.kind != DISPATCH_EXTERNAL)
+        print_kind(name, "a shell builtin", NULL, mode);
+    else if (strchr(name, '/'))
+    {
+        if (!is_executable(name))
+            return 1;
+        print_kind(name, "", name, mode);
+    }
+    else if (dispatch.hashed)
+        print_kind(name, "hashed (", dispatch.hashed->path, mode);
+    else
+    {
+        char *path = path_search(name);
+        if (path == NULL)
+            return 1;
+        print_kind(name, "", path, mode);
+        free(path);
+    }
+    return 0;
+}
+
+int builtin_type(char **argv, size_t argc)
+{
+    int return_code = 0;
+    size_t i = 1;
+    if (i < argc && strcmp(argv[i], "--") == 0)
+        i++;
+    for (; i < argc; i++)
+    {
+        if (describe(argv[i], DESCRIBE_VERBOSE) != 0)
+        {
+            fprintf(stderr, "42sh: type: %s: not found\n", argv[i]);
+            return_code = 1;
+        }
+    }
+    fflush(stdout);
+    return return_code;
+}
+
+int builtin_command(char **argv, size_t argc)
+{
+    size_t i = 1;
+    int describe_mode = -1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++)
+    {
+        if (strcmp(argv[i], "--") == 0)
+        {
+            i++;
+            break;
+        }
+        for (char *c = argv[i] + 1; *c != '\0'; c++)
+        {
+            if (*c == 'v')
+                describe_mode = DESCRIBE_NAME;
+            else if (*c == 'V')
+                describe_mode = DESCRIBE_VERBOSE;
+            else if (*c != 'p')
+            {
+                fprintf(stderr, "42sh: command: -%c: invalid option\n", *c);
+                return 2;
+            }
+        }
+    }
+    if (describe_mode == -1)
+        return cmd_exec_fields(argv + i, argc - i);
+    // Like bash, it succeeds if any name was found
+    int found = 0;
+    for (; i < argc; i++)
+    {
+        if (describe(argv[i], describe_mode) == 0)
+            found = 1;
+        else if (describe_mode == DESCRIBE_VERBOSE)
+            fprintf(stderr, "42sh: command: %s: not found\n", argv[i]);
+    }
+    fflush(stdout);
+    return !found;
+}
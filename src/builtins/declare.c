@@ -0,0 +1,100 @@
+#include <ast/ast.h>
+#include <ctype.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "builtin.h"
+
+// Parse the options, return the index of the first name, 0 on error
+static size_t parse_options(char **argv, size_t argc, int *array,
+                            enum array_kind *kind)
+{
+    size_t i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++)
+    {
+        if (strcmp(argv[i], "--") == 0)
+            return i + 1;
+        for (char *c = argv[i] + 1; *c != '\0'; c++)
+        {
+            if (*c != 'a' && *c != 'A')
+            {
+                fprintf(stderr, "42sh: declare: -%c: invalid option\n", *c);
+                return 0;
+            }
+            // -A wins over -a
+            if (!*array || *c == 'A')
+                *kind = *c == 'A' ? ARRAY_ASSOC : ARRAY_INDEXED;
+            *array = 1;
+        }
+    }
+    return i;
+}
+
+// Return if the len first characters of word are a variable name
+static int is_name(const char *word, size_t len)
+{
+    if (len == 0 || (!isalpha(word[0]) && word[0] != '_'))
+        return 0;
+    for (size_t i = 1; i < len; i++)
+    {
+        if (!isalnum(word[i]) && word[i] != '_')
+            return 0;
+    }
+    return 1;
+}
+
+// Declare the variable of a word name[=value], an array of kind if array
+static int declare_var(char *word, int array, enum array_kind kind)
+{
+    char *equal = strchr(word, '=');
+    size_t len = equal ? (size_t)(equal - word) : strlen(word);
+    if (!is_name(word, len))
+    {
+        fprintf(stderr, "42sh: declare: %.*s: bad variable name\n", (int)len,
+                word);
+        return 1;
+    }
+    char *name = strndup(word, len);
+    struct list *var = find_var(name);
+    if (array && var && var->array && var->array->kind != kind)
+    {
+        fprintf(stderr, "42sh: declare: %s: cannot convert array\n", name);
+        free(name);
+        return 1;
+    }
+    if (array && (!var || !var->array))
+    {
+        // The value of a string becomes the first element
+        struct array *elements = array_new(kind);
+        if (var && var->value[0] != '\0')
+            array_set(elements, "0", var->value);
+        if (!var)
+            var = var_set(name, "");
+        var->array = elements;
+    }
+    size_t word_len = strlen(word);
+    if (equal && var && var->array && equal[1] == '('
+        && word[word_len - 1] == ')')
+        array_assign(word);
+    else if (equal && var && var->array)
+        array_set(var->array, "0", equal + 1);
+    else if (equal)
+        var_set(name, equal + 1);
+    free(name);
+    return 0;
+}
+
+int builtin_declare(char **argv, size_t argc)
+{
+    int array = 0;
+    enum array_kind kind = ARRAY_INDEXED;
+    size_t first = parse_options(argv, argc, &array, &kind);
+    if (first == 0)
+        return 2;
+    int code = 0;
+    for (size_t i = first; i < argc; i++)
+        code |= declare_var(argv[i], array, kind);
+    return code;
+}
@@ -73,8 +73,7 @@ static int eval_file(FILE *file)
         vec_push(line, c);
     }
     free(cs);
-    vec_destroy(line);
-    free(line);
+    vec_free(line);
 
     parser->lexer = lexer_create(vec_cstring(final));
     enum parser_state state = parsing(parser);
@@ -84,13 +83,11 @@ static int eval_file(FILE *file)
 
     if (state != PARSER_OK)
     {
-        vec_destroy(final);
-        free(final);
+        vec_free(final);
         return 2;
     }
 
-    vec_destroy(final);
-    free(final);
+    vec_free(final);
     return eval;
 }
 
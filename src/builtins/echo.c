@@ -1,9 +1,9 @@
+#include <ast/ast.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <utils/alloc.h>
-#include <utils/vec.h>
+#include <utils/arena.h>
 
 #include "builtin.h"
 
@@ -58,44 +58,38 @@ int echo(char *args)
 
     // options[0] => -n
     // options[1] => -e
-    int *options = zalloc(sizeof(int) * 2);
+    int options[2] = { 0, 0 };
     size_t begin = parse_options(args, options, len);
 
-    struct vec *vector = vec_init();
+    // The output is never longer than the arguments and its newline
+    char *out = arena_alloc(&global->scratch, len + 2);
+    size_t size = 0;
     for (size_t i = begin; i < len; ++i)
     {
         if (args[i] == '(' || args[i] == ')')
         {
             fprintf(stderr, "42sh: Syntax error: Unexpected character: %c\n",
                     args[i]);
-            free(options);
-            vec_destroy(vector);
-            free(vector);
             return 2;
         }
         if ((args[i] == '\\') && options[1] && i < len - 1)
         {
             if (args[i + 1] == '\\')
-                vec_push(vector, '\\');
+                out[size++] = '\\';
             else if (args[i + 1] == 'n')
-                vec_push(vector, '\n');
+                out[size++] = '\n';
             else if (args[i + 1] == 't')
-                vec_push(vector, '\t');
+                out[size++] = '\t';
             ++i;
         }
 
         else
-            vec_push(vector, args[i]);
+            out[size++] = args[i];
     }
-    // print vec->value
     if (!options[0])
-        printf("%s\n", vec_cstring(vector));
-    else
-        printf("%s", vec_cstring(vector));
+        out[size++] = '\n';
+    fwrite(out, 1, size, stdout);
 
     fflush(stdout);
-    free(options);
-    vec_destroy(vector);
-    free(vector);
     return 0;
 }
@@ -9,8 +9,6 @@
 
 #include "builtin.h"
 
-struct global *global;
-
 static int specific_separator(char c)
 {
     if (c == ' ' || c == ';')
@@ -0,0 +1,110 @@
+#include <ast/ast.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <utils/intern.h>
+
+#include "builtin.h"
+
+/**
+ * \brief The options of hash
+ * @param path: the path given with -p, NULL without it
+ */
+struct hash_options
+{
+    int reset;
+    int print;
+    char *path;
+};
+
+// Parse the options, return the index of the first name, 0 on error
+static size_t parse_options(char **argv, size_t argc, struct hash_options *opt)
+{
+    size_t i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++)
+    {
+        if (strcmp(argv[i], "--") == 0)
+            return i + 1;
+        for (char *c = argv[i] + 1; *c != '\0'; c++)
+        {
+            if (*c == 'r')
+                opt->reset = 1;
+            else if (*c == 't')
+                opt->print = 1;
+            else if (*c == 'p')
+            {
+                // The path is the rest of the word or the next argument
+                opt->path = c[1] != '\0' ? c + 1 : argv[++i];
+                if (i >= argc)
+                {
+                    fprintf(stderr, "42sh: hash: -p: option requires an "
+                                    "argument\n");
+                    return 0;
+                }
+                break;
+            }
+            else
+            {
+                fprintf(stderr, "42sh: hash: -%c: invalid option\n", *c);
+                return 0;
+            }
+        }
+    }
+    return i;
+}
+
+// Print the path of name for -t, with its name if there are several
+static int print_path(const char *name, int with_name)
+{
+    const char *key = intern_find(name, strlen(name));
+    struct hashed_cmd *hashed = key ? cmd_hash_find(key) : NULL;
+    if (hashed == NULL)
+    {
+        fprintf(stderr, "42sh: hash: %s: not found\n", name);
+        return 1;
+    }
+    if (with_name)
+        printf("%s\t", name);
+    printf("%s\n", hashed->path);
+    return 0;
+}
+
+// Search PATH for name again, builtins and functions are left alone
+static int hash_name(const char *name)
+{
+    struct dispatch dispatch = cmd_resolve(name, 0);
+    if (dispatch.kind != DISPATCH_EXTERNAL || strchr(name, '/'))
+        return 0;
+    char *path = path_search(name);
+    if (path == NULL)
+    {
+        fprintf(stderr, "42sh: hash: %s: not found\n", name);
+        return 1;
+    }
+    cmd_hash_set(intern(name, strlen(name)), path);
+    return 0;
+}
+
+int builtin_hash(char **argv, size_t argc)
+{
+    struct hash_options opt = { 0, 0, NULL };
+    size_t i = parse_options(argv, argc, &opt);
+    if (i == 0)
+        return 2;
+    if (opt.reset)
+        cmd_hash_clear();
+    if (i == argc)
+        return opt.reset || opt.path ? 0 : cmd_hash_print();
+    int return_code = 0;
+    for (; i < argc; i++)
+    {
+        if (opt.path)
+            cmd_hash_set(intern(argv[i], strlen(argv[i])), strdup(opt.path));
+        else if (opt.print)
+            return_code |= print_path(argv[i], argc - i > 1 || i > 2);
+        else
+            return_code |= hash_name(argv[i]);
+    }
+    fflush(stdout);
+    return return_code;
+}
@@ -0,0 +1,229 @@
+#include <ast/ast.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utils/alloc.h>
+
+#include "builtin.h"
+
+/**
+ * \brief Size of the blocks read from inputs which can not be mapped
+ */
+#define MAPFILE_BLOCK 65536
+
+/**
+ * \brief Options and progress of a mapfile
+ * @param count: the number of lines to store, 0 for all of them
+ * @param skip: the number of lines to discard first
+ * @param trim: remove the newline ending the lines
+ */
+struct mapfile
+{
+    size_t count;
+    size_t skip;
+    int trim;
+    int fd;
+    struct array *array;
+    size_t stored;
+};
+
+// Return if every line wanted was stored
+static int mapfile_done(struct mapfile *map)
+{
+    return map->count != 0 && map->stored == map->count;
+}
+
+// Store or skip one line of len bytes, its newline included if any
+static void mapfile_line(struct mapfile *map, const char *line, size_t len)
+{
+    if (map->skip > 0)
+    {
+        map->skip--;
+        return;
+    }
+    if (map->trim && len > 0 && line[len - 1] == '\n')
+        len--;
+    array_push(map->array, line, len);
+    map->stored++;
+}
+
+/**
+ * \brief Split the complete lines of data, memchr finding the newlines
+ * @return: the number of bytes consumed, up to the last complete line or
+ * the last line wanted
+ */
+static size_t mapfile_lines(struct mapfile *map, const char *data, size_t len)
+{
+    size_t pos = 0;
+    while (pos < len && !mapfile_done(map))
+    {
+        const char *newline = memchr(data + pos, '\n', len - pos);
+        if (!newline)
+            break;
+        size_t end = newline - data + 1;
+        mapfile_line(map, data + pos, end - pos);
+        pos = end;
+    }
+    return pos;
+}
+
+/**
+ * \brief Map the rest of a regular file and split it in one pass
+ * @return: 0 on success, -1 if the file can not be mapped
+ */
+static int mapfile_mmap(struct mapfile *map)
+{
+    struct stat st;
+    if (fstat(map->fd, &st) == -1 || !S_ISREG(st.st_mode))
+        return -1;
+    off_t offset = lseek(map->fd, 0, SEEK_CUR);
+    if (offset == -1)
+        return -1;
+    if (offset >= st.st_size)
+        return 0;
+    // The mapping starts at a page boundary
+    long page = sysconf(_SC_PAGESIZE);
+    off_t start = offset - offset % page;
+    size_t size = st.st_size - start;
+    char *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, map->fd, start);
+    if (mapped == MAP_FAILED)
+        return -1;
+    const char *data = mapped + (offset - start);
+    size_t len = st.st_size - offset;
+    size_t used = mapfile_lines(map, data, len);
+    if (used < len && !mapfile_done(map))
+    {
+        mapfile_line(map, data + used, len - used);
+        used = len;
+    }
+    munmap(mapped, size);
+    // Leave the unread lines to the next reader
+    lseek(map->fd, offset + used, SEEK_SET);
+    return 0;
+}
+
+/**
+ * \brief Read the input by blocks, the partial line ending a block being
+ * moved to the start of the buffer
+ * @details Lines read past the last one wanted are given back to seekable
+ * inputs only
+ */
+static int mapfile_read(struct mapfile *map)
+{
+    size_t capacity = MAPFILE_BLOCK;
+    char *buf = xmalloc(capacity);
+    size_t len = 0;
+    ssize_t got = 0;
+    while (!mapfile_done(map))
+    {
+        if (len == capacity)
+        {
+            capacity *= 2;
+            buf = xrealloc(buf, capacity);
+        }
+        got = read(map->fd, buf + len, capacity - len);
+        if (got == -1 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            break;
+        len += got;
+        size_t used = mapfile_lines(map, buf, len);
+        memmove(buf, buf + used, len - used);
+        len -= used;
+    }
+    if (len > 0 && !mapfile_done(map))
+        mapfile_line(map, buf, len);
+    else if (len > 0)
+        lseek(map->fd, -(off_t)len, SEEK_CUR);
+    free(buf);
+    return got == -1 ? 1 : 0;
+}
+
+// Parse the number of an option, return -1 if it is not one or is above max
+static int parse_number(const char *str, size_t max, size_t *res)
+{
+    if (!isdigit(str[0]))
+        return -1;
+    char *end = NULL;
+    errno = 0;
+    unsigned long value = strtoul(str, &end, 10);
+    if (*end != '\0' || errno == ERANGE || value > max)
+        return -1;
+    *res = value;
+    return 0;
+}
+
+// Parse the options, return the index of the array name, 0 on error
+static size_t parse_options(char **argv, size_t argc, struct mapfile *map)
+{
+    size_t i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++)
+    {
+        if (strcmp(argv[i], "--") == 0)
+            return i + 1;
+        for (char *c = argv[i] + 1; *c != '\0'; c++)
+        {
+            if (*c == 't')
+            {
+                map->trim = 1;
+                continue;
+            }
+            if (!strchr("nsu", *c))
+            {
+                fprintf(stderr, "42sh: mapfile: -%c: invalid option\n", *c);
+                return 0;
+            }
+            // The value is the rest of the word or the next argument
+            char *value = c[1] != '\0' ? c + 1 : argv[++i];
+            // A file descriptor is an int
+            size_t max = *c == 'u' ? INT_MAX : SIZE_MAX;
+            size_t number = 0;
+            if (i >= argc || parse_number(value, max, &number) == -1)
+            {
+                fprintf(stderr, "42sh: mapfile: -%c: invalid number\n", *c);
+                return 0;
+            }
+            if (*c == 'n')
+                map->count = number;
+            else if (*c == 's')
+                map->skip = number;
+            else
+                map->fd = number;
+            break;
+        }
+    }
+    return i;
+}
+
+int builtin_mapfile(char **argv, size_t argc)
+{
+    struct mapfile map = { 0, 0, 0, STDIN_FILENO, NULL, 0 };
+    size_t first = parse_options(argv, argc, &map);
+    if (first == 0)
+        return 2;
+    const char *name = first < argc ? argv[first] : "MAPFILE";
+    if (fcntl(map.fd, F_GETFD) == -1)
+    {
+        fprintf(stderr, "42sh: mapfile: %d: invalid file descriptor\n",
+                map.fd);
+        return 1;
+    }
+    map.array = var_new_array(name);
+    if (map.array == NULL)
+    {
+        fprintf(stderr, "42sh: mapfile: %s: bad array name\n", name);
+        return 1;
+    }
+    if (mapfile_mmap(&map) == 0)
+        return 0;
+    return mapfile_read(&map);
+}
@@ -0,0 +1,43 @@
+#include <ast/ast.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "builtin.h"
+
+// Print the variables the way they can be read back
+static void print_vars(void)
+{
+    for (struct list *cur = global->vars; cur; cur = cur->next)
+    {
+        printf("%s='", cur->name);
+        for (char *c = cur->value; *c != '\0'; c++)
+        {
+            if (*c == '\'')
+                fputs("'\\''", stdout);
+            else
+                putchar(*c);
+        }
+        puts("'");
+    }
+    fflush(stdout);
+}
+
+int builtin_set(char **argv, size_t argc)
+{
+    if (argc == 1)
+    {
+        print_vars();
+        return 0;
+    }
+    size_t first = 1;
+    if (strcmp(argv[1], "--") == 0)
+        first = 2;
+    else if (argv[1][0] == '-' || argv[1][0] == '+')
+    {
+        fprintf(stderr, "42sh: set: %s: invalid option\n", argv[1]);
+        return 2;
+    }
+    params_set(global->params, argv + first, argc - first);
+    return 0;
+}
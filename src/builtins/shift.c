@@ -0,0 +1,30 @@
+#include <ast/ast.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "builtin.h"
+
+int builtin_shift(char **argv, size_t argc)
+{
+    size_t n = 1;
+    if (argc > 1)
+    {
+        char *end = NULL;
+        long value = strtol(argv[1], &end, 10);
+        if (argv[1][0] < '0' || argv[1][0] > '9' || *end != '\0')
+        {
+            fprintf(stderr, "42sh: shift: Illegal number: %s\n", argv[1]);
+            global->current_mode->mode = EXIT;
+            return 2;
+        }
+        n = value;
+    }
+    if (params_shift(global->params, n) == -1)
+    {
+        fprintf(stderr, "42sh: shift: can't shift that many\n");
+        global->current_mode->mode = EXIT;
+        return 2;
+    }
+    return 0;
+}
@@ -86,7 +86,9 @@ int unset(char *args)
             {
                 remove_function(vec_cstring(vector));
             }
-            if (options[1])
+            if (options[1] && strchr(vec_cstring(vector), '['))
+                var_unset_element(vector->data);
+            else if (options[1])
             {
                 unset_var(vec_cstring(vector));
                 if (remove_env)
@@ -99,7 +101,6 @@ int unset(char *args)
     }
 
     free(options);
-    vec_destroy(vector);
-    free(vector);
+    vec_free(vector);
     return code;
 }
\ No newline at end of file
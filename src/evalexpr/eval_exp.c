@@ -1,263 +1,825 @@
 #include "eval_exp.h"
 
+#include <ast/ast.h>
 #include <ctype.h>
-#include <err.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <utils/alloc.h>
 
 #include "stack.h"
 
-// Return 1 if c is an operator
-static int is_operator(char *op)
+/**
+ * \brief Maximum nesting of parentheses and unary operators
+ */
+#define MAX_NESTING 256
+
+struct compiler
 {
-    if (strncmp(op, "+", 1) == 0)
-        return 1;
-    if (strncmp(op, "-", 1) == 0)
-        return 1;
-    if (strncmp(op, "/", 1) == 0)
-        return 1;
-    if (strncmp(op, "*", 1) == 0)
-        return 1;
-    if (strncmp(op, "^", 1) == 0)
-        return 1;
-    if (strncmp(op, "%", 1) == 0)
-        return 1;
-    if (strncmp(op, "&", 1) == 0)
-        return 1;
-    if (strncmp(op, "|", 1) == 0)
-        return 1;
-    if (strncmp(op, "!", 1) == 0)
-        return 1;
-    if (strncmp(op, "~", 1) == 0)
-        return 1;
-    if (strncmp(op, "(", 1) == 0)
-        return 1;
-    if (strncmp(op, ")", 1) == 0)
+    char *expr;
+    size_t pos;
+    struct arith_prog *prog;
+    size_t depth;
+    int nesting;
+    int error;
+};
+
+static void skip_spaces(struct compiler *c)
+{
+    while (isspace(c->expr[c->pos]))
+        c->pos++;
+}
+
+// Stack depth variation of an instruction
+static int depth_change(enum type type)
+{
+    switch (type)
+    {
+    case NB:
+    case VAR:
+    case PRE_INC:
+    case PRE_DEC:
+    case POST_INC:
+    case POST_DEC:
         return 1;
+    case JUMP_AND:
+    case JUMP_OR:
+    case JUMP_FALSE:
+    case POP:
+        return -1;
+    default:
+        return op_priority(type) != 0 ? -1 : 0;
+    }
+}
+
+// Append an instruction and keep track of the stack depth it needs
+static size_t emit(struct compiler *c, enum type type, int64_t data)
+{
+    struct arith_prog *prog = c->prog;
+    if (prog->size >= prog->capacity)
+    {
+        prog->capacity *= 2;
+        prog->code =
+            xrealloc(prog->code, prog->capacity * sizeof(struct token_stack));
+    }
+    prog->code[prog->size].type = type;
+    prog->code[prog->size].data = data;
+
+    c->depth += depth_change(type);
+    if (c->depth > prog->depth)
+        prog->depth = c->depth;
+    if (prog->depth > STACK_SIZE)
+        c->error = 1;
+    return prog->size++;
+}
+
+static size_t name_len(const char *s)
+{
+    if (!isalpha(s[0]) && s[0] != '_')
+        return 0;
+    size_t len = 1;
+    while (isalnum(s[len]) || s[len] == '_')
+        len++;
+    return len;
+}
+
+// Return the index of a variable in the program, adding it if needed
+static size_t var_index(struct compiler *c, const char *name, size_t len)
+{
+    struct arith_prog *prog = c->prog;
+    for (size_t i = 0; i < prog->nb_vars; i++)
+    {
+        if (strncmp(prog->vars[i].name, name, len) == 0
+            && prog->vars[i].name[len] == '\0')
+            return i;
+    }
+    prog->vars =
+        xrealloc(prog->vars, (prog->nb_vars + 1) * sizeof(struct arith_var));
+    prog->vars[prog->nb_vars].name = strndup(name, len);
+    prog->vars[prog->nb_vars].var = NULL;
+    prog->vars[prog->nb_vars].generation = SIZE_MAX;
+    return prog->nb_vars++;
+}
+
+// Return if the code starting at start is a single literal
+static int is_constant(struct compiler *c, size_t start)
+{
+    return c->prog->size == start + 1 && c->prog->code[start].type == NB;
+}
+
+// Return if the literal at index is not zero
+static int is_true(struct compiler *c, size_t index)
+{
+    int64_t data = c->prog->code[index].data;
+    return c->prog->is_float ? bits_to_real(data) != 0 : data != 0;
+}
+
+// Return the literal of a truth value
+static int64_t truth(struct compiler *c, int value)
+{
+    return c->prog->is_float ? real_to_bits(value) : value;
+}
+
+static void emit_unary(struct compiler *c, enum type type, size_t start)
+{
+    int64_t *data = &c->prog->code[start].data;
+    if (!is_constant(c, start))
+        emit(c, type, 0);
+    else if (c->prog->is_float)
+        *data = real_to_bits(compute_unary_real(type, bits_to_real(*data)));
+    else
+        *data = compute_unary(type, *data);
+}
+
+// Fold an operation on two literals, return -1 if it cannot be computed
+static int fold(struct compiler *c, enum type type, int64_t a, int64_t b,
+                int64_t *res)
+{
+    if (!c->prog->is_float)
+        return compute(type, a, b, res);
+    double value;
+    if (compute_real(type, bits_to_real(a), bits_to_real(b), &value) == -1)
+        return -1;
+    *res = real_to_bits(value);
     return 0;
 }
 
-// Get the number from a string
-static int mini_atoi(char *s, size_t *i)
+static void emit_binary(struct compiler *c, enum type type, size_t left,
+                        size_t right)
+{
+    int64_t res;
+    struct token_stack *code = c->prog->code;
+    if (right == left + 1 && code[left].type == NB && is_constant(c, right)
+        && fold(c, type, code[left].data, code[right].data, &res) == 0)
+    {
+        code[left].data = res;
+        c->prog->size--;
+        c->depth--;
+        return;
+    }
+    emit(c, type, 0);
+}
+
+static int digit_value(char c)
 {
-    int res = 0;
-    while (isdigit(s[*i]))
+    if (isdigit(c))
+        return c - '0';
+    if (isalpha(c))
+        return tolower(c) - 'a' + 10;
+    return 64;
+}
+
+// Parse a decimal floating point literal
+static void parse_real(struct compiler *c)
+{
+    char *s = c->expr + c->pos;
+    size_t i = strspn(s, "0123456789");
+    if (s[i] == '.')
+        i += 1 + strspn(s + i + 1, "0123456789");
+    if (i == 0 || (i == 1 && s[0] == '.'))
+    {
+        c->error = 1;
+        return;
+    }
+    if (s[i] == 'e' || s[i] == 'E')
+    {
+        size_t exponent = i + 1;
+        if (s[exponent] == '-' || s[exponent] == '+')
+            exponent++;
+        if (isdigit(s[exponent]))
+            i = exponent + strspn(s + exponent, "0123456789");
+    }
+    if (isalnum(s[i]) || s[i] == '.' || s[i] == '_')
     {
-        res *= 10;
-        res += s[*i] - '0';
-        *i = *i + 1;
+        c->error = 1;
+        return;
     }
-    return res;
+    c->pos += i;
+    emit(c, NB, real_to_bits(strtod(s, NULL)));
 }
 
-// Evalutate expr according to the reverse polish notation
-int eval_rpn(char *expr, int rpn)
+// Parse a decimal, octal (0 prefix) or hexadecimal (0x prefix) literal
+static void parse_number(struct compiler *c)
 {
+    char *s = c->expr + c->pos;
+    if (c->prog->is_float)
+    {
+        parse_real(c);
+        return;
+    }
+    int base = 10;
     size_t i = 0;
-    struct stack *nb_stack = NULL;
-    while (expr[i] != '\0')
+    if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
     {
-        while (isspace(expr[i]))
-            i++;
-        if (expr[i] == '\0')
-            break;
-        if (isdigit(expr[i]))
+        base = 16;
+        i = 2;
+    }
+    else if (s[0] == '0')
+        base = 8;
+    uint64_t nb = 0;
+    size_t begin = i;
+    while (isalnum(s[i]))
+    {
+        int digit = digit_value(s[i]);
+        if (digit >= base)
         {
-            struct token_stack t = { NB, mini_atoi(expr, &i) };
-            nb_stack = stack_add(nb_stack, t);
+            c->error = 1;
+            return;
         }
-        else if (expr[i] == '@' && rpn == 0) // Unary minus
+        nb = nb * base + digit;
+        i++;
+    }
+    if (i == begin)
+        c->error = 1;
+    c->pos += i;
+    emit(c, NB, nb);
+}
+
+static size_t parse_binary(struct compiler *c, int min_priority);
+static size_t parse_expr(struct compiler *c);
+
+// Return if a variable name follows ++ or -- at pos
+static int is_increment(struct compiler *c, char cur)
+{
+    char *s = c->expr + c->pos;
+    if (s[1] != cur)
+        return 0;
+    s += 2;
+    while (isspace(*s))
+        s++;
+    return name_len(s) > 0;
+}
+
+// Compile a variable read, with an optional ++ or -- suffix
+static void parse_variable(struct compiler *c)
+{
+    size_t len = name_len(c->expr + c->pos);
+    size_t index = var_index(c, c->expr + c->pos, len);
+    c->pos += len;
+    char *s = c->expr + c->pos;
+    if ((s[0] == '+' || s[0] == '-') && s[1] == s[0])
+    {
+        c->pos += 2;
+        emit(c, s[0] == '+' ? POST_INC : POST_DEC, index);
+    }
+    else
+        emit(c, VAR, index);
+}
+
+static size_t parse_unary(struct compiler *c)
+{
+    size_t start = c->prog->size;
+    skip_spaces(c);
+    char cur = c->expr[c->pos];
+    if (++c->nesting > MAX_NESTING)
+        c->error = 1;
+    if (c->error)
+        return start;
+
+    if ((cur == '+' || cur == '-') && is_increment(c, cur))
+    {
+        c->pos += 2;
+        skip_spaces(c);
+        size_t len = name_len(c->expr + c->pos);
+        emit(c, cur == '+' ? PRE_INC : PRE_DEC,
+             var_index(c, c->expr + c->pos, len));
+        c->pos += len;
+    }
+    else if (cur == '-' || cur == '+' || cur == '!' || cur == '~')
+    {
+        c->pos++;
+        enum type type = cur == '-' ? UMINUS
+            : cur == '+'            ? UPLUS
+            : cur == '!'            ? NOT
+                                    : TILDE;
+        parse_unary(c);
+        emit_unary(c, type, start);
+    }
+    else if (cur == '(')
+    {
+        c->pos++;
+        parse_expr(c);
+        skip_spaces(c);
+        if (c->expr[c->pos] != ')')
+            c->error = 1;
+        c->pos++;
+    }
+    else if (isdigit(cur) || (cur == '.' && c->prog->is_float))
+        parse_number(c);
+    else if (name_len(c->expr + c->pos) > 0)
+        parse_variable(c);
+    else
+        c->error = 1;
+    c->nesting--;
+    return start;
+}
+
+/**
+ * \brief Compile the right operand of a && or || with short-circuit
+ * @details when the left operand is a literal, the operator is resolved
+ * at compile time
+ */
+static void parse_logical(struct compiler *c, enum type type, size_t left,
+                          int priority)
+{
+    struct arith_prog *prog = c->prog;
+    if (is_constant(c, left))
+    {
+        int value = is_true(c, left);
+        // The right operand is not evaluated: `0 && x` or `1 || x`
+        if (value == (type == LOGICAL_OR))
         {
-            nb_stack->data.data = -nb_stack->data.data;
-            i++;
+            size_t depth = c->depth;
+            parse_binary(c, priority + 1);
+            prog->size = left + 1;
+            prog->code[left].data = truth(c, value);
+            c->depth = depth;
+            return;
         }
-        else if (expr[i] == '!' && rpn == 0)
+        prog->size = left;
+        c->depth--;
+        parse_binary(c, priority + 1);
+        emit_unary(c, BOOL, left);
+        return;
+    }
+    size_t jump = prog->size;
+    emit(c, type == LOGICAL_AND ? JUMP_AND : JUMP_OR, 0);
+    size_t right = parse_binary(c, priority + 1);
+    emit_unary(c, BOOL, right);
+    prog->code[jump].data = prog->size;
+}
+
+static size_t parse_binary(struct compiler *c, int min_priority)
+{
+    size_t left = parse_unary(c);
+    while (!c->error)
+    {
+        skip_spaces(c);
+        size_t len = 0;
+        enum type type = token_op(c->expr + c->pos, &len);
+        int priority = op_priority(type);
+        if (priority == 0 || priority < min_priority)
+            break;
+        c->pos += len;
+        if (type == LOGICAL_AND || type == LOGICAL_OR)
         {
-            nb_stack->data.data = !nb_stack->data.data;
-            i++;
+            parse_logical(c, type, left, priority);
+            continue;
         }
-        else if (expr[i] == '~' && rpn == 0)
+        size_t right =
+            parse_binary(c, op_right_assoc(type) ? priority : priority + 1);
+        emit_binary(c, type, left, right);
+    }
+    return left;
+}
+
+static size_t parse_assign(struct compiler *c);
+
+/**
+ * \brief Compile cond ? first : second with jumps
+ * @details a literal condition keeps only the selected branch
+ */
+static size_t parse_ternary(struct compiler *c)
+{
+    struct arith_prog *prog = c->prog;
+    size_t cond = parse_binary(c, 1);
+    skip_spaces(c);
+    if (c->error || c->expr[c->pos] != '?')
+        return cond;
+    c->pos++;
+    int constant = is_constant(c, cond);
+    int value = constant && is_true(c, cond);
+    size_t jump_false = 0;
+    if (constant)
+    {
+        prog->size = cond;
+        c->depth--;
+    }
+    else
+        jump_false = emit(c, JUMP_FALSE, 0);
+    size_t depth = c->depth;
+    parse_expr(c);
+    skip_spaces(c);
+    if (c->error || c->expr[c->pos] != ':')
+    {
+        c->error = 1;
+        return cond;
+    }
+    c->pos++;
+    if (constant)
+    {
+        size_t end = prog->size;
+        if (!value)
+            prog->size = cond;
+        c->depth = depth;
+        parse_assign(c);
+        if (value)
+            prog->size = end;
+        c->depth = depth + 1;
+        return cond;
+    }
+    size_t jump = emit(c, JUMP, 0);
+    prog->code[jump_false].data = prog->size;
+    c->depth = depth;
+    parse_assign(c);
+    prog->code[jump].data = prog->size;
+    return cond;
+}
+
+// Compile `name = value`, `name op= value` or a conditional expression
+static size_t parse_assign(struct compiler *c)
+{
+    size_t start = c->prog->size;
+    skip_spaces(c);
+    if (++c->nesting > MAX_NESTING)
+        c->error = 1;
+    size_t len = name_len(c->expr + c->pos);
+    if (len > 0 && !c->error)
+    {
+        size_t save = c->pos;
+        size_t op_len = 0;
+        c->pos += len;
+        skip_spaces(c);
+        enum type type = assign_op(c->expr + c->pos, &op_len);
+        if (type != NONE_OP)
         {
-            nb_stack->data.data = -nb_stack->data.data - 1;
-            i++;
+            size_t index = var_index(c, c->expr + save, len);
+            c->pos += op_len;
+            if (type != NB)
+                emit(c, VAR, index);
+            parse_assign(c);
+            if (type != NB)
+                emit(c, type, 0);
+            emit(c, ASSIGN, index);
+            c->nesting--;
+            return start;
         }
-        else if (is_operator(expr + i))
+        c->pos = save;
+    }
+    parse_ternary(c);
+    c->nesting--;
+    return start;
+}
+
+// Compile a comma separated list of expressions, the last one is the value
+static size_t parse_expr(struct compiler *c)
+{
+    size_t start = parse_assign(c);
+    skip_spaces(c);
+    while (!c->error && c->expr[c->pos] == ',')
+    {
+        c->pos++;
+        if (is_constant(c, start))
         {
-            char *save = expr + i;
-            int count = 0;
-            while (expr[i] != '\0' && expr[i] != ' ')
-            {
-                i++;
-                count++;
-            }
-            char *operator= strndup(save, count);
-            if (nb_stack == NULL)
-            {
-                free(operator);
-                return INT_MIN;
-            }
-            struct token_stack nb1 = nb_stack->data;
-            nb_stack = stack_pop(nb_stack);
-            if (nb_stack == NULL)
-            {
-                free(operator);
-                return INT_MIN;
-            }
-            struct token_stack nb2 = nb_stack->data;
-            nb_stack = stack_pop(nb_stack);
-            struct token_stack res = { NB, compute(nb2, nb1, operator) };
-            free(operator);
-            if (res.data == INT_MIN)
-                return res.data;
-            nb_stack = stack_add(nb_stack, res);
+            c->prog->size = start;
+            c->depth--;
         }
         else
-            return INT_MIN;
+            emit(c, POP, 0);
+        parse_assign(c);
+        skip_spaces(c);
     }
-    struct token_stack res = nb_stack->data;
-    nb_stack = stack_pop(nb_stack);
-    if (nb_stack != NULL)
-        return INT_MIN;
-    return res.data; // Success
+    return start;
 }
 
-struct stack *op_pop(struct stack *st, char *res, size_t *j)
+// Parse at most two digits of a format width or precision
+static size_t format_digits(const char *s)
 {
-    struct token_stack poped = st->data;
-    st = stack_pop(st);
-    char *operator= char_op(poped);
-    res[*j] = operator[0];
+    size_t i = 0;
+    while (i < 2 && isdigit(s[i]))
+        i++;
+    return i;
+}
 
-    if (strlen(operator) > 1)
+/**
+ * \brief Parse the context of an expression: `:` for floating point,
+ * `%<printf conversion>:` to format the result
+ * @details integer conversions are d i o u x X, the others select the
+ * floating point context
+ */
+static void parse_context(struct compiler *c)
+{
+    skip_spaces(c);
+    char *s = c->expr + c->pos;
+    if (s[0] == ':')
+    {
+        c->prog->is_float = 1;
+        c->pos++;
+        return;
+    }
+    if (s[0] != '%')
+        return;
+    size_t i = 1 + strspn(s + 1, "-+ #0");
+    i += format_digits(s + i);
+    if (s[i] == '.')
+        i += 1 + format_digits(s + i + 1);
+    char conversion = s[i];
+    if (conversion != '\0' && strchr("fFeEgGaA", conversion))
+        c->prog->is_float = 1;
+    else if (conversion == '\0' || !strchr("diouxX", conversion))
+    {
+        c->error = 1;
+        return;
+    }
+    if (s[i + 1] != ':')
     {
-        *j = *j + 1;
-        res[*j] = operator[1];
+        c->error = 1;
+        return;
     }
-    *j = *j + 1;
-    res[*j] = ' ';
-    *j = *j + 1;
-    return st;
+    c->prog->format = zalloc(i + 4);
+    sprintf(c->prog->format, "%.*s%s%c", (int)i, s,
+            c->prog->is_float ? "" : "ll", conversion);
+    c->pos += i + 2;
 }
 
-// Return true if the char at index i is a unary operator
-static int is_unary(char *expr, size_t i, int state)
+struct arith_prog *arith_compile(const char *expr, size_t len)
 {
-    if (state == 1)
-        return 0;
-    if (expr[i] != '+' && expr[i] != '-' && expr[i] != '!' && expr[i] != '~')
-        return 0;
-    if (i == 0) // begining of the expr
-        return 1;
-    if (expr[i - 1] == '(')
-        return 1;
-    if (is_operator(expr + i - 1))
-        return 1;
-    if (isspace(expr[i - 1]))
-        return 1;
-    return 0;
+    struct arith_prog *prog = zalloc(sizeof(struct arith_prog));
+    prog->capacity = 8;
+    prog->code = xmalloc(prog->capacity * sizeof(struct token_stack));
+    struct compiler c = { strndup(expr, len), 0, prog, 0, 0, 0 };
+
+    parse_context(&c);
+    if (!c.error)
+        parse_expr(&c);
+    skip_spaces(&c);
+    if (c.error || c.expr[c.pos] != '\0')
+    {
+        arith_free(prog);
+        prog = NULL;
+    }
+    free(c.expr);
+    return prog;
 }
 
-struct stack *append_op(struct stack *st, struct token_stack cur, char *res,
-                        size_t *j)
+// Return the variable of an expression, creating it if asked
+static struct list *lookup_var(struct arith_var *v, int create)
 {
-    if (cur.type == POPEN)
-        st = stack_add(st, cur);
-    else
+    if (v->generation != global->vars_generation)
     {
-        while (st != NULL && st->data.type != POPEN
-               && (cur.type == PCLOSE || st->data.type / 10 >= cur.type / 10))
-            st = op_pop(st, res, j);
-        st = cur.type == PCLOSE ? stack_pop(st) : stack_add(st, cur);
+        v->var = find_var(v->name);
+        v->generation = global->vars_generation;
     }
-    return st;
+    if (!v->var && create)
+    {
+        v->var = var_set(v->name, "");
+        v->generation = global->vars_generation;
+    }
+    return v->var;
 }
 
-char *to_polish(char *expr)
+// Unset variables are 0
+static int load_var(struct arith_var *v, int64_t *res)
 {
+    struct list *var = lookup_var(v, 0);
+    *res = 0;
+    if (!var)
+        return 0;
+    return var_number(var, res);
+}
+
+static int update_var(struct arith_var *v, enum type type, int64_t *res)
+{
+    int64_t value;
+    if (load_var(v, &value) == -1)
+        return -1;
+    int increment = type == PRE_INC || type == POST_INC;
+    int64_t new = increment ? (uint64_t)value + 1 : (uint64_t)value - 1;
+    var_set_number(lookup_var(v, 1), new);
+    *res = type == PRE_INC || type == PRE_DEC ? new : value;
+    return 0;
+}
+
+int arith_run(struct arith_prog *prog, int64_t *res)
+{
+    struct stack st;
+    st.size = 0;
     size_t i = 0;
-    struct stack *st = NULL;
-    char *res = malloc(sizeof(char) * strlen(expr) * 2);
-    size_t j = 0;
-    int state = 0; // 1 if last was add nb, 2 if last was add op
-    while (expr[i] != '\0')
-    {
-        while (isspace(expr[i]))
-            i++;
-        if (expr[i] == '\0')
-            break;
-        if (is_unary(expr, i, state))
+    int64_t value;
+    while (i < prog->size)
+    {
+        const struct token_stack *op = prog->code + i++;
+        int64_t *top = st.data + st.size - 1;
+        switch (op->type)
         {
-            if (expr[i] == '-')
-            {
-                struct token_stack uminus = { UMINUS, 0 };
-                st = stack_add(st, uminus);
-            }
-            else if (expr[i] == '~')
-            {
-                struct token_stack tilde = { TILDE, 0 };
-                st = stack_add(st, tilde);
-            }
-            else if (expr[i] == '!')
+        case NB:
+            stack_add(&st, op->data);
+            break;
+        case VAR:
+            if (load_var(prog->vars + op->data, &value) == -1)
+                return -1;
+            stack_add(&st, value);
+            break;
+        case ASSIGN:
+            var_set_number(lookup_var(prog->vars + op->data, 1), *top);
+            break;
+        case PRE_INC:
+        case PRE_DEC:
+        case POST_INC:
+        case POST_DEC:
+            if (update_var(prog->vars + op->data, op->type, &value) == -1)
+                return -1;
+            stack_add(&st, value);
+            break;
+        case JUMP_AND:
+        case JUMP_OR:
+            if ((*top != 0) == (op->type == JUMP_OR))
             {
-                struct token_stack not = { NOT, 0 };
-                st = stack_add(st, not );
+                *top = *top != 0;
+                i = op->data;
             }
-            i++;
-        }
-        else if (is_operator(expr + i))
-        {
-            struct token_stack cur = token_op(expr + i);
-            if (cur.type == LOGICAL_OR || cur.type == LOGICAL_AND
-                || cur.type == DOUBLE_STAR)
-                i++;
-            i++;
-            st = append_op(st, cur, res, &j);
-            state = 2;
+            else
+                st.size--;
+            break;
+        case JUMP_FALSE:
+            if (stack_pop(&st) == 0)
+                i = op->data;
+            break;
+        case JUMP:
+            i = op->data;
+            break;
+        case POP:
+            st.size--;
+            break;
+        case UMINUS:
+        case UPLUS:
+        case NOT:
+        case TILDE:
+        case BOOL:
+            *top = compute_unary(op->type, *top);
+            break;
+        default: {
+            int64_t nb2 = stack_pop(&st);
+            int64_t nb1 = stack_pop(&st);
+            if (compute(op->type, nb1, nb2, &value) == -1)
+                return -1;
+            stack_add(&st, value);
         }
-        else if (isdigit(expr[i]))
-        {
-            while (isdigit(expr[i]))
-                res[j++] = expr[i++];
-            res[j++] = ' ';
-            state = 1;
         }
-        else
-            return NULL;
     }
-    while (st != NULL) // Destack remaining operators
+    *res = stack_pop(&st);
+    return 0;
+}
+
+// Unset variables are 0
+static int load_real(struct arith_var *v, double *res)
+{
+    struct list *var = lookup_var(v, 0);
+    *res = 0;
+    if (!var)
+        return 0;
+    return var_real(var, res);
+}
+
+static void store_real(struct arith_var *v, double value)
+{
+    char buf[32];
+    arith_format_real(value, buf);
+    var_replace(lookup_var(v, 1), buf);
+}
+
+static int update_real(struct arith_var *v, enum type type, double *res)
+{
+    double value;
+    if (load_real(v, &value) == -1)
+        return -1;
+    double new = type == PRE_INC || type == POST_INC ? value + 1 : value - 1;
+    store_real(v, new);
+    *res = type == PRE_INC || type == PRE_DEC ? new : value;
+    return 0;
+}
+
+int arith_run_real(struct arith_prog *prog, double *res)
+{
+    struct real_stack st;
+    st.size = 0;
+    size_t i = 0;
+    double value;
+    while (i < prog->size)
     {
-        char *op = char_op(st->data);
-        int k = 0;
-        while (op[k] != '\0')
+        const struct token_stack *op = prog->code + i++;
+        double *top = st.data + st.size - 1;
+        switch (op->type)
         {
-            res[j++] = op[k];
-            k++;
+        case NB:
+            real_stack_add(&st, bits_to_real(op->data));
+            break;
+        case VAR:
+            if (load_real(prog->vars + op->data, &value) == -1)
+                return -1;
+            real_stack_add(&st, value);
+            break;
+        case ASSIGN:
+            store_real(prog->vars + op->data, *top);
+            break;
+        case PRE_INC:
+        case PRE_DEC:
+        case POST_INC:
+        case POST_DEC:
+            if (update_real(prog->vars + op->data, op->type, &value) == -1)
+                return -1;
+            real_stack_add(&st, value);
+            break;
+        case JUMP_AND:
+        case JUMP_OR:
+            if ((*top != 0) == (op->type == JUMP_OR))
+            {
+                *top = *top != 0;
+                i = op->data;
+            }
+            else
+                st.size--;
+            break;
+        case JUMP_FALSE:
+            if (real_stack_pop(&st) == 0)
+                i = op->data;
+            break;
+        case JUMP:
+            i = op->data;
+            break;
+        case POP:
+            st.size--;
+            break;
+        case UMINUS:
+        case UPLUS:
+        case NOT:
+        case TILDE:
+        case BOOL:
+            *top = compute_unary_real(op->type, *top);
+            break;
+        default: {
+            double nb2 = real_stack_pop(&st);
+            double nb1 = real_stack_pop(&st);
+            if (compute_real(op->type, nb1, nb2, &value) == -1)
+                return -1;
+            real_stack_add(&st, value);
+        }
         }
-        st = stack_pop(st);
     }
-    res[j] = '\0';
-    return res;
+    *res = real_stack_pop(&st);
+    return 0;
 }
 
-int eval_exp(char *expr)
+void arith_format_real(double value, char *buf)
 {
-    int valid = 0;
-    for (size_t i = 0; expr[i] != '\0'; i++)
+    for (int precision = 15; precision <= 17; precision++)
     {
-        if (isdigit(expr[i]))
-            valid = 1;
+        sprintf(buf, "%.*g", precision, value);
+        if (strtod(buf, NULL) == value)
+            return;
     }
-    if (valid == 0)
-        return INT_MIN;
-    else
+}
+
+int arith_eval_string(struct arith_prog *prog, char *buf)
+{
+    if (prog->is_float)
     {
-        char *polish = to_polish(expr);
-        if (polish == NULL)
-            return INT_MIN;
-        int res = eval_rpn(polish, 0);
-        free(polish);
-        return res;
+        double value;
+        if (arith_run_real(prog, &value) == -1)
+            return -1;
+        if (prog->format)
+            sprintf(buf, prog->format, value);
+        else
+            arith_format_real(value, buf);
+        return 0;
     }
+    int64_t value;
+    if (arith_run(prog, &value) == -1)
+        return -1;
+    if (prog->format)
+        sprintf(buf, prog->format, (long long)value);
+    else
+        sprintf(buf, "%" PRId64, value);
     return 0;
 }
+
+void arith_free(struct arith_prog *prog)
+{
+    if (!prog)
+        return;
+    for (size_t i = 0; i < prog->nb_vars; i++)
+        free(prog->vars[i].name);
+    free(prog->vars);
+    free(prog->format);
+    free(prog->code);
+    free(prog);
+}
+
+int eval_exp(char *expr, int64_t *res)
+{
+    struct arith_prog *prog = arith_compile(expr, strlen(expr));
+    if (prog == NULL)
+        return -1;
+    int status;
+    if (prog->is_float)
+    {
+        double value = 0;
+        status = arith_run_real(prog, &value);
+        *res = real_to_int(value);
+    }
+    else
+        status = arith_run(prog, res);
+    arith_free(prog);
+    return status;
+}
@@ -2,11 +2,89 @@
 #define EVAL_EXP_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include "stack.h"
 
-#define INT_MIN -2147483648
+struct list;
 
-int eval_exp(char *expr);
+/**
+ * \brief A variable referenced by a compiled expression
+ * @details var is the last node found for name, valid while the variables
+ * generation is unchanged
+ */
+struct arith_var
+{
+    char *name;
+    struct list *var;
+    size_t generation;
+};
+
+/**
+ * \brief Size of a buffer big enough for any formatted result
+ * Format widths and precisions are limited to two digits
+ */
+#define ARITH_BUF_SIZE 512
+
+/**
+ * \brief An arithmetic expression compiled to bytecode
+ * @details code is in reverse polish notation, depth is the maximum
+ * stack depth needed to run it, variable operations index vars.
+ * Expressions starting with `:` or with a floating point conversion like
+ * `%.2f:` are floating point programs, format is the printf format of the
+ * result when one is given.
+ */
+struct arith_prog
+{
+    struct token_stack *code;
+    size_t size;
+    size_t capacity;
+    size_t depth;
+    struct arith_var *vars;
+    size_t nb_vars;
+    int is_float;
+    char *format;
+};
+
+/**
+ * \brief Compile the len first characters of expr
+ * Sub-expressions made only of literals are folded
+ * Return NULL on syntax error
+ */
+struct arith_prog *arith_compile(const char *expr, size_t len);
+
+/**
+ * \brief Evaluate a compiled expression, reading and assigning the shell
+ * variables it references
+ * Return 0 on success, -1 on evaluation error (division by zero...)
+ */
+int arith_run(struct arith_prog *prog, int64_t *res);
+
+/**
+ * \brief Evaluate a floating point program
+ * Return 0 on success, -1 on evaluation error
+ */
+int arith_run_real(struct arith_prog *prog, double *res);
+
+/**
+ * \brief Evaluate a program of any context and format its result in buf,
+ * which must hold ARITH_BUF_SIZE characters
+ * Return 0 on success, -1 on evaluation error
+ */
+int arith_eval_string(struct arith_prog *prog, char *buf);
+
+/**
+ * \brief Write the shortest representation of value which reads back to
+ * the same number, buf must hold 32 characters
+ */
+void arith_format_real(double value, char *buf);
+
+void arith_free(struct arith_prog *prog);
+
+/**
+ * \brief Compile and evaluate expr at once
+ * Return 0 on success, -1 on error
+ */
+int eval_exp(char *expr, int64_t *res);
 
 #endif /* ! EVAL_EXP */
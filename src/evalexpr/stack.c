@@ -1,165 +1,285 @@
 #include "stack.h"
 
-#include <err.h>
-#include <stdio.h>
-#include <stdlib.h>
+#include <math.h>
 #include <string.h>
 
-struct token_stack token_op(char *op)
+/**
+ * \brief Operator table, two characters operators first
+ * @details priority is 0 for operators which are not binary
+ */
+static const struct
 {
-    struct token_stack t;
-    if (strncmp(op, "**", 2) == 0)
-        t.type = DOUBLE_STAR;
-    else if (strncmp(op, "*", 1) == 0)
-        t.type = MULT;
-    if (strncmp(op, "+", 1) == 0)
-        t.type = ADD;
-    if (strncmp(op, "-", 1) == 0)
-        t.type = MINUS;
-    if (strncmp(op, "/", 1) == 0)
-        t.type = DIV;
-    if (strncmp(op, "%", 1) == 0)
-        t.type = MOD;
-    if (strncmp(op, "^", 1) == 0)
-        t.type = POW;
-    if (strncmp(op, "(", 1) == 0)
-        t.type = POPEN;
-    if (strncmp(op, ")", 1) == 0)
-        t.type = PCLOSE;
-    if (strncmp(op, "&&", 2) == 0)
-        t.type = LOGICAL_AND;
-    else if (strncmp(op, "||", 2) == 0)
-        t.type = LOGICAL_OR;
-    else if (strncmp(op, "&", 1) == 0)
-        t.type = BINARY_AND;
-    else if (strncmp(op, "|", 1) == 0)
-        t.type = BINARY_OR;
-    else if (strncmp(op, "!", 1) == 0)
-        t.type = NOT;
-    else if (strncmp(op, "~", 1) == 0)
-        t.type = TILDE;
-    return t;
-}
+    const char *str;
+    enum type type;
+    int priority;
+} ops[] = {
+    { "**", DOUBLE_STAR, 11 }, { "<<", LEFT_SHIFT, 8 },
+    { ">>", RIGHT_SHIFT, 8 },  { "<=", LESS_EQUAL, 7 },
+    { ">=", GREATER_EQUAL, 7 }, { "==", EQUAL, 6 },
+    { "!=", NOT_EQUAL, 6 },    { "&&", LOGICAL_AND, 2 },
+    { "||", LOGICAL_OR, 1 },   { "*", MULT, 10 },
+    { "/", DIV, 10 },          { "%", MOD, 10 },
+    { "+", ADD, 9 },           { "-", MINUS, 9 },
+    { "<", LESS, 7 },          { ">", GREATER, 7 },
+    { "&", BINARY_AND, 5 },    { "^", BINARY_XOR, 4 },
+    { "|", BINARY_OR, 3 },     { "!", NOT, 0 },
+    { "~", TILDE, 0 },         { "(", POPEN, 0 },
+    { ")", PCLOSE, 0 },
+};
+
+#define OPS_NB (sizeof(ops) / sizeof(*ops))
 
-// if the operation is valid, return the result, raise error otherwise
-static int compute_errors(int a, int b, char op)
+enum type token_op(const char *op, size_t *len)
 {
-    if (op == '/')
+    for (size_t i = 0; i < OPS_NB; i++)
     {
-        if (b == 0)
-            return INT_MIN;
-        else
-            return a / b;
+        size_t op_len = strlen(ops[i].str);
+        if (strncmp(op, ops[i].str, op_len) == 0)
+        {
+            *len = op_len;
+            return ops[i].type;
+        }
     }
-    else if (op == '%')
+    *len = 0;
+    return NONE_OP;
+}
+
+enum type assign_op(const char *op, size_t *len)
+{
+    if (op[0] == '=' && op[1] != '=')
     {
-        if (b == 0)
-            return INT_MIN;
-        else
-            return a % b;
+        *len = 1;
+        return NB;
     }
-    else if (b < 0)
-        return INT_MIN;
-    else
+    enum type type = token_op(op, len);
+    switch (type)
     {
-        int res = 1;
-        while (b > 0)
+    case ADD:
+    case MINUS:
+    case MULT:
+    case DIV:
+    case MOD:
+    case LEFT_SHIFT:
+    case RIGHT_SHIFT:
+    case BINARY_AND:
+    case BINARY_XOR:
+    case BINARY_OR:
+        if (op[*len] == '=')
         {
-            res *= a;
-            b--;
+            (*len)++;
+            return type;
         }
-        return res;
+        break;
+    default:
+        break;
+    }
+    *len = 0;
+    return NONE_OP;
+}
+
+int op_priority(enum type type)
+{
+    for (size_t i = 0; i < OPS_NB; i++)
+    {
+        if (ops[i].type == type)
+            return ops[i].priority;
     }
     return 0;
 }
 
-char *char_op(struct token_stack t)
+int op_right_assoc(enum type type)
+{
+    return type == DOUBLE_STAR;
+}
+
+// Exponentiation by squaring, wrapping on overflow
+static uint64_t power(uint64_t a, int64_t b)
 {
-    switch (t.type)
+    uint64_t res = 1;
+    while (b > 0)
     {
-    case DOUBLE_STAR:
-        return "**";
-    case POW:
-        return "^";
+        if (b & 1)
+            res *= a;
+        a *= a;
+        b >>= 1;
+    }
+    return res;
+}
+
+int compute(enum type type, int64_t nb1, int64_t nb2, int64_t *res)
+{
+    uint64_t a = nb1;
+    uint64_t b = nb2;
+    switch (type)
+    {
+    case ADD:
+        *res = a + b;
+        return 0;
+    case MINUS:
+        *res = a - b;
+        return 0;
     case MULT:
-        return "*";
+        *res = a * b;
+        return 0;
     case DIV:
-        return "/";
     case MOD:
-        return "%";
-    case ADD:
-        return "+";
-    case MINUS:
-        return "-";
-    case UMINUS:
-        return "@";
+        if (nb2 == 0)
+            return -1;
+        // INT64_MIN / -1 overflows, wrap like the other operators
+        if (nb2 == -1)
+            *res = type == DIV ? (int64_t)(0 - a) : 0;
+        else
+            *res = type == DIV ? nb1 / nb2 : nb1 % nb2;
+        return 0;
+    case DOUBLE_STAR:
+        if (nb2 < 0)
+            return -1;
+        *res = power(a, nb2);
+        return 0;
+    case LEFT_SHIFT:
+        *res = a << (b & 63);
+        return 0;
+    case RIGHT_SHIFT:
+        *res = nb1 >> (b & 63);
+        return 0;
+    case LESS:
+        *res = nb1 < nb2;
+        return 0;
+    case LESS_EQUAL:
+        *res = nb1 <= nb2;
+        return 0;
+    case GREATER:
+        *res = nb1 > nb2;
+        return 0;
+    case GREATER_EQUAL:
+        *res = nb1 >= nb2;
+        return 0;
+    case EQUAL:
+        *res = nb1 == nb2;
+        return 0;
+    case NOT_EQUAL:
+        *res = nb1 != nb2;
+        return 0;
     case BINARY_AND:
-        return "&";
+        *res = nb1 & nb2;
+        return 0;
+    case BINARY_XOR:
+        *res = nb1 ^ nb2;
+        return 0;
     case BINARY_OR:
-        return "|";
+        *res = nb1 | nb2;
+        return 0;
     case LOGICAL_AND:
-        return "&&";
+        *res = nb1 && nb2;
+        return 0;
     case LOGICAL_OR:
-        return "||";
+        *res = nb1 || nb2;
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+int64_t compute_unary(enum type type, int64_t nb)
+{
+    switch (type)
+    {
+    case UMINUS:
+        return 0 - (uint64_t)nb;
     case NOT:
-        return "!";
+        return !nb;
     case TILDE:
-        return "~";
+        return ~nb;
+    case BOOL:
+        return nb != 0;
     default:
-        return "+";
+        return nb;
     }
 }
 
-// Compute nb1 and nb2 with op
-int compute(struct token_stack nb1, struct token_stack nb2, char *op)
+int64_t real_to_int(double nb)
 {
-    if (strncmp(op, "+", 1) == 0)
-        return nb1.data + nb2.data;
-    else if (strncmp(op, "-", 1) == 0)
-        return nb1.data - nb2.data;
-    else if (strncmp(op, "**", 2) == 0)
-        return compute_errors(nb1.data, nb2.data, '^');
-    else if (strncmp(op, "*", 1) == 0)
-        return nb1.data * nb2.data;
-    else if (strncmp(op, "/", 1) == 0)
-        return nb1.data / nb2.data;
-    else if (strncmp(op, "%", 1) == 0)
-        return nb1.data % nb2.data;
-    else if (strncmp(op, "^", 1) == 0)
-        return nb1.data ^ nb2.data;
-    else if (strncmp(op, "&&", 2) == 0)
-        return nb1.data && nb2.data;
-    else if (strncmp(op, "||", 2) == 0)
-        return nb1.data || nb2.data;
-    else if (strncmp(op, "&", 1) == 0)
-        return nb1.data & nb2.data;
-    else if (strncmp(op, "|", 1) == 0)
-        return nb1.data | nb2.data;
-    else if (strncmp(op, "!", 1) == 0)
-        return !nb1.data;
-    else if (strncmp(op, "!", 1) == 0)
-        return !nb1.data;
-    else if (strncmp(op, "~", 1) == 0)
-        return -nb1.data - 1;
-    else
-        return compute_errors(nb1.data, nb2.data, op[0]);
+    if (isnan(nb))
+        return 0;
+    if (nb >= 9223372036854775807.0)
+        return INT64_MAX;
+    if (nb <= -9223372036854775808.0)
+        return INT64_MIN;
+    return nb;
 }
 
-struct stack *stack_add(struct stack *s, struct token_stack t)
+int compute_real(enum type type, double nb1, double nb2, double *res)
 {
-    struct stack *new = malloc(sizeof(struct stack));
-    if (!new)
-        return NULL;
-    new->data = t;
-    new->next = s;
-    return new;
+    int64_t integer;
+    switch (type)
+    {
+    case ADD:
+        *res = nb1 + nb2;
+        return 0;
+    case MINUS:
+        *res = nb1 - nb2;
+        return 0;
+    case MULT:
+        *res = nb1 * nb2;
+        return 0;
+    case DIV:
+        if (nb2 == 0)
+            return -1;
+        *res = nb1 / nb2;
+        return 0;
+    case MOD:
+        if (nb2 == 0)
+            return -1;
+        *res = fmod(nb1, nb2);
+        return 0;
+    case DOUBLE_STAR:
+        *res = pow(nb1, nb2);
+        return 0;
+    case LESS:
+        *res = nb1 < nb2;
+        return 0;
+    case LESS_EQUAL:
+        *res = nb1 <= nb2;
+        return 0;
+    case GREATER:
+        *res = nb1 > nb2;
+        return 0;
+    case GREATER_EQUAL:
+        *res = nb1 >= nb2;
+        return 0;
+    case EQUAL:
+        *res = nb1 == nb2;
+        return 0;
+    case NOT_EQUAL:
+        *res = nb1 != nb2;
+        return 0;
+    case LOGICAL_AND:
+        *res = nb1 != 0 && nb2 != 0;
+        return 0;
+    case LOGICAL_OR:
+        *res = nb1 != 0 || nb2 != 0;
+        return 0;
+    default:
+        if (compute(type, real_to_int(nb1), real_to_int(nb2), &integer) == -1)
+            return -1;
+        *res = integer;
+        return 0;
+    }
 }
 
-struct stack *stack_pop(struct stack *s)
+double compute_unary_real(enum type type, double nb)
 {
-    if (s == NULL)
-        return NULL;
-    struct stack *res = s->next;
-    free(s);
-    return res;
+    switch (type)
+    {
+    case UMINUS:
+        return -nb;
+    case NOT:
+        return nb == 0;
+    case TILDE:
+        return ~real_to_int(nb);
+    case BOOL:
+        return nb != 0;
+    default:
+        return nb;
+    }
 }
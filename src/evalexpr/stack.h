@@ -1,60 +1,176 @@
 #ifndef STACK_H
 #define STACK_H
 
-#include "eval_exp.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * \brief Maximum depth of the evaluation stack
+ * Expressions needing more are rejected when compiled
+ */
+#define STACK_SIZE 64
 
 /*
-** Enum sorted in priority order
-** Make a division per 10 to get the priority order
+** Operations of the compiled arithmetic bytecode
+** Binary operators are sorted by priority, see op_priority
 */
 enum type
 {
-    MINUS = 0,
-    ADD = 1,
-    MOD = 10,
-    DIV = 11,
-    MULT = 12,
-    BINARY_AND = 13,
-    BINARY_OR = 14,
-    LOGICAL_AND = 15,
-    LOGICAL_OR = 16,
-    NOT = 17,
-    POW = 20,
-    DOUBLE_STAR = 21,
-    UMINUS = 30,
-    UPLUS = 31,
-    TILDE = 32,
-    PCLOSE = 40,
-    POPEN = 41,
-    NB
+    NB,
+    LOGICAL_OR,
+    LOGICAL_AND,
+    BINARY_OR,
+    BINARY_XOR,
+    BINARY_AND,
+    EQUAL,
+    NOT_EQUAL,
+    LESS,
+    LESS_EQUAL,
+    GREATER,
+    GREATER_EQUAL,
+    LEFT_SHIFT,
+    RIGHT_SHIFT,
+    ADD,
+    MINUS,
+    MULT,
+    DIV,
+    MOD,
+    DOUBLE_STAR,
+    UMINUS,
+    UPLUS,
+    NOT,
+    TILDE,
+    JUMP_AND,
+    JUMP_OR,
+    JUMP_FALSE,
+    JUMP,
+    BOOL,
+    POP,
+    VAR,
+    ASSIGN,
+    PRE_INC,
+    PRE_DEC,
+    POST_INC,
+    POST_DEC,
+    POPEN,
+    PCLOSE,
+    NONE_OP
 };
 
+/**
+ * \brief An instruction of the bytecode
+ * @details data is the value pushed by NB (the bits of a double in floating
+ * point programs), the target of jumps and the variable index of variable
+ * operations
+ */
 struct token_stack
 {
     enum type type;
-    int data;
+    int64_t data;
 };
 
+/**
+ * \brief Fixed size evaluation stack
+ */
 struct stack
 {
-    struct token_stack data;
-    struct stack *next;
+    int64_t data[STACK_SIZE];
+    size_t size;
 };
 
-// Return a token_stack according to its operator
-struct token_stack token_op(char *op);
+/**
+ * \brief Fixed size evaluation stack of floating point programs
+ */
+struct real_stack
+{
+    double data[STACK_SIZE];
+    size_t size;
+};
+
+/**
+ * \brief Return the operator starting at op, NONE_OP if there is none
+ * @param len: set to the length of the operator
+ */
+enum type token_op(const char *op, size_t *len);
+
+/**
+ * \brief Return the assignment operator starting at op
+ * @return: NB for '=', the binary operator of a compound assignment,
+ * NONE_OP if there is no assignment operator
+ */
+enum type assign_op(const char *op, size_t *len);
+
+/**
+ * \brief Return the priority of a binary operator, 0 if it is not one
+ */
+int op_priority(enum type type);
+
+/**
+ * \brief Return if the binary operator is right associative
+ */
+int op_right_assoc(enum type type);
+
+/**
+ * \brief Compute a binary operation with wrapping 64 bits semantics
+ * Return 0 on success, -1 on error (division by zero, negative exponent)
+ */
+int compute(enum type type, int64_t nb1, int64_t nb2, int64_t *res);
+
+/**
+ * \brief Compute an unary operation
+ */
+int64_t compute_unary(enum type type, int64_t nb);
+
+/**
+ * \brief Compute a binary operation on floating point numbers
+ * Bitwise operators and shifts work on the integer parts
+ * Return 0 on success, -1 on error (division by zero)
+ */
+int compute_real(enum type type, double nb1, double nb2, double *res);
 
-// Return the operator of a token_stack
-char *char_op(struct token_stack);
+/**
+ * \brief Compute an unary operation on a floating point number
+ */
+double compute_unary_real(enum type type, double nb);
 
-// 0 if t1 = t2, 1 if t1>t2, -1 otherwise
-int compute(struct token_stack t1, struct token_stack t2, char *op);
+/**
+ * \brief Convert to an integer, saturating out of range values
+ */
+int64_t real_to_int(double nb);
 
-// Add an element in the stack and return the new head, NULL return new stack
-struct stack *stack_add(struct stack *s, struct token_stack);
+static inline double bits_to_real(int64_t bits)
+{
+    double nb;
+    memcpy(&nb, &bits, sizeof(nb));
+    return nb;
+}
+
+static inline int64_t real_to_bits(double nb)
+{
+    int64_t bits;
+    memcpy(&bits, &nb, sizeof(bits));
+    return bits;
+}
+
+static inline void stack_add(struct stack *s, int64_t nb)
+{
+    s->data[s->size++] = nb;
+}
 
-// Pop the head of the stack and return the new head
-// Carreful ! Need to save the head before pop
-struct stack *stack_pop(struct stack *s);
+static inline int64_t stack_pop(struct stack *s)
+{
+    return s->data[--s->size];
+}
+
+static inline void real_stack_add(struct real_stack *s, double nb)
+{
+    s->data[s->size++] = nb;
+}
+
+static inline double real_stack_pop(struct real_stack *s)
+{
+    return s->data[--s->size];
+}
 
 #endif
@@ -41,11 +41,17 @@ static int is_redir(char *str)
 {
     size_t i = 0;
     int quotes = 0;
+    int depth = 0;
     while (str[i] != '\0')
     {
         if (str[i] == '\'')
             quotes++;
-        if (str[i] == '<' || str[i] == '>')
+        // '<' and '>' of a substitution are not redirections of the word
+        else if (str[i] == '(' && (depth > 0 || (i > 0 && str[i - 1] == '$')))
+            depth++;
+        else if (str[i] == ')' && depth > 0)
+            depth--;
+        else if (depth == 0 && (str[i] == '<' || str[i] == '>'))
         {
             if (quotes == 1)
                 return 0;
@@ -134,10 +140,16 @@ static size_t get_redir_idx(struct lexer *lexer, size_t len)
 {
     size_t i = lexer->pos;
     int quote = 0;
-    while (i < len && lexer->input[i] != '>' && lexer->input[i] != '<')
+    int depth = 0;
+    char *input = lexer->input;
+    while (i < len && (depth > 0 || (input[i] != '>' && input[i] != '<')))
     {
-        if (lexer->input[i] == '\'')
+        if (input[i] == '\'')
             quote++;
+        else if (input[i] == '(' && (depth > 0 || (i > 0 && input[i - 1] == '$')))
+            depth++;
+        else if (input[i] == ')' && depth > 0)
+            depth--;
         i++;
     }
     if (quote == 1 && i != len) // Quoted '<' '>'
@@ -202,14 +214,19 @@ static int get_substr(struct lexer *lexer, struct vec *vec, size_t *len)
 
         if (current == ')' || current == '(')
         {
-            if (current == '(')
-                ++sub;
-            else if (current == ')')
-                --sub;
-            if (lexer->input[lexer->pos - 1] == '$' || (arithmetic && !sub))
-                arithmetic = !arithmetic;
-            else if (!arithmetic)
+            // $( opens a substitution, =( the words of an array
+            int opening = current == '(' && lexer->pos > 0
+                && (lexer->input[lexer->pos - 1] == '$'
+                    || lexer->input[lexer->pos - 1] == '=');
+            // A parenthesis outside a substitution ends the word, it must
+            // not be counted
+            if (!arithmetic && !opening)
                 break;
+            sub += current == '(' ? 1 : -1;
+            if (opening)
+                arithmetic = 1;
+            else if (!sub)
+                arithmetic = 0;
         }
         if (arithmetic)
         {
@@ -254,6 +271,34 @@ static int get_substr(struct lexer *lexer, struct vec *vec, size_t *len)
     return quote;
 }
 
+/**
+ * \brief: Lex an arithmetic command `(( expression ))`.
+ * @return value: the token holding the expression, NULL if the parentheses
+ *                are not closed by "))" (nested subshells)
+ */
+static struct token *get_arith(struct lexer *lexer, size_t len)
+{
+    size_t begin = lexer->pos + 2;
+    int depth = 0;
+    for (size_t i = begin; i < len; i++)
+    {
+        if (lexer->input[i] == '(')
+            depth++;
+        else if (lexer->input[i] == ')' && depth > 0)
+            depth--;
+        else if (lexer->input[i] == ')')
+        {
+            if (lexer->input[i + 1] != ')')
+                return NULL;
+            struct token *tok = token_create(TOKEN_ARITH);
+            tok->value = strndup(lexer->input + begin, i - begin);
+            lexer->pos = i + 2;
+            return tok;
+        }
+    }
+    return NULL;
+}
+
 /**
  * \brief: Return a lexed a token in input.
  * Fill the value of the token.
@@ -267,6 +312,12 @@ struct token *get_token(struct lexer *lexer)
         lexer->pos++;
     if (lexer->pos >= input_len)
         return token_create(TOKEN_EOF);
+    if (strncmp(lexer->input + lexer->pos, "((", 2) == 0)
+    {
+        struct token *arith = get_arith(lexer, input_len);
+        if (arith)
+            return arith;
+    }
     struct vec *vec = vec_init();
     int quote = get_substr(lexer, vec, &input_len);
     struct token *tok = NULL;
@@ -278,8 +329,7 @@ struct token *get_token(struct lexer *lexer)
         tok = token_create(match_token(sub_str, quote));
         tok->value = strdup(sub_str);
     }
-    vec_destroy(vec);
-    free(vec);
+    vec_free(vec);
     return tok;
 }
 
@@ -2,9 +2,10 @@
 
 #include <string.h>
 #include <utils/alloc.h>
+#include <utils/slab.h>
 struct token *token_create(enum token_type type)
 {
-    struct token *new = zalloc(sizeof(struct token));
+    struct token *new = slab_alloc(SLAB_TOKEN, sizeof(struct token));
     new->type = type;
     new->value = NULL;
     return new;
@@ -14,7 +15,7 @@ void token_free(struct token *token)
 {
     if (token->value != NULL)
         free(token->value);
-    free(token);
+    slab_free(SLAB_TOKEN, token, sizeof(struct token));
 }
 
 struct token *token_dup(struct token *tok)
@@ -41,7 +41,8 @@ enum token_type
     TOKEN_EXIT = 29,
     TOKEN_EXPORT = 30,
     TOKEN_DOT = 31,
-    TOKEN_ERROR = 32
+    TOKEN_ERROR = 32,
+    TOKEN_ARITH = 33
 };
 
 /**
@@ -7,6 +7,7 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
+#include <utils/slab.h>
 #include <utils/utils.h>
 #include <utils/vec.h>
 
@@ -108,8 +109,7 @@ static enum parser_state parse_element(struct parser *parser, struct ast **ast)
                 tmp->capacity = tmp->size + 1;
                 vec_push(tmp, ' ');
                 (*ast)->val = vec_concat((*ast)->val, tmp);
-                vec_destroy(tmp);
-                free(tmp);
+                vec_free(tmp);
             }
 
             tok = lexer_pop(parser->lexer);
@@ -130,8 +130,7 @@ static enum parser_state parse_element(struct parser *parser, struct ast **ast)
         tmp->size = strlen(tok->value);
         tmp->capacity = tmp->size + 1;
         (*ast)->val = vec_concat((*ast)->val, tmp);
-        vec_destroy(tmp);
-        free(tmp);
+        vec_free(tmp);
         tok = lexer_pop(parser->lexer);
         token_free(tok);
         tok = lexer_peek(parser->lexer);
@@ -220,6 +219,12 @@ static enum parser_state parse_simple_command(struct parser *parser,
             return PARSER_PANIC;
         return PARSER_ABSENT;
     }
+    if (new->val)
+    {
+        arithmetic_compile(new->val->data, &new->arith);
+        if (new->type == AST_CMD)
+            new->name = cmd_literal_name(new->val->data);
+    }
     *ast = new;
     if (neg)
     {
@@ -427,9 +432,80 @@ static enum parser_state parse_do_group(struct parser *parser, struct ast **ast)
     return PARSER_OK;
 }
 
+/**
+ * \brief Split the clauses of `for (( init; cond; step ))`
+ * @return: 0 on success, -1 if there are not exactly three clauses
+ */
+static int split_for_clauses(struct ast *for_node, char *str)
+{
+    int depth = 0;
+    size_t begin = 0;
+    for (size_t i = 0; str[i] != '\0'; i++)
+    {
+        if (str[i] == '(')
+            depth++;
+        else if (str[i] == ')' && depth > 0)
+            depth--;
+        else if (str[i] == ';' && depth == 0)
+        {
+            if (for_node->size == 2)
+                return -1;
+            str[i] = '\0';
+            add_to_list(for_node, str + begin);
+            str[i] = ';';
+            begin = i + 1;
+        }
+    }
+    if (for_node->size != 2)
+        return -1;
+    add_to_list(for_node, str + begin);
+    return 0;
+}
+
+static enum parser_state parse_rule_for_arith(struct parser *parser,
+                                              struct ast **ast)
+{
+    struct token *tok = lexer_pop(parser->lexer);
+    struct ast *for_node = create_ast(AST_FOR_ARITH);
+    int error = split_for_clauses(for_node, tok->value);
+    token_free(tok);
+    if (error == -1)
+    {
+        ast_free(for_node);
+        return PARSER_PANIC;
+    }
+    tok = lexer_peek(parser->lexer);
+    if (tok->type == TOKEN_SEMIC)
+    {
+        lexer_pop(parser->lexer);
+        token_free(tok);
+    }
+    while ((tok = lexer_peek(parser->lexer))->type == TOKEN_NEWL)
+    {
+        lexer_pop(parser->lexer);
+        token_free(tok);
+    }
+    if (tok->type == TOKEN_ERROR)
+    {
+        ast_free(for_node);
+        return PARSER_PANIC;
+    }
+    (*ast) = for_node;
+
+    enum parser_state state = parse_do_group(parser, &((*ast)->left));
+    if (state != PARSER_OK)
+    {
+        ast_free(*ast);
+        return state;
+    }
+    return PARSER_OK;
+}
+
 static enum parser_state parse_rule_for(struct parser *parser, struct ast **ast)
 {
     struct token *tok = lexer_peek(parser->lexer);
+    if (tok->type == TOKEN_ARITH)
+        return parse_rule_for_arith(parser, ast);
     if (tok->type != TOKEN_WORD)
         return PARSER_PANIC;
     struct ast *for_node = create_ast(AST_FOR);
@@ -448,7 +524,7 @@ static enum parser_state parse_rule_for(struct parser *parser, struct ast **ast)
     }
     if (tok->type == TOKEN_SEMIC)
     {
-        add_to_list(for_node, "$@");
+        add_to_list(for_node, "\"$@\"");
         lexer_pop(parser->lexer);
         token_free(tok);
     }
@@ -612,8 +688,7 @@ static enum parser_state parse_cmdblocks(struct parser *parser,
         token_free(tok);
         lexer_pop(parser->lexer); // skip ')'
         ast_free(subs);
-        vec_destroy(vec);
-        free(vec);
+        vec_free(vec);
         return PARSER_PANIC;
     }
     if (tok->type == TOKEN_CLOSE_BRAC)
@@ -656,6 +731,7 @@ static enum parser_state parse_rule_case(struct parser *parser,
     }
 
     int last = 0;
+    size_t arm_index = 0;
     while ((tok = lexer_peek(parser->lexer))->type != TOKEN_ESAC)
     {
         if (last == 1)
@@ -675,9 +751,9 @@ static enum parser_state parse_rule_case(struct parser *parser,
             ast_free(new);
             return PARSER_PANIC;
         }
-        struct cas *cas = zalloc(sizeof(struct cas));
-        cas->pattern = zalloc(sizeof(char) * (strlen(tok->value) + 4));
-        sprintf(cas->pattern, "+(%s", tok->value);
+        struct cas *cas = slab_alloc(SLAB_CASE, sizeof(struct cas));
+        cas->pattern = strdup(tok->value);
+        case_add_pattern(new, cas, arm_index, tok->value);
 
         lexer_pop(parser->lexer);
         token_free(tok);
@@ -695,16 +771,16 @@ static enum parser_state parse_rule_case(struct parser *parser,
                 return PARSER_PANIC;
             }
 
-            cas->pattern = realloc(
+            cas->pattern = xrealloc(
                 cas->pattern,
-                sizeof(char) * (strlen(cas->pattern) + strlen(tok->value) + 4));
+                sizeof(char) * (strlen(cas->pattern) + strlen(tok->value) + 2));
             strcat(cas->pattern, "|");
             strcat(cas->pattern, tok->value);
+            case_add_pattern(new, cas, arm_index, tok->value);
 
             lexer_pop(parser->lexer);
             token_free(tok);
         }
-        strcat(cas->pattern, ")");
 
         tok = lexer_peek(parser->lexer);
         if (tok->type != TOKEN_CLOSE_PAR)
@@ -750,6 +826,7 @@ static enum parser_state parse_rule_case(struct parser *parser,
         }
         else
             new->cas = cas;
+        arm_index++;
     }
     lexer_pop(parser->lexer);
     token_free(tok);
@@ -758,10 +835,26 @@ static enum parser_state parse_rule_case(struct parser *parser,
     return PARSER_OK;
 }
 
+// Parse an arithmetic command (( expression ))
+static enum parser_state parse_arith(struct parser *parser, struct ast **ast)
+{
+    struct token *tok = lexer_pop(parser->lexer);
+    struct ast *arith = create_ast(AST_ARITH);
+    arith->val = vec_init();
+    arith->val->data = strdup(tok->value);
+    arith->val->size = strlen(tok->value);
+    arith->val->capacity = arith->val->size + 1;
+    token_free(tok);
+    *ast = arith;
+    return PARSER_OK;
+}
+
 static enum parser_state parse_shell_command(struct parser *parser,
                                              struct ast **ast)
 {
     struct token *tok = lexer_peek(parser->lexer);
+    if (tok->type == TOKEN_ARITH)
+        return parse_arith(parser, ast);
     if (tok->type == TOKEN_OPEN_PAR)
     {
         enum parser_state state = parse_subshells(parser, ast);
@@ -826,8 +919,7 @@ static enum parser_state parse_funcdec(struct parser *parser, struct ast **ast)
     if (tok->type != TOKEN_OPEN_PAR)
     {
         ast_free(fun_node);
-        vec_destroy(vec);
-        free(vec);
+        vec_free(vec);
         return PARSER_ABSENT;
     }
     // Skip '('
@@ -837,8 +929,7 @@ static enum parser_state parse_funcdec(struct parser *parser, struct ast **ast)
     if (tok->type != TOKEN_CLOSE_PAR)
     {
         ast_free(fun_node);
-        vec_destroy(vec);
-        free(vec);
+        vec_free(vec);
         return PARSER_PANIC;
     }
     // Skip ')'
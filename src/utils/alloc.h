@@ -30,3 +30,7 @@ static inline void *__malloc __alloc_size(1) zalloc(size_t size)
     memset(res, 0, size);
     return res;
 }
+
+#ifdef ALLOC_STATS
+#    include <utils/alloc_stats.h>
+#endif
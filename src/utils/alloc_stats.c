@@ -0,0 +1,323 @@
+#define ALLOC_STATS_IMPL
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <utils/alloc_stats.h>
+#include <utils/slab.h>
+
+#define SITES_MAX 64
+#define TABLE_MIN 1024
+
+/**
+ * \brief An allocation in flight, so that free knows its size and module
+ * @details ptr is NULL for empty slots of the table
+ */
+struct alloc_entry
+{
+    void *ptr;
+    size_t size;
+    enum alloc_tag tag;
+};
+
+/**
+ * \brief The allocations in flight, by open addressing on their address
+ * @details The table, the counters and the sites are shared with the
+ * threads of the directory walker, under lock
+ */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct alloc_entry *table = NULL;
+static size_t table_capacity = 0;
+static size_t table_count = 0;
+
+static struct alloc_counter counters[ALLOC_TAGS_NB];
+
+/**
+ * \brief The tags of the files already seen, __FILE__ being the same
+ * string for all the call sites of a file
+ */
+static struct
+{
+    const char *file;
+    enum alloc_tag tag;
+} sites[SITES_MAX];
+static size_t sites_nb = 0;
+
+static const char *tag_names[ALLOC_TAGS_NB] = {
+    "lexer",    "parser",   "expansion", "vars",
+    "evalexpr", "builtins", "execution", "other"
+};
+
+static char *output_path = NULL;
+static pid_t output_pid = -1;
+
+// Nothing is recorded unless --alloc-stats asked for the summary
+static int enabled = 0;
+
+static const struct
+{
+    const char *file;
+    enum alloc_tag tag;
+} ast_files[] = {
+    { "vars.c", ALLOC_VARS },      { "array.c", ALLOC_VARS },
+    { "params.c", ALLOC_VARS },    { "brace.c", ALLOC_EXPANSION },
+    { "glob.c", ALLOC_EXPANSION }, { "split.c", ALLOC_EXPANSION },
+    { "subshell.c", ALLOC_EXPANSION },
+};
+
+static int dir_is(const char *dir, size_t len, const char *name)
+{
+    return strlen(name) == len && strncmp(dir, name, len) == 0;
+}
+
+// Find the module of a source file from its directory, and its name for
+// the files of src/ast
+static enum alloc_tag classify(const char *file)
+{
+    const char *name = strrchr(file, '/');
+    if (name == NULL)
+        return ALLOC_OTHER;
+    const char *dir = name;
+    while (dir > file && dir[-1] != '/')
+        dir--;
+    size_t len = name++ - dir;
+    if (dir_is(dir, len, "lexer"))
+        return ALLOC_LEXER;
+    if (dir_is(dir, len, "parser"))
+        return ALLOC_PARSER;
+    if (dir_is(dir, len, "evalexpr"))
+        return ALLOC_EVALEXPR;
+    if (dir_is(dir, len, "builtins"))
+        return ALLOC_BUILTINS;
+    if (!dir_is(dir, len, "ast"))
+        return ALLOC_OTHER;
+    for (size_t i = 0; i < sizeof(ast_files) / sizeof(*ast_files); i++)
+    {
+        if (strcmp(name, ast_files[i].file) == 0)
+            return ast_files[i].tag;
+    }
+    return ALLOC_EXECUTION;
+}
+
+static enum alloc_tag site_tag(const char *file)
+{
+    for (size_t i = 0; i < sites_nb; i++)
+    {
+        if (sites[i].file == file)
+            return sites[i].tag;
+    }
+    enum alloc_tag tag = classify(file);
+    if (sites_nb < SITES_MAX)
+    {
+        sites[sites_nb].file = file;
+        sites[sites_nb++].tag = tag;
+    }
+    return tag;
+}
+
+static size_t slot_of(const void *ptr, size_t capacity)
+{
+    uintptr_t hash = (uintptr_t)ptr;
+    hash ^= hash >> 17;
+    hash *= (uintptr_t)0x9e3779b97f4a7c15ULL;
+    return (hash >> 7) & (capacity - 1);
+}
+
+static size_t table_find(const void *ptr)
+{
+    size_t i = slot_of(ptr, table_capacity);
+    while (table[i].ptr != NULL && table[i].ptr != ptr)
+        i = (i + 1) & (table_capacity - 1);
+    return i;
+}
+
+static void table_grow(void)
+{
+    struct alloc_entry *old = table;
+    size_t old_capacity = table_capacity;
+    table_capacity = old_capacity ? old_capacity * 2 : TABLE_MIN;
+    table = calloc(table_capacity, sizeof(struct alloc_entry));
+    if (table == NULL)
+        abort();
+    for (size_t i = 0; i < old_capacity; i++)
+    {
+        if (old[i].ptr != NULL)
+            table[table_find(old[i].ptr)] = old[i];
+    }
+    free(old);
+}
+
+// Forget the allocation of ptr, moving back the entries of its cluster
+// which could not take their own slot
+static void table_remove(size_t i)
+{
+    struct alloc_entry *removed = &table[i];
+    counters[removed->tag].live -= removed->size;
+    removed->ptr = NULL;
+    table_count--;
+    size_t hole = i;
+    for (size_t j = (i + 1) & (table_capacity - 1); table[j].ptr != NULL;
+         j = (j + 1) & (table_capacity - 1))
+    {
+        size_t home = slot_of(table[j].ptr, table_capacity);
+        // Move the entry if its home slot is not between the hole and it
+        if ((j > hole && (home <= hole || home > j))
+            || (j < hole && home <= hole && home > j))
+        {
+            table[hole] = table[j];
+            table[j].ptr = NULL;
+            hole = j;
+        }
+    }
+}
+
+static void record(const char *file, void *ptr, size_t size)
+{
+    if (ptr == NULL || !enabled)
+        return;
+    pthread_mutex_lock(&lock);
+    if ((table_count + 1) * 2 > table_capacity)
+        table_grow();
+    size_t i = table_find(ptr);
+    // A pointer freed without going through alloc_stats_free, by a file
+    // which does not include alloc.h, may be returned again
+    if (table[i].ptr != NULL)
+    {
+        table_remove(i);
+        i = table_find(ptr);
+    }
+    enum alloc_tag tag = site_tag(file);
+    table[i].ptr = ptr;
+    table[i].size = size;
+    table[i].tag = tag;
+    table_count++;
+    struct alloc_counter *counter = &counters[tag];
+    counter->count++;
+    counter->bytes += size;
+    counter->live += size;
+    if (counter->live > counter->peak)
+        counter->peak = counter->live;
+    pthread_mutex_unlock(&lock);
+}
+
+static void forget(void *ptr)
+{
+    if (ptr == NULL || !enabled)
+        return;
+    pthread_mutex_lock(&lock);
+    if (table != NULL)
+    {
+        size_t i = table_find(ptr);
+        if (table[i].ptr != NULL)
+            table_remove(i);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void *alloc_stats_malloc(const char *file, size_t size)
+{
+    void *res = malloc(size);
+    if (res == NULL && size != 0)
+        abort();
+    record(file, res, size);
+    return res;
+}
+
+void *alloc_stats_zalloc(const char *file, size_t size)
+{
+    void *res = alloc_stats_malloc(file, size);
+    memset(res, 0, size);
+    return res;
+}
+
+void *alloc_stats_realloc(const char *file, void *ptr, size_t size)
+{
+    forget(ptr);
+    void *res = realloc(ptr, size);
+    if (res == NULL && size != 0)
+        abort();
+    record(file, res, size);
+    return res;
+}
+
+char *alloc_stats_strdup(const char *file, const char *str)
+{
+    size_t len = strlen(str);
+    char *res = alloc_stats_malloc(file, len + 1);
+    return memcpy(res, str, len + 1);
+}
+
+char *alloc_stats_strndup(const char *file, const char *str, size_t len)
+{
+    size_t i = 0;
+    while (i < len && str[i] != '\0')
+        i++;
+    char *res = alloc_stats_malloc(file, i + 1);
+    memcpy(res, str, i);
+    res[i] = '\0';
+    return res;
+}
+
+void alloc_stats_free(void *ptr)
+{
+    forget(ptr);
+    free(ptr);
+}
+
+const struct alloc_counter *alloc_stats_counter(enum alloc_tag tag)
+{
+    return &counters[tag];
+}
+
+void alloc_stats_print(FILE *out)
+{
+    struct alloc_counter total = { 0, 0, 0, 0 };
+    fprintf(out, "%-12s %12s %14s %14s %14s\n", "module", "allocations",
+            "bytes", "live bytes", "peak bytes");
+    for (size_t i = 0; i < ALLOC_TAGS_NB; i++)
+    {
+        const struct alloc_counter *c = &counters[i];
+        fprintf(out, "%-12s %12zu %14zu %14zu %14zu\n", tag_names[i],
+                c->count, c->bytes, c->live, c->peak);
+        total.count += c->count;
+        total.bytes += c->bytes;
+        total.live += c->live;
+    }
+    // The peaks of the modules are not simultaneous, so they are not summed
+    fprintf(out, "%-12s %12zu %14zu %14zu\n", "total", total.count,
+            total.bytes, total.live);
+    fputc('\n', out);
+    slab_print_stats(out);
+}
+
+static void print_at_exit(void)
+{
+    if (getpid() != output_pid)
+        return;
+    FILE *out = stderr;
+    if (output_path != NULL)
+    {
+        out = fopen(output_path, "w");
+        if (out == NULL)
+        {
+            perror(output_path);
+            return;
+        }
+    }
+    alloc_stats_print(out);
+    if (out != stderr)
+        fclose(out);
+}
+
+void alloc_stats_enable(const char *path)
+{
+    enabled = 1;
+    if (output_pid == -1)
+        atexit(print_at_exit);
+    output_pid = getpid();
+    free(output_path);
+    output_path = path ? strdup(path) : NULL;
+}
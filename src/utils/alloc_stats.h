@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * \page Allocation statistics
+ *
+ * When 42sh is configured with -Dalloc_stats=true, xmalloc, zalloc,
+ * xrealloc, strdup, strndup and free are redirected here. Each allocation
+ * is tagged with the module of the file which made it, and a summary of
+ * the allocations of each module is printed at exit if 42sh was run with
+ * --alloc-stats. Other builds do not include this header at all.
+ */
+
+/**
+ * \brief The modules allocations are accounted to
+ */
+enum alloc_tag
+{
+    ALLOC_LEXER,
+    ALLOC_PARSER,
+    ALLOC_EXPANSION,
+    ALLOC_VARS,
+    ALLOC_EVALEXPR,
+    ALLOC_BUILTINS,
+    ALLOC_EXECUTION,
+    ALLOC_OTHER,
+    ALLOC_TAGS_NB
+};
+
+/**
+ * \brief The allocations of one module
+ * @param count: the number of allocations, reallocations included
+ * @param bytes: the bytes requested by them
+ * @param live: the bytes currently allocated
+ * @param peak: the most bytes ever allocated at once
+ */
+struct alloc_counter
+{
+    size_t count;
+    size_t bytes;
+    size_t live;
+    size_t peak;
+};
+
+void *alloc_stats_malloc(const char *file, size_t size);
+void *alloc_stats_zalloc(const char *file, size_t size);
+void *alloc_stats_realloc(const char *file, void *ptr, size_t size);
+char *alloc_stats_strdup(const char *file, const char *str);
+char *alloc_stats_strndup(const char *file, const char *str, size_t len);
+void alloc_stats_free(void *ptr);
+
+/** \brief Return the counter of the allocations of a module */
+const struct alloc_counter *alloc_stats_counter(enum alloc_tag tag);
+
+/**
+ * \brief Record the allocations made from now on and print their summary at
+ * exit, to path or to stderr if it is NULL
+ * @details Only the process which called it prints, not its children
+ */
+void alloc_stats_enable(const char *path);
+
+/** \brief Print the allocations of each module and the slab counters */
+void alloc_stats_print(FILE *out);
+
+// The allocator itself calls the real functions
+#ifndef ALLOC_STATS_IMPL
+#    undef strdup
+#    undef strndup
+#    define xmalloc(size) alloc_stats_malloc(__FILE__, (size))
+#    define zalloc(size) alloc_stats_zalloc(__FILE__, (size))
+#    define xrealloc(ptr, size) alloc_stats_realloc(__FILE__, (ptr), (size))
+#    define strdup(str) alloc_stats_strdup(__FILE__, (str))
+#    define strndup(str, len) alloc_stats_strndup(__FILE__, (str), (len))
+#    define free(ptr) alloc_stats_free(ptr)
+#endif
@@ -0,0 +1,89 @@
+#include <stddef.h>
+#include <string.h>
+#include <utils/alloc.h>
+#include <utils/arena.h>
+
+// Enough for any fundamental type on the supported platforms
+#define ARENA_ALIGN 16
+
+// The data of a block starts at the first aligned address after its header
+#define BLOCK_HEADER                                                           \
+    ((sizeof(struct arena_block) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+static char *block_data(struct arena_block *block)
+{
+    return (char *)block + BLOCK_HEADER;
+}
+
+// Return a block of at least size bytes following the current one, reusing
+// the kept blocks which are large enough
+static struct arena_block *arena_next(struct arena *arena, size_t size)
+{
+    struct arena_block **link = arena->block ? &arena->block->next
+                                             : &arena->first;
+    while (*link && (*link)->size < size)
+    {
+        // Too small for this allocation: free it, a larger one replaces it
+        struct arena_block *small = *link;
+        *link = small->next;
+        free(small);
+    }
+    if (*link)
+        return *link;
+    size_t block_size = arena->block ? arena->block->size * 2
+                                     : ARENA_BLOCK_SIZE;
+    while (block_size < size)
+        block_size *= 2;
+    struct arena_block *block = xmalloc(BLOCK_HEADER + block_size);
+    block->next = NULL;
+    block->size = block_size;
+    *link = block;
+    return block;
+}
+
+void *arena_alloc(struct arena *arena, size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if (!arena->block || arena->block->size - arena->used < size)
+    {
+        arena->block = arena_next(arena, size);
+        arena->used = 0;
+    }
+    void *res = block_data(arena->block) + arena->used;
+    arena->used += size;
+    return res;
+}
+
+char *arena_strndup(struct arena *arena, const char *str, size_t len)
+{
+    char *res = arena_alloc(arena, len + 1);
+    memcpy(res, str, len);
+    res[len] = '\0';
+    return res;
+}
+
+struct arena_mark arena_mark(struct arena *arena)
+{
+    struct arena_mark mark = { arena->block, arena->used };
+    return mark;
+}
+
+void arena_release(struct arena *arena, struct arena_mark mark)
+{
+    arena->block = mark.block;
+    arena->used = mark.used;
+}
+
+void arena_destroy(struct arena *arena)
+{
+    struct arena_block *block = arena->first;
+    while (block)
+    {
+        struct arena_block *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->first = NULL;
+    arena->block = NULL;
+    arena->used = 0;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * \brief Size of the first block of an arena, the next ones doubling
+ */
+#define ARENA_BLOCK_SIZE 4096
+
+/**
+ * \brief A block of memory of an arena, its data following the header
+ */
+struct arena_block
+{
+    struct arena_block *next;
+    size_t size;
+};
+
+/**
+ * \brief A bump pointer allocator, whose allocations are only released
+ * together
+ * @details The blocks are kept when the arena is released, so that an
+ * arena used the same way again does not allocate anymore
+ */
+struct arena
+{
+    struct arena_block *first;
+    struct arena_block *block;
+    size_t used;
+};
+
+/**
+ * \brief A position in an arena, to release what was allocated after it
+ */
+struct arena_mark
+{
+    struct arena_block *block;
+    size_t used;
+};
+
+/**
+ * \brief Allocate size bytes aligned for any type, which stay valid until
+ * the arena is released past them
+ */
+void *arena_alloc(struct arena *arena, size_t size);
+
+/** \brief Copy the len first characters of str in the arena */
+char *arena_strndup(struct arena *arena, const char *str, size_t len);
+
+/** \brief Return the current position of the arena */
+struct arena_mark arena_mark(struct arena *arena);
+
+/** \brief Release everything allocated after mark, keeping the blocks */
+void arena_release(struct arena *arena, struct arena_mark mark);
+
+/** \brief Free the blocks of the arena */
+void arena_destroy(struct arena *arena);
@@ -0,0 +1,357 @@
+#ifdef __linux__
+#    define _GNU_SOURCE
+#    include <sys/syscall.h>
+#endif
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utils/alloc.h>
+#include <utils/dirwalk.h>
+
+/**
+ * \brief Size of the buffer directory entries are read in
+ */
+#define WALK_BUF_SIZE 32768
+
+/**
+ * \brief A growable array of paths
+ */
+struct walk_paths
+{
+    char **data;
+    size_t size;
+    size_t capacity;
+};
+
+/**
+ * \brief The directories waiting to be read by a worker
+ * @details The owner pushes and pops at the tail, the other workers steal
+ * from the head
+ */
+struct walk_deque
+{
+    char **jobs;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+    pthread_mutex_t lock;
+};
+
+/**
+ * \brief State shared by the workers of a walk
+ * @details pending counts the directories queued or being read, the walk is
+ * over when it drops to zero. pushes changes each time directories are
+ * queued, idle workers wait for it to change.
+ */
+struct walker
+{
+    int root_fd;
+    enum walk_mode mode;
+    size_t nb_workers;
+    struct walk_deque *deques;
+    struct walk_paths *results;
+    size_t pending;
+    size_t pushes;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+struct walk_worker
+{
+    struct walker *walker;
+    size_t id;
+};
+
+static void paths_add(struct walk_paths *paths, char *path)
+{
+    if (paths->size >= paths->capacity)
+    {
+        paths->capacity = paths->capacity ? paths->capacity * 2 : 64;
+        paths->data = xrealloc(paths->data, paths->capacity * sizeof(char *));
+    }
+    paths->data[paths->size++] = path;
+}
+
+static void deque_push(struct walk_deque *deque, char *job)
+{
+    pthread_mutex_lock(&deque->lock);
+    if (deque->tail >= deque->capacity)
+    {
+        deque->capacity = deque->capacity ? deque->capacity * 2 : 64;
+        deque->jobs = xrealloc(deque->jobs, deque->capacity * sizeof(char *));
+    }
+    deque->jobs[deque->tail++] = job;
+    pthread_mutex_unlock(&deque->lock);
+}
+
+// Take a job at the tail (own deque) or at the head (stealing)
+static char *deque_take(struct walk_deque *deque, int steal)
+{
+    char *job = NULL;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->head < deque->tail)
+        job = steal ? deque->jobs[deque->head++] : deque->jobs[--deque->tail];
+    if (deque->head == deque->tail)
+    {
+        deque->head = 0;
+        deque->tail = 0;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return job;
+}
+
+static char *join_path(const char *dir, const char *name)
+{
+    size_t dir_len = strlen(dir);
+    size_t name_len = strlen(name);
+    char *path = xmalloc(dir_len + name_len + 2);
+    memcpy(path, dir, dir_len);
+    if (dir_len > 0)
+        path[dir_len++] = '/';
+    memcpy(path + dir_len, name, name_len + 1);
+    return path;
+}
+
+/**
+ * \brief Record an entry of the directory fd read at path
+ * @param is_dir: -1 if the type of the entry is unknown
+ */
+static void walk_entry(struct walker *walker, size_t id, int fd,
+                       const char *path, const char *name, int is_dir,
+                       struct walk_paths *subdirs)
+{
+    if (name[0] == '.')
+        return;
+    if (is_dir == -1)
+    {
+        struct stat st;
+        is_dir = fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0
+            && S_ISDIR(st.st_mode);
+    }
+    if (!is_dir && walker->mode == WALK_DIRS)
+        return;
+    char *entry = join_path(path, name);
+    paths_add(walker->results + id, entry);
+    // The results own the paths, the jobs only borrow them
+    if (is_dir)
+        paths_add(subdirs, entry);
+}
+
+#ifdef __linux__
+struct linux_dirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+static void read_entries(struct walker *walker, size_t id, int fd,
+                         const char *path, struct walk_paths *subdirs)
+{
+    uint64_t buf[WALK_BUF_SIZE / sizeof(uint64_t)];
+    long len;
+    while ((len = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0)
+    {
+        for (long pos = 0; pos < len;)
+        {
+            struct linux_dirent64 *entry =
+                (struct linux_dirent64 *)((char *)buf + pos);
+            int is_dir = -1;
+            if (entry->d_type != DT_UNKNOWN)
+                is_dir = entry->d_type == DT_DIR;
+            walk_entry(walker, id, fd, path, entry->d_name, is_dir, subdirs);
+            pos += entry->d_reclen;
+        }
+    }
+    close(fd);
+}
+#else
+static void read_entries(struct walker *walker, size_t id, int fd,
+                         const char *path, struct walk_paths *subdirs)
+{
+    DIR *dir = fdopendir(fd);
+    if (!dir)
+    {
+        close(fd);
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+        walk_entry(walker, id, fd, path, entry->d_name, -1, subdirs);
+    closedir(dir);
+}
+#endif
+
+// Read the directory at path and queue its subdirectories
+static void walk_dir(struct walker *walker, size_t id, const char *path)
+{
+    int fd = openat(walker->root_fd, path[0] == '\0' ? "." : path,
+                    O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd == -1)
+        return;
+    struct walk_paths subdirs = { NULL, 0, 0 };
+    read_entries(walker, id, fd, path, &subdirs);
+    if (subdirs.size == 0)
+        return;
+    // Count the jobs before they can be stolen and finished
+    pthread_mutex_lock(&walker->lock);
+    walker->pending += subdirs.size;
+    pthread_mutex_unlock(&walker->lock);
+    for (size_t i = subdirs.size; i > 0; i--)
+        deque_push(walker->deques + id, subdirs.data[i - 1]);
+    free(subdirs.data);
+    pthread_mutex_lock(&walker->lock);
+    walker->pushes++;
+    pthread_cond_broadcast(&walker->cond);
+    pthread_mutex_unlock(&walker->lock);
+}
+
+static char *next_job(struct walker *walker, size_t id)
+{
+    while (1)
+    {
+        pthread_mutex_lock(&walker->lock);
+        size_t pushes = walker->pushes;
+        pthread_mutex_unlock(&walker->lock);
+
+        char *job = deque_take(walker->deques + id, 0);
+        for (size_t i = 1; !job && i < walker->nb_workers; i++)
+            job = deque_take(walker->deques + (id + i) % walker->nb_workers,
+                             1);
+        if (job)
+            return job;
+
+        pthread_mutex_lock(&walker->lock);
+        if (walker->pending == 0)
+        {
+            pthread_mutex_unlock(&walker->lock);
+            return NULL;
+        }
+        if (walker->pushes == pushes)
+            pthread_cond_wait(&walker->cond, &walker->lock);
+        pthread_mutex_unlock(&walker->lock);
+    }
+}
+
+static void job_done(struct walker *walker)
+{
+    pthread_mutex_lock(&walker->lock);
+    if (--walker->pending == 0)
+        pthread_cond_broadcast(&walker->cond);
+    pthread_mutex_unlock(&walker->lock);
+}
+
+static void *walk_worker(void *data)
+{
+    struct walk_worker *worker = data;
+    char *job;
+    while ((job = next_job(worker->walker, worker->id)) != NULL)
+    {
+        walk_dir(worker->walker, worker->id, job);
+        job_done(worker->walker);
+    }
+    return NULL;
+}
+
+static size_t workers_number(void)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1)
+        return 1;
+    return cpus < WALK_MAX_THREADS ? cpus : WALK_MAX_THREADS;
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Gather the results of every worker and sort them
+static char **walk_results(struct walker *walker, size_t *count)
+{
+    *count = 0;
+    for (size_t i = 0; i < walker->nb_workers; i++)
+        *count += walker->results[i].size;
+    char **paths = xmalloc((*count + 1) * sizeof(char *));
+    size_t size = 0;
+    for (size_t i = 0; i < walker->nb_workers; i++)
+    {
+        struct walk_paths *results = walker->results + i;
+        if (results->size > 0)
+            memcpy(paths + size, results->data,
+                   results->size * sizeof(char *));
+        size += results->size;
+        free(results->data);
+    }
+    qsort(paths, *count, sizeof(char *), compare_paths);
+    paths[*count] = NULL;
+    return paths;
+}
+
+char **dir_walk(const char *root, enum walk_mode mode, size_t *count)
+{
+    struct walker walker;
+    walker.root_fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (walker.root_fd == -1)
+        return NULL;
+    walker.mode = mode;
+    walker.nb_workers = workers_number();
+    walker.deques = zalloc(walker.nb_workers * sizeof(struct walk_deque));
+    walker.results = zalloc(walker.nb_workers * sizeof(struct walk_paths));
+    walker.pending = 0;
+    walker.pushes = 0;
+    pthread_mutex_init(&walker.lock, NULL);
+    pthread_cond_init(&walker.cond, NULL);
+    for (size_t i = 0; i < walker.nb_workers; i++)
+        pthread_mutex_init(&walker.deques[i].lock, NULL);
+
+    // The root is read first, threads are only started for subdirectories
+    walk_dir(&walker, 0, "");
+    pthread_t threads[WALK_MAX_THREADS];
+    struct walk_worker workers[WALK_MAX_THREADS];
+    size_t started = 1;
+    for (size_t i = 0; i < walker.nb_workers; i++)
+    {
+        workers[i].walker = &walker;
+        workers[i].id = i;
+    }
+    if (walker.pending > 0)
+    {
+        for (; started < walker.nb_workers; started++)
+        {
+            if (pthread_create(threads + started, NULL, walk_worker,
+                               workers + started)
+                != 0)
+                break;
+        }
+    }
+    walk_worker(workers);
+    for (size_t i = 1; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    for (size_t i = 0; i < walker.nb_workers; i++)
+    {
+        free(walker.deques[i].jobs);
+        pthread_mutex_destroy(&walker.deques[i].lock);
+    }
+    free(walker.deques);
+    pthread_mutex_destroy(&walker.lock);
+    pthread_cond_destroy(&walker.cond);
+    close(walker.root_fd);
+    char **paths = walk_results(&walker, count);
+    free(walker.results);
+    return paths;
+}
+
+void dir_walk_free(char **paths, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        free(paths[i]);
+    free(paths);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * \brief Maximum number of threads reading directories during a walk
+ */
+#define WALK_MAX_THREADS 8
+
+enum walk_mode
+{
+    WALK_ALL,
+    WALK_DIRS
+};
+
+/**
+ * \brief List every entry below root, or only the directories with
+ * WALK_DIRS, skipping hidden entries and not following symbolic links
+ * @details Directories are read by a bounded pool of threads, each one
+ * taking the pending directories of the others once its own are done
+ * @param count: set to the number of paths returned
+ * @return: the paths relative to root sorted with strcmp, NULL if root can
+ * not be opened
+ */
+char **dir_walk(const char *root, enum walk_mode mode, size_t *count);
+
+void dir_walk_free(char **paths, size_t count);
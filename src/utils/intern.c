@@ -0,0 +1,90 @@
+#include <stdint.h>
+#include <string.h>
+#include <utils/alloc.h>
+#include <utils/arena.h>
+#include <utils/intern.h>
+
+/**
+ * \brief A slot of the table, str being NULL when it is empty
+ */
+struct intern_entry
+{
+    const char *str;
+    size_t len;
+    uint64_t hash;
+};
+
+static struct intern_entry *table = NULL;
+static size_t capacity = 0;
+static size_t count = 0;
+// The strings themselves, which live as long as the table
+static struct arena strings = { NULL, NULL, 0 };
+
+// FNV-1a
+static uint64_t hash_of(const char *str, size_t len)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= (unsigned char)str[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Return the slot of str, or the empty slot where it would go
+static struct intern_entry *lookup(const char *str, size_t len, uint64_t hash)
+{
+    size_t i = hash & (capacity - 1);
+    while (table[i].str != NULL
+           && (table[i].hash != hash || table[i].len != len
+               || memcmp(table[i].str, str, len) != 0))
+        i = (i + 1) & (capacity - 1);
+    return &table[i];
+}
+
+static void grow(void)
+{
+    struct intern_entry *old = table;
+    size_t old_capacity = capacity;
+    capacity = capacity ? capacity * 2 : INTERN_MIN_CAPACITY;
+    table = zalloc(capacity * sizeof(struct intern_entry));
+    for (size_t i = 0; i < old_capacity; i++)
+    {
+        if (old[i].str != NULL)
+            *lookup(old[i].str, old[i].len, old[i].hash) = old[i];
+    }
+    free(old);
+}
+
+const char *intern(const char *str, size_t len)
+{
+    if ((count + 1) * 2 > capacity)
+        grow();
+    uint64_t hash = hash_of(str, len);
+    struct intern_entry *entry = lookup(str, len, hash);
+    if (entry->str == NULL)
+    {
+        entry->str = arena_strndup(&strings, str, len);
+        entry->len = len;
+        entry->hash = hash;
+        count++;
+    }
+    return entry->str;
+}
+
+const char *intern_find(const char *str, size_t len)
+{
+    if (count == 0)
+        return NULL;
+    return lookup(str, len, hash_of(str, len))->str;
+}
+
+void intern_destroy(void)
+{
+    free(table);
+    table = NULL;
+    capacity = 0;
+    count = 0;
+    arena_destroy(&strings);
+}
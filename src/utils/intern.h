@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * \brief Size of the table of interned strings when it is first used
+ */
+#define INTERN_MIN_CAPACITY 256
+
+/**
+ * \brief Return the interned copy of the len first characters of str,
+ * adding it to the table if needed
+ * @details Equal strings are interned at the same address, so interned
+ * strings are compared by pointer. They are never freed before
+ * intern_destroy.
+ */
+const char *intern(const char *str, size_t len);
+
+/**
+ * \brief Return the interned copy of the len first characters of str,
+ * NULL if they were never interned
+ * @details Names which are not interned are not the name of anything, so
+ * lookups do not add them
+ */
+const char *intern_find(const char *str, size_t len);
+
+/** \brief Free every interned string */
+void intern_destroy(void);
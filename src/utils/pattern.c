@@ -0,0 +1,195 @@
+#include <ctype.h>
+#include <string.h>
+#include <utils/alloc.h>
+#include <utils/pattern.h>
+
+static void set_add(uint64_t *set, unsigned char c)
+{
+    set[c / 64] |= (uint64_t)1 << (c % 64);
+}
+
+static int set_has(const uint64_t *set, unsigned char c)
+{
+    return (set[c / 64] >> (c % 64)) & 1;
+}
+
+static const struct
+{
+    const char *name;
+    int (*func)(int c);
+} classes[] = {
+    { "alnum", isalnum }, { "alpha", isalpha }, { "blank", isblank },
+    { "cntrl", iscntrl }, { "digit", isdigit }, { "graph", isgraph },
+    { "lower", islower }, { "print", isprint }, { "punct", ispunct },
+    { "space", isspace }, { "upper", isupper }, { "xdigit", isxdigit },
+};
+
+#define CLASSES_NB (sizeof(classes) / sizeof(*classes))
+
+// Add a [:class:] to the set, return its length, 0 if it is not one
+static size_t parse_class(const char *str, uint64_t *set)
+{
+    for (size_t i = 0; i < CLASSES_NB; i++)
+    {
+        size_t len = strlen(classes[i].name);
+        if (strncmp(str + 2, classes[i].name, len) != 0
+            || strncmp(str + 2 + len, ":]", 2) != 0)
+            continue;
+        for (int c = 0; c < 256; c++)
+        {
+            if (classes[i].func(c))
+                set_add(set, c);
+        }
+        return len + 4;
+    }
+    return 0;
+}
+
+// Parse a bracket expression, return its length, 0 if it is not closed
+static size_t parse_set(const char *str, struct pattern_elem *elem)
+{
+    size_t i = 1;
+    int negate = str[i] == '!' || str[i] == '^';
+    if (negate)
+        i++;
+    memset(elem->set, 0, sizeof(elem->set));
+    size_t first = i;
+    while (str[i] != '\0' && (str[i] != ']' || i == first))
+    {
+        size_t len = 0;
+        if (str[i] == '[' && str[i + 1] == ':'
+            && (len = parse_class(str + i, elem->set)) != 0)
+        {
+            i += len;
+            continue;
+        }
+        if (str[i] == '\\' && str[i + 1] != '\0')
+            i++;
+        unsigned char low = str[i++];
+        unsigned char high = low;
+        if (str[i] == '-' && str[i + 1] != ']' && str[i + 1] != '\0')
+        {
+            if (str[i + 1] == '\\' && str[i + 2] != '\0')
+                i++;
+            high = str[i + 1];
+            i += 2;
+        }
+        for (unsigned c = low; c <= high; c++)
+            set_add(elem->set, c);
+    }
+    if (str[i] != ']')
+        return 0;
+    if (negate)
+    {
+        for (size_t j = 0; j < 4; j++)
+            elem->set[j] = ~elem->set[j];
+    }
+    elem->type = PATTERN_SET;
+    return i + 1;
+}
+
+struct pattern *pattern_compile(const char *str)
+{
+    struct pattern *pattern = zalloc(sizeof(struct pattern));
+    // A pattern never has more elements than characters
+    pattern->elems = xmalloc((strlen(str) + 1) * sizeof(struct pattern_elem));
+    size_t i = 0;
+    while (str[i] != '\0')
+    {
+        struct pattern_elem *elem = pattern->elems + pattern->size;
+        if (str[i] == '*')
+        {
+            i++;
+            // Consecutive stars are the same as one
+            if (pattern->size > 0 && elem[-1].type == PATTERN_STAR)
+                continue;
+            elem->type = PATTERN_STAR;
+        }
+        else if (str[i] == '?')
+        {
+            i++;
+            elem->type = PATTERN_ANY;
+        }
+        else if (str[i] == '[' && parse_set(str + i, elem) != 0)
+            i += parse_set(str + i, elem);
+        else
+        {
+            if (str[i] == '\\' && str[i + 1] != '\0')
+                i++;
+            elem->type = PATTERN_CHAR;
+            elem->c = str[i++];
+        }
+        pattern->size++;
+    }
+    return pattern;
+}
+
+static int elem_match(const struct pattern_elem *elem, unsigned char c)
+{
+    switch (elem->type)
+    {
+    case PATTERN_CHAR:
+        return elem->c == c;
+    case PATTERN_SET:
+        return set_has(elem->set, c);
+    default:
+        return 1;
+    }
+}
+
+int pattern_match(const struct pattern *pattern, const char *str)
+{
+    const struct pattern_elem *elems = pattern->elems;
+    size_t size = pattern->size;
+    size_t p = 0;
+    size_t s = 0;
+    // On a mismatch, only the last star needs to absorb one more character:
+    // whatever an earlier star could absorb, the last one can too
+    size_t star = SIZE_MAX;
+    size_t star_end = 0;
+    while (str[s] != '\0')
+    {
+        if (p < size && elems[p].type == PATTERN_STAR)
+        {
+            star = ++p;
+            star_end = s;
+        }
+        else if (p < size && elem_match(elems + p, str[s]))
+        {
+            p++;
+            s++;
+        }
+        else if (star != SIZE_MAX)
+        {
+            p = star;
+            s = ++star_end;
+        }
+        else
+            return 0;
+    }
+    while (p < size && elems[p].type == PATTERN_STAR)
+        p++;
+    return p == size;
+}
+
+int pattern_has_glob(const char *str)
+{
+    struct pattern_elem elem;
+    for (size_t i = 0; str[i] != '\0'; i++)
+    {
+        if (str[i] == '\\' && str[i + 1] != '\0')
+            i++;
+        else if (str[i] == '*' || str[i] == '?'
+                 || (str[i] == '[' && parse_set(str + i, &elem) != 0))
+            return 1;
+    }
+    return 0;
+}
+
+void pattern_free(struct pattern *pattern)
+{
+    if (!pattern)
+        return;
+    free(pattern->elems);
+    free(pattern);
+}
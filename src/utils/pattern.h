@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum pattern_type
+{
+    PATTERN_CHAR,
+    PATTERN_ANY,
+    PATTERN_STAR,
+    PATTERN_SET
+};
+
+/**
+ * \brief An element of a compiled pattern
+ * @details set is a bitmap of the 256 characters matched by a bracket
+ * expression, c the character of PATTERN_CHAR
+ */
+struct pattern_elem
+{
+    enum pattern_type type;
+    unsigned char c;
+    uint64_t set[4];
+};
+
+/**
+ * \brief A shell pattern (* ? [...] and \ escapes) compiled once and matched
+ * without backtracking recursion
+ */
+struct pattern
+{
+    struct pattern_elem *elems;
+    size_t size;
+};
+
+/** Compile a pattern, a '[' without matching ']' is an ordinary character */
+struct pattern *pattern_compile(const char *str);
+
+/** Return 1 if str matches the whole pattern, 0 otherwise */
+int pattern_match(const struct pattern *pattern, const char *str);
+
+/** Return 1 if str contains an unescaped * ? or bracket expression */
+int pattern_has_glob(const char *str);
+
+void pattern_free(struct pattern *pattern);
@@ -0,0 +1,182 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utils/alloc.h>
+#include <utils/slab.h>
+
+#ifdef __SANITIZE_ADDRESS__
+#    include <sanitizer/asan_interface.h>
+#endif
+
+#define SLAB_ALIGN 16
+#define SLAB_CLASSES 8
+#define SLAB_MAX_SIZE (SLAB_ALIGN * SLAB_CLASSES)
+#define SLAB_CHUNK_SIZE 16384
+#define SLAB_POISON 0xa5
+
+/**
+ * \brief A freed object, linked to the next one of its class
+ */
+struct slab_object
+{
+    struct slab_object *next;
+};
+
+/**
+ * \brief A block of objects of one class, linked to the previous one
+ */
+struct slab_chunk
+{
+    struct slab_chunk *next;
+};
+
+struct slab_class
+{
+    struct slab_object *free;
+    char *cur;
+    char *end;
+};
+
+static struct slab_class classes[SLAB_CLASSES];
+static struct slab_chunk *chunks = NULL;
+static struct slab_counter counters[SLAB_TYPES_NB];
+
+static const char *slab_names[SLAB_TYPES_NB] = {
+    "variables", "functions", "tokens", "case items", "vectors"
+};
+
+// The data of a chunk starts at the first aligned address after its header
+#define CHUNK_HEADER                                                           \
+    ((sizeof(struct slab_chunk) + SLAB_ALIGN - 1) & ~(size_t)(SLAB_ALIGN - 1))
+
+static void poison(void *ptr, size_t size)
+{
+#ifdef __SANITIZE_ADDRESS__
+    ASAN_POISON_MEMORY_REGION(ptr, size);
+#elif defined(SLAB_POISONING)
+    // The link to the next free object is kept
+    memset((char *)ptr + sizeof(struct slab_object), SLAB_POISON,
+           size - sizeof(struct slab_object));
+#else
+    (void)ptr;
+    (void)size;
+#endif
+}
+
+static void unpoison(void *ptr, size_t size)
+{
+#ifdef __SANITIZE_ADDRESS__
+    ASAN_UNPOISON_MEMORY_REGION(ptr, size);
+#elif defined(SLAB_POISONING)
+    const unsigned char *bytes = ptr;
+    for (size_t i = sizeof(struct slab_object); i < size; i++)
+    {
+        if (bytes[i] != SLAB_POISON)
+        {
+            fprintf(stderr, "42sh: slab: object %p written after free\n",
+                    ptr);
+            abort();
+        }
+    }
+#else
+    (void)ptr;
+    (void)size;
+#endif
+}
+
+// Carve the objects of a class from a new chunk
+static void class_grow(struct slab_class *class)
+{
+    struct slab_chunk *chunk = xmalloc(CHUNK_HEADER + SLAB_CHUNK_SIZE);
+    chunk->next = chunks;
+    chunks = chunk;
+    class->cur = (char *)chunk + CHUNK_HEADER;
+    class->end = class->cur + SLAB_CHUNK_SIZE;
+#ifdef __SANITIZE_ADDRESS__
+    ASAN_POISON_MEMORY_REGION(class->cur, SLAB_CHUNK_SIZE);
+#endif
+}
+
+static void count_alloc(enum slab_type type)
+{
+    struct slab_counter *counter = &counters[type];
+    if (++counter->live > counter->peak)
+        counter->peak = counter->live;
+}
+
+void *slab_alloc(enum slab_type type, size_t size)
+{
+    count_alloc(type);
+    size = (size + SLAB_ALIGN - 1) & ~(size_t)(SLAB_ALIGN - 1);
+    if (size == 0 || size > SLAB_MAX_SIZE)
+        return zalloc(size);
+    struct slab_class *class = &classes[size / SLAB_ALIGN - 1];
+    void *res = NULL;
+    if (class->free)
+    {
+        struct slab_object *object = class->free;
+#ifdef __SANITIZE_ADDRESS__
+        ASAN_UNPOISON_MEMORY_REGION(object, sizeof(struct slab_object));
+#endif
+        class->free = object->next;
+        unpoison(object, size);
+        res = object;
+    }
+    else
+    {
+        if (class->end - class->cur < (ptrdiff_t)size)
+            class_grow(class);
+        res = class->cur;
+        class->cur += size;
+#ifdef __SANITIZE_ADDRESS__
+        ASAN_UNPOISON_MEMORY_REGION(res, size);
+#endif
+    }
+    return memset(res, 0, size);
+}
+
+void slab_free(enum slab_type type, void *ptr, size_t size)
+{
+    if (ptr == NULL)
+        return;
+    counters[type].live--;
+    size = (size + SLAB_ALIGN - 1) & ~(size_t)(SLAB_ALIGN - 1);
+    if (size == 0 || size > SLAB_MAX_SIZE)
+    {
+        free(ptr);
+        return;
+    }
+    struct slab_class *class = &classes[size / SLAB_ALIGN - 1];
+    struct slab_object *object = ptr;
+    object->next = class->free;
+    class->free = object;
+    poison(object, size);
+}
+
+const struct slab_counter *slab_counter(enum slab_type type)
+{
+    return &counters[type];
+}
+
+void slab_print_stats(FILE *out)
+{
+    fprintf(out, "%-12s %10s %10s\n", "slab", "live", "peak");
+    for (size_t i = 0; i < SLAB_TYPES_NB; i++)
+        fprintf(out, "%-12s %10zu %10zu\n", slab_names[i], counters[i].live,
+                counters[i].peak);
+}
+
+void slab_destroy(void)
+{
+    while (chunks)
+    {
+        struct slab_chunk *next = chunks->next;
+#ifdef __SANITIZE_ADDRESS__
+        ASAN_UNPOISON_MEMORY_REGION(chunks, CHUNK_HEADER + SLAB_CHUNK_SIZE);
+#endif
+        free(chunks);
+        chunks = next;
+    }
+    memset(classes, 0, sizeof(classes));
+}
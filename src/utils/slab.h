@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * \brief The structures allocated from the slabs, counted separately
+ */
+enum slab_type
+{
+    SLAB_VAR,
+    SLAB_FUNCTION,
+    SLAB_TOKEN,
+    SLAB_CASE,
+    SLAB_VEC,
+    SLAB_TYPES_NB
+};
+
+/**
+ * \brief The objects of one type currently allocated, and the most there
+ * ever were
+ */
+struct slab_counter
+{
+    size_t live;
+    size_t peak;
+};
+
+/**
+ * \brief Allocate a zeroed object of size bytes
+ * @details Objects are rounded up to a multiple of 16 bytes, each size
+ * class taking them from its own free list, or else from its current chunk.
+ * Objects larger than the largest class come from malloc.
+ */
+void *slab_alloc(enum slab_type type, size_t size);
+
+/**
+ * \brief Give back an object of size bytes to the free list of its class
+ * @details Builds with -Dslab_poison=true or the address sanitizer poison
+ * the object, and check on its next allocation that it was not written to
+ * in the meantime
+ */
+void slab_free(enum slab_type type, void *ptr, size_t size);
+
+/** \brief Return the counter of the objects of a type */
+const struct slab_counter *slab_counter(enum slab_type type);
+
+/** \brief Print the live and peak objects of each type */
+void slab_print_stats(FILE *out);
+
+/** \brief Free every chunk: the objects must not be used anymore */
+void slab_destroy(void);
@@ -3,6 +3,7 @@
 #include <ctype.h>
 #include <stddef.h>
 #include <string.h>
+#include <utils/slab.h>
 
 /**
  * \brief: Return wether the sequence of \ escape itself
@@ -76,7 +77,7 @@ void cas_free(struct cas *cas)
         struct cas *tmp = cas->next;
         free(cas->pattern);
         ast_free(cas->ast);
-        free(cas);
+        slab_free(SLAB_CASE, cas, sizeof(struct cas));
         cas = tmp;
     }
 }
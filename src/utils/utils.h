@@ -15,6 +15,8 @@ struct opts
     int p;
     int c;
     int optind;
+    int spawn_server;
+    int alloc_stats;
     char *input;
 };
 
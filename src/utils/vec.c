@@ -1,14 +1,12 @@
 #include <stdio.h>
+#include <string.h>
 #include <utils/alloc.h>
+#include <utils/slab.h>
 #include <utils/vec.h>
 
 struct vec *vec_init(void)
 {
-    struct vec *vec = xmalloc(sizeof(struct vec));
-    vec->data = NULL;
-    vec->size = 0;
-    vec->capacity = 0;
-    return vec;
+    return slab_alloc(SLAB_VEC, sizeof(struct vec));
 }
 
 void vec_destroy(struct vec *vec)
@@ -21,6 +19,12 @@ void vec_destroy(struct vec *vec)
     vec->data = NULL;
 }
 
+void vec_free(struct vec *vec)
+{
+    free(vec->data);
+    slab_free(SLAB_VEC, vec, sizeof(struct vec));
+}
+
 static void vec_grow(struct vec *vec)
 {
     size_t new_capacity;
@@ -34,6 +38,35 @@ static void vec_grow(struct vec *vec)
     vec->capacity = new_capacity;
 }
 
+void vec_reserve(struct vec *vec, size_t len)
+{
+    if (vec->size + len <= vec->capacity)
+        return;
+    size_t new_capacity = vec->capacity == 0 ? 10 : vec->capacity * 2;
+    if (new_capacity < vec->size + len)
+        new_capacity = vec->size + len;
+    vec->data = xrealloc(vec->data, new_capacity);
+    vec->capacity = new_capacity;
+}
+
+void vec_append(struct vec *vec, const char *str, size_t len)
+{
+    vec_reserve(vec, len);
+    memcpy(vec->data + vec->size, str, len);
+    vec->size += len;
+}
+
+char *vec_release(struct vec *vec)
+{
+    vec_reserve(vec, 1);
+    vec->data[vec->size] = '\0';
+    char *data = vec->data;
+    vec->data = NULL;
+    vec->size = 0;
+    vec->capacity = 0;
+    return data;
+}
+
 void vec_reset(struct vec *vec)
 {
     vec->size = 0;
@@ -58,7 +91,7 @@ struct vec *vec_concat(struct vec *vec, struct vec *vec2)
 {
     if (!vec)
     {
-        vec = zalloc(sizeof(struct vec));
+        vec = slab_alloc(SLAB_VEC, sizeof(struct vec));
         vec->data = strdup("");
         vec->size = 1;
         vec->capacity = 1;
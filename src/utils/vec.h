@@ -18,12 +18,27 @@ struct vec *vec_init(void);
 /** Releases the memory allocated for the vector */
 void vec_destroy(struct vec *vec);
 
+/** Releases the vector allocated by vec_init and its memory */
+void vec_free(struct vec *vec);
+
 /** Remove all characters from the vector, without releasing memory */
 void vec_reset(struct vec *vec);
 
 /** Add a character at the end of the vector */
 void vec_push(struct vec *vec, char c);
 
+/** Make room for len more characters, at least doubling the capacity */
+void vec_reserve(struct vec *vec, size_t len);
+
+/** Add the len first characters of str at the end of the vector */
+void vec_append(struct vec *vec, const char *str, size_t len);
+
+/**
+ * Terminate the characters of the vector by a NUL byte which is not counted
+ * in its size, and give them to the caller, who frees them
+ */
+char *vec_release(struct vec *vec);
+
 /** Ensures the array has a NUL byte at the end, and returns it */
 char *vec_cstring(struct vec *vec);
 
@@ -0,0 +1,26 @@
+#!/bin/sh
+# Time growing a variable by appending to it
+# usage: append.sh [shell] [count]
+
+SHELL_BIN=${1:-../../builddir/42sh}
+COUNT=${2:-20000}
+
+now()
+{
+    date +%s%N
+}
+
+bench()
+{
+    name=$1
+    script=$2
+    start=$(now)
+    "$SHELL_BIN" -c "$script" > /dev/null
+    end=$(now)
+    printf '%-24s %8d times %8d ms\n' "$name" "$COUNT" \
+        "$(( (end - start) / 1000000 ))"
+}
+
+bench 's="$s ..."' "s=; for i in \$(seq $COUNT); do s=\"\$s 0123456789\"; done; echo \${#s}"
+bench 's+=...' "s=; for i in \$(seq $COUNT); do s+=' 0123456789'; done; echo \${#s}"
+bench 'a+=(...)' "a=(); for i in \$(seq $COUNT); do a+=(\$i); done; echo \${#a[@]}"
@@ -0,0 +1,38 @@
+#!/bin/sh
+# Compare counting loop idioms
+# usage: for_loop.sh [shell] [iterations] [forking iterations]
+# Idioms forking a process per iteration run fewer iterations, all times
+# are reported per iteration.
+
+SHELL_BIN=${1:-../../builddir/42sh}
+N=${2:-1000000}
+FORK_N=${3:-10000}
+
+now()
+{
+    date +%s%N
+}
+
+bench()
+{
+    name=$1
+    count=$2
+    script=$3
+    start=$(now)
+    "$SHELL_BIN" -c "$script" > /dev/null
+    end=$(now)
+    total=$(( (end - start) / 1000000 ))
+    printf '%-28s %8d iterations %8d ms %8d ns/iteration\n' "$name" "$count" \
+        "$total" "$(( (end - start) / count ))"
+}
+
+bench 'for ((;;))' "$N" \
+    "for ((i = 0; i < $N; i++)); do x=1; done"
+bench 'while (( ))' "$N" \
+    "i=0; while ((i < $N)); do ((i++)); done"
+bench 'while [ ] $(( ))' "$FORK_N" \
+    "i=0; while [ \$i -lt $FORK_N ]; do i=\$((i + 1)); done"
+bench 'for in $(seq)' "$FORK_N" \
+    "for i in \$(seq $FORK_N); do x=1; done"
+bench 'for in {1..n}' "$N" \
+    "for i in {1..$N}; do x=1; done"
@@ -0,0 +1,33 @@
+#!/bin/sh
+# Time pathname expansion over a large directory, repeated in a loop
+# usage: glob.sh [shell] [entries] [iterations]
+
+SHELL_BIN=${1:-../../builddir/42sh}
+ENTRIES=${2:-100000}
+N=${3:-100}
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+(cd "$DIR" && seq -f 'file%06g.txt' "$ENTRIES" | xargs touch)
+# Listings of directories modified during the current second are not cached
+sleep 1
+
+now()
+{
+    date +%s%N
+}
+
+bench()
+{
+    name=$1
+    script=$2
+    start=$(now)
+    (cd "$DIR" && "$SHELL_BIN" -c "$script" > /dev/null)
+    end=$(now)
+    printf '%-24s %6d entries %6d iterations %8d us/iteration\n' "$name" \
+        "$ENTRIES" "$N" "$(( (end - start) / N / 1000 ))"
+}
+
+bench 'glob *9.txt' "for i in \$(seq $N); do echo *9.txt; done"
+bench 'glob [a-f]*12?.txt' "for i in \$(seq $N); do echo [a-f]*12?.txt; done"
+bench 'glob file0?00[0-4]*' "for i in \$(seq $N); do echo file0?00[0-4]*; done"
@@ -0,0 +1,38 @@
+#!/bin/sh
+# Time recursive ** globs against forking find over a generated tree
+# usage: globstar.sh [shell] [directories] [files per directory]
+
+SHELL_BIN=${1:-../../builddir/42sh}
+DIRS=${2:-2000}
+FILES=${3:-50}
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+(
+    cd "$DIR" || exit 1
+    for d in $(seq "$DIRS"); do
+        sub="d$((d % 20))/e$((d % 7))/f$d"
+        mkdir -p "$sub"
+        (cd "$sub" && seq -f 'file%g.txt' "$FILES" | xargs touch && touch x.log)
+    done
+)
+
+now()
+{
+    date +%s%N
+}
+
+bench()
+{
+    name=$1
+    script=$2
+    start=$(now)
+    (cd "$DIR" && "$SHELL_BIN" -c "$script" > /dev/null)
+    end=$(now)
+    printf '%-24s %8d files %8d ms\n' "$name" "$((DIRS * (FILES + 1)))" \
+        "$(( (end - start) / 1000000 ))"
+}
+
+bench 'echo **/*.log' 'echo **/*.log'
+bench 'echo d1*/**/x.log' 'echo d1*/**/x.log'
+bench 'find -name *.log' "find . -name '*.log'"
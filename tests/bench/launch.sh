@@ -0,0 +1,39 @@
+#!/bin/sh
+# Time launching an external command as the memory of the shell grows
+# usage: launch.sh [shell] [launches] [sizes in MB...]
+# The shell grows by loading a file into an array, the time of the load is
+# measured apart and removed. SHELL_OPTS are given to the shell, such as
+# --spawn-server.
+
+SHELL_BIN=${1:-../../builddir/42sh}
+N=${2:-2000}
+shift 2 2>/dev/null
+SIZES=${*:-0 64 256 1024}
+
+FILE=$(mktemp)
+trap 'rm -f "$FILE"' EXIT
+
+now()
+{
+    date +%s%N
+}
+
+run()
+{
+    start=$(now)
+    "$SHELL_BIN" $SHELL_OPTS -c "$1" > /dev/null
+    end=$(now)
+    echo $((end - start))
+}
+
+for size in $SIZES; do
+    # Lines of 100 bytes
+    seq -f '%099g' $((size * 10000)) > "$FILE"
+    load="mapfile -t a < $FILE"
+    rss=$("$SHELL_BIN" $SHELL_OPTS -c "$load; grep VmRSS /proc/\$\$/status" |
+        awk '{ print int($2 / 1024) }')
+    base=$(run "$load")
+    total=$(run "$load; for i in \$(seq $N); do /bin/true; done")
+    printf '%6d MB rss %8d launches %8d us/launch\n' "$rss" "$N" \
+        "$(( (total - base) / N / 1000 ))"
+done
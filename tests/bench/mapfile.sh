@@ -0,0 +1,29 @@
+#!/bin/sh
+# Time loading a large file into an array
+# usage: mapfile.sh [shell] [lines]
+
+SHELL_BIN=${1:-../../builddir/42sh}
+LINES=${2:-1000000}
+
+FILE=$(mktemp)
+trap 'rm -f "$FILE"' EXIT
+seq -f 'host%07g.example.com 10.0.0.1 up' "$LINES" > "$FILE"
+
+now()
+{
+    date +%s%N
+}
+
+bench()
+{
+    name=$1
+    script=$2
+    start=$(now)
+    "$SHELL_BIN" -c "$script" > /dev/null
+    end=$(now)
+    printf '%-24s %8d lines %8d ms\n' "$name" "$LINES" \
+        "$(( (end - start) / 1000000 ))"
+}
+
+bench 'mapfile file' "mapfile -t a < $FILE; echo \${#a[@]}"
+bench 'mapfile -s -n' "mapfile -t -s 1000 -n 1000 a < $FILE; echo \${a[0]}"
@@ -1,7 +1,7 @@
 from argparse import ArgumentParser
 from pathlib import Path
 from dataclasses import dataclass, field
-from typing import List
+from typing import List, Optional
 
 import subprocess as sp
 import termcolor
@@ -13,6 +13,11 @@ class TestCase:
     name: str
     input: str
     checks: List[str] = field(default_factory=lambda: ["stdout", "stderr", "exitcode"])
+    # shell used to compute the expected output, for non POSIX features
+    reference: str = "dash"
+    # expected output of features no reference shell has
+    stdout: Optional[str] = None
+    exitcode: int = 0
 
 OK_TAG = f"[ {termcolor.colored('OK', 'green')} ]"
 KO_TAG = f"[ {termcolor.colored('KO', 'red')} ]"
@@ -26,6 +31,11 @@ def diff(expected: str, actual: str) -> str:
 def run_shell(shell: str, stdin: str) -> sp.CompletedProcess:
     return sp.run([shell], input=stdin, capture_output=True, text=True)
 
+def expected_result(testcase: TestCase) -> sp.CompletedProcess:
+    if testcase.stdout is None:
+        return run_shell(testcase.reference, testcase.input)
+    return sp.CompletedProcess([], testcase.exitcode, testcase.stdout, "")
+
 def perform_checks(expected: sp.CompletedProcess, actual: sp.CompletedProcess, checks):
     assert "has_stderr" not in checks or actual.stderr != "", \
         "Something was expected on stderr"
@@ -55,7 +65,7 @@ if __name__ == "__main__":
     for testcase in testsuite:
         stdin = testcase.input
         name = testcase.name
-        dash_proc = run_shell("dash", stdin)
+        dash_proc = expected_result(testcase)
         sh_proc = run_shell(binary_path, stdin)
         test_nb += 1
         try: